@@ -157,9 +157,6 @@
 /* Define to 1 if you have the <zlib.h> header file. */
 #define HAVE_ZLIB_H 1
 
-/* ${desc_zzip} enabled */
-#define HAVE_ZZIP 1
-
 /* mkstemp() available */
 #define LUA_USE_MKSTEMP 1
 
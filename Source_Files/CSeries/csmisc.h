@@ -24,6 +24,12 @@
 #define MACHINE_TICKS_PER_SECOND 1000
 
 extern uint32 machine_tick_count(void);
+
+// Microseconds since some arbitrary point; for timing things shorter than a tick
+extern Uint64 machine_microsecond_count(void);
+
+// Number of processors online (at least 1)
+extern int get_processor_count(void);
 extern bool wait_for_click_or_keypress(
 	uint32 ticks);
 
@@ -26,6 +26,19 @@
 
 #include "cseries.h"
 
+#ifdef HAVE_SYSCONF
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYSCTLBYNAME
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
 
 /*
  *  Return tick counter
@@ -37,6 +50,54 @@ uint32 machine_tick_count(void)
 }
 
 
+/*
+ *  Return microsecond counter
+ */
+
+Uint64 machine_microsecond_count(void)
+{
+#ifdef __WIN32__
+	static LARGE_INTEGER frequency = {{0, 0}};
+	LARGE_INTEGER count;
+	if (frequency.QuadPart == 0 && !QueryPerformanceFrequency(&frequency))
+		return Uint64(SDL_GetTicks()) * 1000;
+	QueryPerformanceCounter(&count);
+	return Uint64(count.QuadPart / frequency.QuadPart) * 1000000 + Uint64(count.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return Uint64(now.tv_sec) * 1000000 + now.tv_usec;
+#endif
+}
+
+
+/*
+ *  Return number of processors
+ */
+
+int get_processor_count(void)
+{
+	static int count = 0;
+	if (count == 0) {
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+		count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#ifdef HAVE_SYSCTLBYNAME
+		size_t size = sizeof(count);
+		sysctlbyname("hw.ncpu", &count, &size, NULL, 0);
+#endif
+#ifdef __WIN32__
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		count = info.dwNumberOfProcessors;
+#endif
+		if (count <= 0)
+			count = 1;
+	}
+	return count;
+}
+
+
 /*
  *  Wait for mouse click or keypress
  */
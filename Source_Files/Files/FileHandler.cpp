@@ -49,10 +49,7 @@
 #include <unistd.h>
 #endif
 
-#ifdef HAVE_ZZIP
-#include <zzip/lib.h>
-#include "SDL_rwops_zzip.h"
-#endif
+#include "ZipArchive.h"
 
 #if defined(__WIN32__)
 #define PATH_SEP '\\'
@@ -363,16 +360,11 @@ bool FileSpecifier::Open(OpenedFile &OFile, bool Writable)
 {
 	OFile.Close();
 
-	SDL_RWops *f;
+	SDL_RWops *f = OFile.f = SDL_RWFromFile(GetPath(), Writable ? "wb+" : "rb");
+	if (!f && !Writable)
 	{
-#ifdef HAVE_ZZIP
-		if (!Writable)
-		{
-			f = OFile.f = SDL_RWFromZZIP(unix_path_separators(GetPath()).c_str(), "rb");
-		} 
-		else
-#endif
-		f = OFile.f = SDL_RWFromFile(GetPath(), Writable ? "wb+" : "rb");
+		// maybe it's inside a zipped plugin or scenario
+		f = OFile.f = SDL_RWFromZipArchive(unix_path_separators(GetPath()));
 	}
 
 	err = f ? 0 : errno;
@@ -424,22 +416,12 @@ bool FileSpecifier::Exists()
 	if (access(GetPath(), R_OK) < 0)
 		err = errno;
 	
-#ifdef HAVE_ZZIP
 	if (err)
 	{
-		// Check whether zzip can open the file (slow!)
-		ZZIP_FILE* file = zzip_open(unix_path_separators(GetPath()).c_str(), R_OK);
-		if (file)
-		{
-			zzip_close(file);
-			return true;
-		}
-		else
-		{
-			return false;
-		}
+		// Check whether it's inside a zip archive
+		return zip_archive_member_exists(unix_path_separators(GetPath()));
 	}
-#endif
+
 	return (err == 0);
 }
 
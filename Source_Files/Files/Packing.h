@@ -51,11 +51,36 @@
 	BytesToStream(uint8* &Stream, const void* Bytes, size_t Count)
 		packs a block of bytes into a stream
 
+	Field schemas: a struct's packed layout can instead be declared once, as
+
+	template<class Visitor> void packing_schema(Visitor& V, endpoint_data& Object)
+	{
+		V(Object.flags);	// numerical values, arrays and nested structs
+		...
+		V.unused(Object.unused);	// padding that's also in the struct
+		V.skip(2*2);		// padding that's only in the packed form
+	}
+
+	and then
+	
+	unpack_with_schema(uint8* Stream, T* Objects, size_t Count, size_t PackedSize)
+		unpacks a stream into a list of objects, returning the new stream position
+	
+	pack_with_schema(uint8* Stream, T* Objects, size_t Count, size_t PackedSize)
+		packs a list of objects into a stream, returning the new stream position
+	
+	Nested structs need a packing_schema of their own. When the struct's native
+	layout is its packed layout apart from byte order (only 16- and 32-bit values,
+	at their packed offsets, and no packing-only padding) whole lists are copied
+	and then byte-swapped in one pass instead of going field by field.
+
 Aug 27, 2002 (Alexander Strange):
 	Moved functions to Packing.cpp to get around inlining issues.
 */
 
 //#include <string.h>
+#include <utility>
+#include <vector>
 
 // Default: packed-data is big-endian.
 // May be overridden by some previous definition,
@@ -116,5 +141,205 @@ inline static void BytesToStream(uint8* &Stream, const void* Bytes, size_t Count
     memcpy(Stream,Bytes,Count);
     Stream += Count;
 }
+
+#if (defined(PACKED_DATA_IS_BIG_ENDIAN) && SDL_BYTEORDER == SDL_LIL_ENDIAN) || \
+	(defined(PACKED_DATA_IS_LITTLE_ENDIAN) && SDL_BYTEORDER == SDL_BIG_ENDIAN)
+#define PACKING_SWAPS_BYTES
+#endif
+
+// Dispatches the fields a packing_schema hands it to the derived visitor's
+// Value(), Byte(), Unused() and Skip()
+template<class Derived> class PackingVisitor
+{
+public:
+	void operator()(int16& Number) { self().Value(Number); }
+	void operator()(uint16& Number) { self().Value(Number); }
+	void operator()(int32& Number) { self().Value(Number); }
+	void operator()(uint32& Number) { self().Value(Number); }
+	void operator()(char& Number) { self().Byte(&Number); }
+	void operator()(int8& Number) { self().Byte(&Number); }
+	void operator()(uint8& Number) { self().Byte(&Number); }
+	
+	template<class T> void operator()(T& Object) { packing_schema(self(), Object); }
+	
+	template<class T, size_t N> void operator()(T (&List)[N])
+	{
+		for (size_t k=0; k<N; k++)
+			(*this)(List[k]);
+	}
+	
+	template<class T, size_t N> void unused(T (&List)[N]) { self().Unused(List, N*sizeof(T)); }
+	void skip(size_t Count) { self().Skip(Count); }
+
+private:
+	Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+class PackingUnpacker : public PackingVisitor<PackingUnpacker>
+{
+public:
+	PackingUnpacker(uint8* &_Stream) : Stream(_Stream) { }
+	
+	template<class T> void Value(T& Number) { StreamToValue(Stream,Number); }
+	void Byte(void* Byte) { StreamToBytes(Stream,Byte,1); }
+	void Unused(void*, size_t Count) { Stream += Count; }
+	void Skip(size_t Count) { Stream += Count; }
+
+private:
+	uint8* &Stream;
+};
+
+class PackingPacker : public PackingVisitor<PackingPacker>
+{
+public:
+	PackingPacker(uint8* &_Stream) : Stream(_Stream) { }
+	
+	template<class T> void Value(T& Number) { ValueToStream(Stream,Number); }
+	void Byte(void* Byte) { BytesToStream(Stream,Byte,1); }
+	void Unused(void*, size_t Count) { Stream += Count; }
+	void Skip(size_t Count) { Stream += Count; }
+
+private:
+	uint8* &Stream;
+};
+
+// Works out a struct's packed size, and whether it can be converted in bulk
+class PackingLayout : public PackingVisitor<PackingLayout>
+{
+public:
+	size_t Size;
+	bool Direct;
+	std::vector<size_t> Offsets32;
+	std::vector<std::pair<size_t,size_t> > UnusedSpans;
+	
+	template<class T> static PackingLayout Of()
+	{
+		T Object;
+		PackingLayout Layout(&Object);
+		packing_schema(Layout, Object);
+		Layout.Direct = Layout.Direct && Layout.Size == sizeof(T) && (sizeof(T) % 2) == 0;
+		return Layout;
+	}
+	
+	template<class T> void Value(T& Number)
+	{
+		Field(&Number, sizeof(T));
+		if (sizeof(T) == 4)
+			Offsets32.push_back(Size - 4);
+	}
+	void Byte(void* Byte) { Field(Byte, 1); Direct = false; }
+	void Unused(void* List, size_t Count)
+	{
+		UnusedSpans.push_back(std::pair<size_t,size_t>(Size, Count));
+		Field(List, Count);
+	}
+	void Skip(size_t Count) { Size += Count; Direct = false; }
+
+private:
+	PackingLayout(void* Object) : Size(0), Direct(true), Base(static_cast<uint8*>(Object)) { }
+	
+	void Field(void* Field, size_t Count)
+	{
+		if (static_cast<uint8*>(Field) - Base != static_cast<ptrdiff_t>(Size))
+			Direct = false;
+		Size += Count;
+	}
+	
+	uint8* Base;
+};
+
+template<class T> inline static const PackingLayout& packing_layout()
+{
+	static const PackingLayout Layout = PackingLayout::Of<T>();
+	return Layout;
+}
+
+#ifdef PACKING_SWAPS_BYTES
+// Byte-swaps a list of directly-laid-out objects in place
+inline static void SwapPackedObjects(uint8* Bytes, size_t Size, size_t Count, const PackingLayout& Layout)
+{
+	// a simple loop over every 16-bit value, which compilers can vectorize
+	size_t Length = Size*Count;
+	for (size_t k=0; k<Length; k+=2)
+	{
+		uint8 Byte = Bytes[k];
+		Bytes[k] = Bytes[k+1];
+		Bytes[k+1] = Byte;
+	}
+	
+	// that leaves 32-bit values with their halves exchanged
+	if (Layout.Offsets32.empty()) return;
+	for (size_t k=0; k<Count; k++, Bytes+=Size)
+	{
+		for (std::vector<size_t>::const_iterator it = Layout.Offsets32.begin(); it != Layout.Offsets32.end(); ++it)
+		{
+			uint8* Value = Bytes + *it;
+			uint8 Byte0 = Value[0], Byte1 = Value[1];
+			Value[0] = Value[2];
+			Value[1] = Value[3];
+			Value[2] = Byte0;
+			Value[3] = Byte1;
+		}
+	}
+}
+#endif
+
+// Padding gets written out as zeros rather than whatever the struct held
+inline static void ClearPackedPadding(uint8* Bytes, size_t Size, size_t Count, const PackingLayout& Layout)
+{
+	if (Layout.UnusedSpans.empty()) return;
+	for (size_t k=0; k<Count; k++, Bytes+=Size)
+	{
+		for (std::vector<std::pair<size_t,size_t> >::const_iterator it = Layout.UnusedSpans.begin(); it != Layout.UnusedSpans.end(); ++it)
+			memset(Bytes + it->first, 0, it->second);
+	}
+}
+
+template<class T> inline static uint8* unpack_with_schema(uint8* Stream, T* Objects, size_t Count, size_t PackedSize)
+{
+	const PackingLayout& Layout = packing_layout<T>();
+	assert(Layout.Size == PackedSize);
+	
+	if (Layout.Direct)
+	{
+		memcpy(Objects,Stream,Count*sizeof(T));
+#ifdef PACKING_SWAPS_BYTES
+		SwapPackedObjects(reinterpret_cast<uint8*>(Objects),sizeof(T),Count,Layout);
+#endif
+		return Stream + Count*sizeof(T);
+	}
+	
+	uint8* S = Stream;
+	PackingUnpacker Unpacker(S);
+	for (size_t k=0; k<Count; k++)
+		packing_schema(Unpacker,Objects[k]);
+	
+	assert((S - Stream) == static_cast<ptrdiff_t>(Count*PackedSize));
+	return S;
+}
+
+template<class T> inline static uint8* pack_with_schema(uint8* Stream, T* Objects, size_t Count, size_t PackedSize)
+{
+	const PackingLayout& Layout = packing_layout<T>();
+	assert(Layout.Size == PackedSize);
+	
+	if (Layout.Direct)
+	{
+		memcpy(Stream,Objects,Count*sizeof(T));
+#ifdef PACKING_SWAPS_BYTES
+		SwapPackedObjects(Stream,sizeof(T),Count,Layout);
+#endif
+		ClearPackedPadding(Stream,sizeof(T),Count,Layout);
+		return Stream + Count*sizeof(T);
+	}
+	
+	uint8* S = Stream;
+	PackingPacker Packer(S);
+	for (size_t k=0; k<Count; k++)
+		packing_schema(Packer,Objects[k]);
+	
+	assert((S - Stream) == static_cast<ptrdiff_t>(Count*PackedSize));
+	return S;
+}
 #endif
 #endif
@@ -0,0 +1,627 @@
+/*
+ *  ZipArchive.cpp - indexed, cached access to members of zip archives
+
+	Copyright (C) 2016 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ */
+
+#include "cseries.h"
+#include "ZipArchive.h"
+
+#include <errno.h>
+#include <map>
+#include <zlib.h>
+
+#include <SDL_mutex.h>
+
+#if defined(HAVE_UNISTD_H) && !defined(__WIN32__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_ZIP_MMAP
+#endif
+
+enum {
+	kLocalHeaderSignature = 0x04034b50,
+	kCentralHeaderSignature = 0x02014b50,
+	kEndOfCentralDirSignature = 0x06054b50,
+
+	kLocalHeaderSize = 30,
+	kCentralHeaderSize = 46,
+	kEndOfCentralDirSize = 22,
+	kMaxCommentSize = 0xffff,
+
+	kMethodStored = 0,
+	kMethodDeflated = 8
+};
+
+// how many idle inflate buffers / streams to keep around
+static const size_t kMaxPooledBuffers = 8;
+static const size_t kMaxPooledStreams = 4;
+
+static inline uint16 get_le16(const uint8* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32 get_le32(const uint8* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+// SDL mutexes don't need SDL_Init, so we can make this on first use
+static SDL_mutex* zip_mutex()
+{
+	static SDL_mutex* mutex = SDL_CreateMutex();
+	return mutex;
+}
+
+class ZipLock
+{
+public:
+	ZipLock() { SDL_LockMutex(zip_mutex()); }
+	~ZipLock() { SDL_UnlockMutex(zip_mutex()); }
+};
+
+// archives we've indexed, by path
+typedef std::map<std::string, boost::shared_ptr<ZipArchive> > archive_cache_t;
+static archive_cache_t archive_cache;
+
+// Pools of inflate output buffers and z_streams; decompressing a member
+// otherwise costs a malloc of the whole member plus inflate's ~40K of
+// state, which adds up over hundreds of textures and sounds.
+// These must be called with the zip mutex held.
+
+static std::vector<std::vector<uint8>*> buffer_pool;
+static std::vector<z_stream*> stream_pool;
+
+static std::vector<uint8>* acquire_buffer(size_t size)
+{
+	// the smallest idle buffer that's big enough, otherwise the biggest
+	std::vector<std::vector<uint8>*>::iterator best = buffer_pool.end();
+	for (std::vector<std::vector<uint8>*>::iterator it = buffer_pool.begin(); it != buffer_pool.end(); ++it)
+	{
+		if (best == buffer_pool.end())
+			best = it;
+		else if ((*best)->capacity() >= size)
+		{
+			if ((*it)->capacity() >= size && (*it)->capacity() < (*best)->capacity())
+				best = it;
+		}
+		else if ((*it)->capacity() > (*best)->capacity())
+			best = it;
+	}
+
+	std::vector<uint8>* buffer;
+	if (best != buffer_pool.end())
+	{
+		buffer = *best;
+		buffer_pool.erase(best);
+	}
+	else
+	{
+		buffer = new std::vector<uint8>;
+	}
+
+	buffer->resize(size);
+	return buffer;
+}
+
+static void release_buffer(std::vector<uint8>* buffer)
+{
+	if (buffer_pool.size() < kMaxPooledBuffers)
+	{
+		buffer_pool.push_back(buffer);
+	}
+	else
+	{
+		// replace the smallest idle buffer, if this one is bigger
+		std::vector<std::vector<uint8>*>::iterator smallest = buffer_pool.begin();
+		for (std::vector<std::vector<uint8>*>::iterator it = buffer_pool.begin(); it != buffer_pool.end(); ++it)
+		{
+			if ((*it)->capacity() < (*smallest)->capacity())
+				smallest = it;
+		}
+
+		if ((*smallest)->capacity() < buffer->capacity())
+			std::swap(*smallest, buffer);
+
+		delete buffer;
+	}
+}
+
+static z_stream* acquire_stream()
+{
+	if (stream_pool.size())
+	{
+		z_stream* stream = stream_pool.back();
+		stream_pool.pop_back();
+		if (inflateReset(stream) == Z_OK)
+			return stream;
+
+		inflateEnd(stream);
+		delete stream;
+	}
+
+	z_stream* stream = new z_stream;
+	memset(stream, 0, sizeof(z_stream));
+	// raw deflate data; zip has its own headers
+	if (inflateInit2(stream, -MAX_WBITS) != Z_OK)
+	{
+		delete stream;
+		return 0;
+	}
+
+	return stream;
+}
+
+static void release_stream(z_stream* stream)
+{
+	if (stream_pool.size() < kMaxPooledStreams)
+	{
+		stream_pool.push_back(stream);
+	}
+	else
+	{
+		inflateEnd(stream);
+		delete stream;
+	}
+}
+
+ZipArchive::ZipArchive(const std::string& path) :
+	m_path(path),
+	m_file(0),
+	m_file_size(0),
+	m_map(0)
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+#ifdef HAVE_ZIP_MMAP
+	if (m_map)
+		munmap(const_cast<uint8*>(m_map), m_file_size);
+#endif
+
+	if (m_file)
+		SDL_RWclose(m_file);
+}
+
+boost::shared_ptr<ZipArchive> ZipArchive::Open(const std::string& path)
+{
+	ZipLock lock;
+
+	archive_cache_t::iterator it = archive_cache.find(path);
+	if (it != archive_cache.end())
+		return it->second;
+
+	boost::shared_ptr<ZipArchive> archive(new ZipArchive(path));
+	archive->m_self = archive;
+	if (!archive->Load())
+		return boost::shared_ptr<ZipArchive>();
+
+	archive_cache[path] = archive;
+	return archive;
+}
+
+void ZipArchive::FlushCache()
+{
+	ZipLock lock;
+	archive_cache.clear();
+}
+
+bool ZipArchive::Load()
+{
+#ifdef HAVE_ZIP_MMAP
+	int fd = open(m_path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= 0xffffffff)
+	{
+		void* map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			m_map = static_cast<const uint8*>(map);
+			m_file_size = static_cast<uint32>(st.st_size);
+		}
+	}
+	close(fd);
+#endif
+
+	if (!m_map)
+	{
+		m_file = SDL_RWFromFile(m_path.c_str(), "rb");
+		if (!m_file)
+			return false;
+
+		int size = SDL_RWseek(m_file, 0, RW_SEEK_END);
+		if (size < kEndOfCentralDirSize)
+			return false;
+		m_file_size = size;
+	}
+
+	if (m_file_size < kEndOfCentralDirSize)
+		return false;
+
+	// the end of central directory record is followed by a comment of
+	// up to 64K, so search backwards for its signature
+	uint32 tail_size = std::min<uint32>(m_file_size, kEndOfCentralDirSize + kMaxCommentSize);
+	std::vector<uint8> tail(tail_size);
+	if (!ReadAt(m_file_size - tail_size, &tail[0], tail_size))
+		return false;
+
+	int32 eocd = -1;
+	for (int32 i = tail_size - kEndOfCentralDirSize; i >= 0; --i)
+	{
+		if (get_le32(&tail[i]) == kEndOfCentralDirSignature)
+		{
+			eocd = i;
+			break;
+		}
+	}
+
+	if (eocd < 0)
+		return false;
+
+	uint16 entries = get_le16(&tail[eocd + 10]);
+	uint32 directory_size = get_le32(&tail[eocd + 12]);
+	uint32 directory_offset = get_le32(&tail[eocd + 16]);
+
+	// no Zip64 or spanned archives
+	if (entries == 0xffff || directory_offset == 0xffffffff ||
+	    directory_offset > m_file_size || directory_size > m_file_size - directory_offset)
+		return false;
+
+	std::vector<uint8> directory(directory_size);
+	if (directory_size && !ReadAt(directory_offset, &directory[0], directory_size))
+		return false;
+
+	m_members.reserve(entries);
+	m_data_offsets.assign(entries, 0);
+
+	uint32 p = 0;
+	for (int i = 0; i < entries; ++i)
+	{
+		if (p + kCentralHeaderSize > directory_size ||
+		    get_le32(&directory[p]) != kCentralHeaderSignature)
+			return false;
+
+		Member member;
+		member.method = get_le16(&directory[p + 10]);
+		member.compressed_size = get_le32(&directory[p + 20]);
+		member.size = get_le32(&directory[p + 24]);
+		uint16 name_length = get_le16(&directory[p + 28]);
+		uint16 extra_length = get_le16(&directory[p + 30]);
+		uint16 comment_length = get_le16(&directory[p + 32]);
+		member.local_header_offset = get_le32(&directory[p + 42]);
+
+		p += kCentralHeaderSize;
+		if (p + name_length > directory_size)
+			return false;
+
+		member.name.assign(reinterpret_cast<const char*>(&directory[p]), name_length);
+		p += name_length + extra_length + comment_length;
+
+		m_index[member.name] = m_members.size();
+		m_members.push_back(member);
+	}
+
+	return true;
+}
+
+const ZipArchive::Member* ZipArchive::Find(const std::string& name) const
+{
+	boost::unordered_map<std::string, size_t>::const_iterator it = m_index.find(name);
+	if (it == m_index.end())
+		return 0;
+
+	return &m_members[it->second];
+}
+
+bool ZipArchive::ReadAt(uint32 offset, void* buffer, uint32 length)
+{
+	if (offset > m_file_size || length > m_file_size - offset)
+		return false;
+
+	if (m_map)
+	{
+		memcpy(buffer, m_map + offset, length);
+		return true;
+	}
+
+	if (SDL_RWseek(m_file, offset, RW_SEEK_SET) < 0)
+		return false;
+
+	return SDL_RWread(m_file, buffer, length, 1) == 1;
+}
+
+const uint8* ZipArchive::DataAt(uint32 offset, uint32 length) const
+{
+	if (!m_map || offset > m_file_size || length > m_file_size - offset)
+		return 0;
+
+	return m_map + offset;
+}
+
+bool ZipArchive::LocateData(const Member& member, uint32& offset)
+{
+	// the local header's name and extra fields may differ in length
+	// from the central directory's, so it has to be read
+	uint32& data_offset = m_data_offsets[&member - &m_members[0]];
+	if (!data_offset)
+	{
+		uint8 header[kLocalHeaderSize];
+		if (!ReadAt(member.local_header_offset, header, kLocalHeaderSize) ||
+		    get_le32(header) != kLocalHeaderSignature)
+			return false;
+
+		data_offset = member.local_header_offset + kLocalHeaderSize + get_le16(&header[26]) + get_le16(&header[28]);
+	}
+
+	offset = data_offset;
+	return offset <= m_file_size && member.compressed_size <= m_file_size - offset;
+}
+
+// Doesn't touch any shared state, so it runs without the zip mutex
+static bool inflate_member(z_stream* stream, const ZipArchive::Member& member, const uint8* compressed, std::vector<uint8>& out)
+{
+	stream->next_in = const_cast<Bytef*>(compressed);
+	stream->avail_in = member.compressed_size;
+	stream->next_out = out.size() ? &out[0] : 0;
+	stream->avail_out = out.size();
+
+	int result = inflate(stream, Z_FINISH);
+	return (result == Z_STREAM_END || (result == Z_BUF_ERROR && stream->avail_out == 0)) && stream->total_out == member.size;
+}
+
+struct ZipMemberData {
+	boost::shared_ptr<ZipArchive> archive;
+	const uint8* data;
+	uint32 size;
+	uint32 pos;
+
+	// non-null if data lives in a pooled buffer
+	std::vector<uint8>* buffer;
+};
+
+#define ZIP_MEMBER_DATA(_context) \
+	(static_cast<ZipMemberData*>((_context)->hidden.unknown.data1))
+
+static int zip_member_seek(SDL_RWops* context, int offset, int whence)
+{
+	ZipMemberData* member = ZIP_MEMBER_DATA(context);
+	int32 pos;
+	switch (whence)
+	{
+		case RW_SEEK_SET:
+			pos = offset;
+			break;
+		case RW_SEEK_CUR:
+			pos = member->pos + offset;
+			break;
+		case RW_SEEK_END:
+			pos = member->size + offset;
+			break;
+		default:
+			return -1;
+	}
+
+	if (pos < 0)
+		pos = 0;
+	if (static_cast<uint32>(pos) > member->size)
+		pos = member->size;
+
+	member->pos = pos;
+	return pos;
+}
+
+static int zip_member_read(SDL_RWops* context, void* ptr, int size, int maxnum)
+{
+	ZipMemberData* member = ZIP_MEMBER_DATA(context);
+	if (size <= 0 || maxnum <= 0)
+		return 0;
+
+	uint32 num = std::min<uint32>(maxnum, (member->size - member->pos) / size);
+	memcpy(ptr, member->data + member->pos, num * size);
+	member->pos += num * size;
+	return num;
+}
+
+static int zip_member_write(SDL_RWops*, const void*, int, int)
+{
+	return -1;
+}
+
+static int zip_member_close(SDL_RWops* context)
+{
+	if (!context)
+		return 0;
+
+	ZipMemberData* member = ZIP_MEMBER_DATA(context);
+	if (member->buffer)
+	{
+		ZipLock lock;
+		release_buffer(member->buffer);
+	}
+	delete member;
+
+	SDL_FreeRW(context);
+	return 0;
+}
+
+SDL_RWops* ZipArchive::OpenMember(const Member& member)
+{
+	if (member.is_directory() ||
+	    (member.method != kMethodStored && member.method != kMethodDeflated) ||
+	    (member.method == kMethodStored && member.compressed_size != member.size))
+		return 0;
+
+	const uint8* data = 0;
+	std::vector<uint8>* buffer = 0;
+
+	// set up under the lock, but inflate outside it so other threads
+	// can open members meanwhile
+	const uint8* compressed = 0;
+	std::vector<uint8>* input = 0;
+	z_stream* stream = 0;
+	{
+		ZipLock lock;
+
+		uint32 offset;
+		if (!LocateData(member, offset))
+			return 0;
+
+		if (member.method == kMethodStored)
+		{
+			data = DataAt(offset, member.size);
+			if (!data && member.size)
+			{
+				// not mapped
+				buffer = acquire_buffer(member.size);
+				if (!ReadAt(offset, &(*buffer)[0], member.size))
+				{
+					release_buffer(buffer);
+					return 0;
+				}
+				data = &(*buffer)[0];
+			}
+		}
+		else if (member.size)
+		{
+			// the file handle is shared, so unmapped input is read here
+			compressed = DataAt(offset, member.compressed_size);
+			if (!compressed)
+			{
+				input = acquire_buffer(member.compressed_size);
+				if (!ReadAt(offset, &(*input)[0], member.compressed_size))
+				{
+					release_buffer(input);
+					return 0;
+				}
+				compressed = &(*input)[0];
+			}
+
+			stream = acquire_stream();
+			buffer = acquire_buffer(member.size);
+		}
+	}
+
+	if (compressed)
+	{
+		bool ok = stream && inflate_member(stream, member, compressed, *buffer);
+
+		ZipLock lock;
+		if (stream)
+			release_stream(stream);
+		if (input)
+			release_buffer(input);
+		if (!ok)
+		{
+			release_buffer(buffer);
+			return 0;
+		}
+
+		data = &(*buffer)[0];
+	}
+
+	SDL_RWops* rwops = SDL_AllocRW();
+	if (!rwops)
+	{
+		if (buffer)
+		{
+			ZipLock lock;
+			release_buffer(buffer);
+		}
+		return 0;
+	}
+
+	ZipMemberData* member_data = new ZipMemberData;
+	member_data->archive = m_self.lock();
+	member_data->data = data;
+	member_data->size = member.size;
+	member_data->pos = 0;
+	member_data->buffer = buffer;
+
+	rwops->hidden.unknown.data1 = member_data;
+	rwops->seek = zip_member_seek;
+	rwops->read = zip_member_read;
+	rwops->write = zip_member_write;
+	rwops->close = zip_member_close;
+	return rwops;
+}
+
+static bool file_exists(const std::string& path)
+{
+#ifdef HAVE_ZIP_MMAP
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#else
+	SDL_RWops* f = SDL_RWFromFile(path.c_str(), "rb");
+	if (f)
+		SDL_RWclose(f);
+	return f;
+#endif
+}
+
+// Walks up the directory chain of path looking for an archive that
+// contains the rest of it
+static boost::shared_ptr<ZipArchive> find_archive(const std::string& path, const ZipArchive::Member*& member)
+{
+	static const char* extensions[] = { ".zip", ".ZIP" };
+
+	for (std::string::size_type slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+	{
+		std::string prefix = path.substr(0, slash);
+		std::string name = path.substr(slash + 1);
+		for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i)
+		{
+			std::string archive_path = prefix + extensions[i];
+			{
+				ZipLock lock;
+				archive_cache_t::iterator it = archive_cache.find(archive_path);
+				if (it == archive_cache.end() && !file_exists(archive_path))
+					continue;
+			}
+
+			boost::shared_ptr<ZipArchive> archive = ZipArchive::Open(archive_path);
+			if (archive && (member = archive->Find(name)))
+				return archive;
+		}
+	}
+
+	return boost::shared_ptr<ZipArchive>();
+}
+
+SDL_RWops* SDL_RWFromZipArchive(const std::string& path)
+{
+	const ZipArchive::Member* member;
+	boost::shared_ptr<ZipArchive> archive = find_archive(path, member);
+	SDL_RWops* rwops = archive ? archive->OpenMember(*member) : 0;
+	if (!rwops)
+		errno = ENOENT;
+
+	return rwops;
+}
+
+bool zip_archive_member_exists(const std::string& path)
+{
+	const ZipArchive::Member* member;
+	return find_archive(path, member).get() != 0;
+}
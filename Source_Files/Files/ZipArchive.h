@@ -0,0 +1,106 @@
+/*
+ *  ZipArchive.h - indexed, cached access to members of zip archives
+
+	Copyright (C) 2016 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Plugins and scenarios can be shipped as .zip files; a path like
+	Plugins/Foo/Textures/wall.png is then looked up as the member
+	Textures/wall.png of Plugins/Foo.zip (or Foo/Textures/wall.png
+	of Plugins.zip, and so on up the tree).
+
+	Each archive's central directory is parsed once and kept in a
+	hashed index for the life of the program. Stored members are
+	served straight out of a memory map of the archive; inflated
+	members are decompressed into buffers that are recycled once the
+	SDL_RWops is closed.
+ */
+
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+#include "cstypes.h"
+
+#include <string>
+#include <vector>
+#include <SDL_rwops.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+class ZipArchive {
+public:
+	struct Member {
+		std::string name;
+		uint16 method;
+		uint32 compressed_size;
+		uint32 size;
+		uint32 local_header_offset;
+
+		bool is_directory() const { return !name.empty() && name[name.size() - 1] == '/'; }
+	};
+
+	// Returns the (cached) archive at path, or a null pointer if it
+	// isn't a readable zip file
+	static boost::shared_ptr<ZipArchive> Open(const std::string& path);
+
+	// Drops every cached archive index; open members stay valid
+	static void FlushCache();
+
+	~ZipArchive();
+
+	const std::string& Path() const { return m_path; }
+	const std::vector<Member>& Members() const { return m_members; }
+
+	// NULL if name isn't in the archive
+	const Member* Find(const std::string& name) const;
+
+	// Returns a read-only SDL_RWops for the member, or NULL on error
+	SDL_RWops* OpenMember(const Member& member);
+
+private:
+	ZipArchive(const std::string& path);
+
+	bool Load();
+	bool ReadAt(uint32 offset, void* buffer, uint32 length);
+	const uint8* DataAt(uint32 offset, uint32 length) const;
+	bool LocateData(const Member& member, uint32& offset);
+
+	std::string m_path;
+	std::vector<Member> m_members;
+	boost::unordered_map<std::string, size_t> m_index;
+
+	// where each member's data starts, once its local header is read
+	std::vector<uint32> m_data_offsets;
+
+	SDL_RWops* m_file;
+	uint32 m_file_size;
+
+	// the whole archive, when it could be memory mapped
+	const uint8* m_map;
+
+	boost::weak_ptr<ZipArchive> m_self;
+};
+
+// Opens path as a member of a zip archive somewhere up its directory
+// chain; NULL (and errno set) if there isn't one
+SDL_RWops* SDL_RWFromZipArchive(const std::string& path);
+
+// Whether path names a member of a zip archive
+bool zip_archive_member_exists(const std::string& path);
+
+#endif
@@ -125,6 +125,11 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 // For packing and unpacking some of the stuff
 #include "Packing.h"
 
+#include "Logging.h"
+#include "ZipArchive.h"
+#include <SDL_thread.h>
+#include <errno.h>
+
 #include "motion_sensor.h"	// ZZZ for reset_motion_sensor()
 
 #include "Music.h"
@@ -156,6 +161,7 @@ static void load_redundant_map_data(short *redundant_data, size_t count);
 static void allocate_map_structure_for_map(struct wad_data *wad);
 static wad_data *build_export_wad(wad_header *header, int32 *length);
 static struct wad_data *build_save_game_wad(struct wad_header *header, int32 *length);
+static struct wad_data *expand_saved_game_wad(struct wad_data *wad);
 
 static void allocate_map_for_counts(size_t polygon_count, size_t side_count,
 	size_t endpoint_count, size_t line_count);
@@ -221,6 +227,33 @@ void *get_map_for_net_transfer(
 	return get_flat_data(MapFileSpec, false, entry->level_number);
 }
 
+/* Saved games are sent expanded, since joiners process the flattened wad as is */
+void *get_saved_game_for_net_transfer(
+	FileSpecifier& File)
+{
+	void *data= NULL;
+	
+	OpenedFile SavedGame;
+	if (open_wad_file_for_reading(File, SavedGame))
+	{
+		struct wad_header header;
+		if (read_wad_header(SavedGame, &header))
+		{
+			struct wad_data *wad= read_indexed_wad_from_file(SavedGame, &header, 0, false);
+			if (wad)
+				wad= expand_saved_game_wad(wad);
+			if (wad)
+			{
+				data= flatten_wad(&header, wad);
+				free_wad(wad);
+			}
+		}
+		close_wad_file(SavedGame);
+	}
+	
+	return data;
+}
+
 /* ---------------------- End Net Functions ----------- */
 
 /* This takes a cstring */
@@ -230,6 +263,8 @@ void set_map_file(FileSpecifier& File)
 	if (file_is_set) RunRestorationScript();
 
 	MapFileSpec = File;
+	// a new scenario may bring its own archives; don't keep stale indices
+	ZipArchive::FlushCache();
 	set_scenario_images_file(File);
 	// Only need to do this here
 	LoadLevelScripts(File);
@@ -297,6 +332,8 @@ bool load_level_from_map(
 				{
                         
 					wad= read_indexed_wad_from_file(MapFile, &header, index_to_load, true);
+					if (wad && restoring_game)
+						wad= expand_saved_game_wad(wad);
 					if (wad)
 					{
 						/* Process everything... */
@@ -1173,6 +1210,7 @@ bool load_game_from_file(FileSpecifier& File, bool run_scripts, bool *was_map_fo
 {
 	bool success= false;
 
+	wait_for_saved_game_write();
 	ResetPassedLua();
 	
 	/* Setup for a revert.. */
@@ -1382,108 +1420,274 @@ void get_current_saved_game_name(FileSpecifier& File)
 	File = revert_game_data.SavedGame;
 }
 
-/* The current mapfile should be set to the save game file... */
-bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata)
+/* -------- saved game writer */
+// Saving captures the world into a wad and opens the file on the main thread;
+// compressing the wad and writing it out happen on a background thread, so
+// only one save is in flight at a time. The writer never touches the global
+// game error; it reports through the job instead.
+
+struct saved_game_job
 {
+	FileSpecifier File;
 	struct wad_header header;
-	short err = 0;
-	bool success= false;
-	int32 offset, wad_length;
-	struct directory_entry entries[2];
-	struct wad_data *wad, *meta_wad;
+	struct wad_data *wad;
+	std::string metadata;
+	boost::function<std::string ()> build_imagedata;
+	boost::function<void ()> written;
+	
+	// opened for writing by save_game_file()
+	FileSpecifier TempFile;
+	OpenedFile SaveFile;
+	
+	uint32 capture_ticks, write_ticks;
+	int32 expanded_length, file_length;
+	int err;
+	bool success;
+	volatile bool done;
+};
 
-	/* Save off the random seed. */
-	dynamic_world->random_seed= get_random_seed();
+static SDL_Thread *saved_game_thread = NULL;
+static saved_game_job *saved_game_in_flight = NULL;
 
-	/* Setup to revert the game properly */
-	revert_game_data.game_is_from_disk= true;
-	revert_game_data.SavedGame = File;
+/* Undoes compress_wad(); frees wad if it returns a different one */
+static struct wad_data *expand_saved_game_wad(struct wad_data *wad)
+{
+	size_t length;
+	if (extract_type_from_wad(wad, COMPRESSED_WAD_TAG, &length))
+	{
+		struct wad_data *expanded = expand_compressed_wad(wad);
+		free_wad(wad);
+		if (!expanded) return NULL;
+		wad = expanded;
+	}
+	
+	return wad;
+}
 
-	// LP: add a file here; use temporary file for a safe save.
-	// Write into the temporary file first
-	FileSpecifier TempFile;
-	TempFile.SetTempName(File);
+static bool write_saved_game(saved_game_job *job)
+{
+	struct wad_header& header = job->header;
+	OpenedFile& SaveFile = job->SaveFile;
+	int32 offset, wad_length;
+	struct directory_entry entries[2];
+	bool success = false;
 	
-	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
-	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
-		
-	/* Assume that we confirmed on save as... */
-	if (create_wadfile(TempFile,_typecode_savegame))
+	std::string imagedata;
+	if (job->build_imagedata)
+		imagedata = job->build_imagedata();
+	
+	struct wad_data *wad = compress_wad(job->wad, &job->expanded_length);
+	if (!wad)
+		job->err = ENOMEM;
+	else
 	{
-		OpenedFile SaveFile;
-		if(open_wad_file_for_writing(TempFile,SaveFile))
+		wad_length = calculate_wad_length(&header, wad);
+		
+		/* Write out the new header */
+		if (write_wad_header(SaveFile, &header))
 		{
-			/* Write out the new header */
-			if (write_wad_header(SaveFile, &header))
+			offset= SIZEOF_wad_header;
+			
+			/* Set the entry data.. */
+			set_indexed_directory_offset_and_length(&header, 
+				entries, 0, offset, wad_length, 0);
+			
+			/* Save it.. */
+			if (write_wad(SaveFile, &header, wad, offset))
 			{
-				offset= SIZEOF_wad_header;
-		
-				wad= build_save_game_wad(&header, &wad_length);
-				if (wad)
+				/* Update the new header */
+				offset+= wad_length;
+				header.directory_offset= offset;
+				
+				/* Create metadata wad */
+				struct wad_data *meta_wad = build_meta_game_wad(job->metadata, imagedata, &header, &wad_length);
+				if (meta_wad)
 				{
-					/* Set the entry data.. */
-					set_indexed_directory_offset_and_length(&header, 
-						entries, 0, offset, wad_length, 0);
+					set_indexed_directory_offset_and_length(&header,
+						entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
 					
-					/* Save it.. */
-					if (write_wad(SaveFile, &header, wad, offset))
+					if (write_wad(SaveFile, &header, meta_wad, offset))
 					{
-						/* Update the new header */
 						offset+= wad_length;
 						header.directory_offset= offset;
-						header.parent_checksum= read_wad_file_checksum(MapFileSpec);
 						
-						/* Create metadata wad */
-						meta_wad = build_meta_game_wad(metadata, imagedata, &header, &wad_length);
-						if (meta_wad)
+						if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
 						{
-							set_indexed_directory_offset_and_length(&header,
-								entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
-							
-							if (write_wad(SaveFile, &header, meta_wad, offset))
-							{
-								offset+= wad_length;
-								header.directory_offset= offset;
-						
-								if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
-								{
-									/* We win. */
-									success= true;
-								}
-							}
-							
-							free_wad(meta_wad);
+							/* We win. */
+							success= true;
+							job->file_length = offset + get_size_of_directory_data(&header);
 						}
 					}
-
-					free_wad(wad);
+					
+					free_wad(meta_wad);
+				}
+				else
+				{
+					job->err = ENOMEM;
 				}
 			}
-
-			err = SaveFile.GetError();
-			close_wad_file(SaveFile);
 		}
 		
-		if (!err)
+		free_wad(wad);
+	}
+	
+	if (SaveFile.GetError())
+		job->err = SaveFile.GetError();
+	else if (!success && !job->err)
+		job->err = EIO;
+	close_wad_file(SaveFile);
+	
+	if (success && !job->err)
+	{
+		errno = 0;
+		if (!job->TempFile.Rename(job->File))
 		{
-			if (!TempFile.Rename(File))
-			{
-				err = 1;
-			}
+			job->err = errno ? errno : EIO;
 		}
 	}
+	else
+	{
+		job->TempFile.Delete();
+	}
 	
-	if(err || error_pending())
+	return success && !job->err;
+}
+
+static int saved_game_writer(void *p)
+{
+	saved_game_job *job = static_cast<saved_game_job *>(p);
+	
+	uint32 start = machine_tick_count();
+	job->success = write_saved_game(job);
+	job->write_ticks = machine_tick_count() - start;
+	
+	job->done = true;
+	return 0;
+}
+
+static bool finish_saved_game(bool report)
+{
+	saved_game_job *job = saved_game_in_flight;
+	if (saved_game_thread)
 	{
-		if(!err) err= get_game_error(NULL);
-		alert_user(infoError, strERRORS, fileError, err);
-		clear_game_error();
-		success= false;
+		int status;
+		SDL_WaitThread(saved_game_thread, &status);
+		saved_game_thread = NULL;
+	}
+	saved_game_in_flight = NULL;
+	
+	bool success = job->success;
+	if (success)
+	{
+		logNote("saved game %s: captured in %u ms, written in %u ms; %d bytes (%d before compression)",
+			job->File.GetPath(), job->capture_ticks, job->write_ticks, job->file_length, job->expanded_length);
+		if (report)
+			screen_printf("Game saved (%d KB in %u ms)", (job->file_length + 1023) / 1024, job->capture_ticks + job->write_ticks);
+	}
+	else
+	{
+		logError("saving game %s failed (%d)", job->File.GetPath(), job->err);
+		alert_user(infoError, strERRORS, fileError, job->err);
 	}
 	
+	boost::function<void ()> written;
+	if (success)
+		written = job->written;
+	
+	free_wad(job->wad);
+	delete job;
+	
+	// after the job is gone, so this can't end up waiting on it
+	if (written)
+		written();
+	
 	return success;
 }
 
+void poll_saved_game_write(void)
+{
+	if (saved_game_in_flight && saved_game_in_flight->done)
+		finish_saved_game(true);
+}
+
+bool wait_for_saved_game_write(void)
+{
+	if (!saved_game_in_flight) return true;
+	return finish_saved_game(false);
+}
+
+/* The current mapfile should be set to the save game file... */
+bool save_game_file(FileSpecifier& File, const std::string& metadata, const boost::function<std::string ()>& build_imagedata, const boost::function<void ()>& written)
+{
+	struct wad_header header;
+	int32 wad_length;
+	
+	wait_for_saved_game_write();
+	uint32 start = machine_tick_count();
+
+	/* Save off the random seed. */
+	dynamic_world->random_seed= get_random_seed();
+
+	/* Setup to revert the game properly */
+	revert_game_data.game_is_from_disk= true;
+	revert_game_data.SavedGame = File;
+
+	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
+	// compressed, so older versions mustn't try to read it
+	fill_default_wad_header(File, WADFILE_HAS_COMPRESSED_SAVES, EDITOR_MAP_VERSION, 2, 0, &header);
+	header.parent_checksum= read_wad_file_checksum(MapFileSpec);
+	
+	saved_game_job *job = new saved_game_job;
+	
+	// LP: add a file here; use temporary file for a safe save.
+	// Write into the temporary file first
+	job->TempFile.SetTempName(File);
+	
+	/* Assume that we confirmed on save as... */
+	if (!create_wadfile(job->TempFile,_typecode_savegame) || !open_wad_file_for_writing(job->TempFile,job->SaveFile))
+	{
+		delete job;
+		alert_user(infoError, strERRORS, fileError, get_game_error(NULL));
+		clear_game_error();
+		return false;
+	}
+	
+	struct wad_data *wad= build_save_game_wad(&header, &wad_length);
+	if (!wad || error_pending())
+	{
+		if (wad) free_wad(wad);
+		close_wad_file(job->SaveFile);
+		job->TempFile.Delete();
+		delete job;
+		alert_user(infoError, strERRORS, fileError, get_game_error(NULL));
+		clear_game_error();
+		return false;
+	}
+	
+	job->File = File;
+	job->header = header;
+	job->wad = wad;
+	job->metadata = metadata;
+	job->build_imagedata = build_imagedata;
+	job->written = written;
+	job->write_ticks = 0;
+	job->expanded_length = job->file_length = 0;
+	job->err = 0;
+	job->success = false;
+	job->done = false;
+	job->capture_ticks = machine_tick_count() - start;
+	
+	saved_game_in_flight = job;
+	saved_game_thread = SDL_CreateThread(saved_game_writer, job);
+	if (!saved_game_thread)
+	{
+		// no thread; write it out here instead
+		saved_game_writer(job);
+	}
+	
+	return true;
+}
+
 /* -------- static functions */
 static void scan_and_add_platforms(
 	uint8 *platform_static_data,
@@ -33,9 +33,19 @@ Aug 12, 2000 (Loren Petrich):
 	Using object-oriented file handler
 */
 
+#include <string>
+#include <boost/function.hpp>
+
 class FileSpecifier;
 
-bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata);
+// Captures the game and starts writing it out in the background; the preview
+// image is built on the writer thread, and written() is called on this one
+// once the file is in place. Returns false if the capture failed
+bool save_game_file(FileSpecifier& File, const std::string& metadata, const boost::function<std::string ()>& build_imagedata, const boost::function<void ()>& written = boost::function<void ()>());
+// Reports (and reaps) a background save that has finished; doesn't block
+void poll_saved_game_write(void);
+// Blocks until any background save is done; false if it failed
+bool wait_for_saved_game_write(void);
 struct wad_data *build_meta_game_wad(const std::string& metadata, const std::string& imagedata, struct wad_header *header, int32 *length);
 
 bool export_level(FileSpecifier& File);
@@ -49,6 +59,8 @@ void set_saved_game_name_to_default();
 
 // ZZZ: exposed this for netgame-resuming code
 bool process_map_wad(struct wad_data *wad, bool restoring_game, short version);
+// the saved game's level as flat data, with anything it refers to in its parent map filled in
+void *get_saved_game_for_net_transfer(FileSpecifier& File);
 
 bool match_checksum_with_map(short vRefNum, long dirID, uint32 checksum, 
 	FileSpecifier& File);
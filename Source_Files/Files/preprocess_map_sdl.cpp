@@ -133,7 +133,7 @@ bool save_game(void)
 	pause_game();
     bool success = create_quick_save();
     if (success)
-        screen_printf("Game saved");
+        screen_printf("Saving game");
     else
         screen_printf("Save failed");
 	resume_game();
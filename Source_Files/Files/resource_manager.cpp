@@ -26,6 +26,10 @@
  *
  *  Jan 16, 2003 (Woody Zenfell):
  *      Reworked stemmed-file opening logic; now using new Logging facility
+ *
+ *  2016:
+ *      Resource maps are hashed by (type, ID) and cached by path, so a file
+ *      that is opened again (or by several image files at once) isn't reparsed
  */
 
 #include <SDL_endian.h>
@@ -36,9 +40,14 @@
 #include "Logging.h"
 
 #include <stdio.h>
+#include <sys/stat.h>
 #include <vector>
 #include <list>
 #include <map>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #ifndef NO_STD_NAMESPACE
 using std::iostream;
@@ -110,21 +119,43 @@ bool is_macbinary(SDL_RWops *f, int32 &data_length, int32 &rsrc_length)
 }
 
 
+// Parsed resource map of a file; it doesn't change once read, so every
+// open of the same file shares one
+struct res_map_t {
+	bool read(SDL_RWops *f);
+
+	// NULL if not found
+	const uint32 *find(uint32 type, int id) const
+	{
+		offset_map_t::const_iterator i = offsets.find(std::make_pair(type, id));
+		return i == offsets.end() ? NULL : &i->second;
+	}
+
+	typedef vector<std::pair<int, uint32> > id_list_t;					// Resource IDs (sorted) and offsets to resource data
+	typedef boost::unordered_map<uint32, id_list_t> type_map_t;			// Maps resource type to ID list
+	typedef boost::unordered_map<std::pair<uint32, int>, uint32> offset_map_t;	// Maps resource type and ID to offset to resource data
+
+	type_map_t types;		// All resource types found in file
+	offset_map_t offsets;	// All resources found in file
+};
+
 // Structure for open resource file
 struct res_file_t {
 	res_file_t() : f(NULL) {}
 	res_file_t(SDL_RWops *file) : f(file) {}
-	res_file_t(const res_file_t &other) {f = other.f;}
+	res_file_t(const res_file_t &other) : f(other.f), rmap(other.rmap) {}
 	~res_file_t() {}
 
 	const res_file_t &operator=(const res_file_t &other)
 	{
-		if (this != &other)
+		if (this != &other) {
 			f = other.f;
+			rmap = other.rmap;
+		}
 		return *this;
 	}
 
-	bool read_map(void);
+	bool read_map(const char *path = NULL);
 	size_t count_resources(uint32 type) const;
 	void get_resource_id_list(uint32 type, vector<int> &ids) const;
 	bool get_resource(uint32 type, int id, LoadedResource &rsrc) const;
@@ -133,12 +164,20 @@ struct res_file_t {
 
 	SDL_RWops *f;		// Opened resource file
 
-	typedef map<int, uint32> id_map_t;			// Maps resource ID to offset to resource data
-	typedef map<uint32, id_map_t> type_map_t;	// Maps resource type to ID map
+	boost::shared_ptr<const res_map_t> rmap;	// Resource map of the file
+};
+
 
-	type_map_t types;	// Map of all resource types found in file
+// Resource maps of files opened by path, kept after the files are closed;
+// a null map means the file isn't a resource file
+struct res_map_cache_entry {
+	off_t size;
+	time_t mtime;
+	boost::shared_ptr<const res_map_t> rmap;
 };
 
+static boost::unordered_map<std::string, res_map_cache_entry> res_map_cache;
+
 
 // List of open resource files
 static list<res_file_t *> res_file_list;
@@ -175,7 +214,7 @@ void initialize_resources(void)
  *  Read and parse resource map from file
  */
 
-bool res_file_t::read_map(void)
+bool res_map_t::read(SDL_RWops *f)
 {
 	SDL_RWseek(f, 0, SEEK_END);
 	uint32 file_size = SDL_RWtell(f);
@@ -232,6 +271,7 @@ bool res_file_t::read_map(void)
 	}
 
 	// Read resource type list
+	map<uint32, map<int, uint32> > types;
 	SDL_RWseek(f, type_list_offset, SEEK_SET);
 	int num_types = SDL_ReadBE16(f) + 1;
 	for (int i=0; i<num_types; i++) {
@@ -249,7 +289,7 @@ bool res_file_t::read_map(void)
 		}
 
 		// Create ID map for this type
-		id_map_t &id_map = types[type];
+		map<int, uint32> &id_map = types[type];
 
 		// Read reference list
 		uint32 cur = SDL_RWtell(f);
@@ -275,20 +315,58 @@ bool res_file_t::read_map(void)
 		}
 		SDL_RWseek(f, cur, SEEK_SET);
 	}
+
+	// Index it
+	map<uint32, map<int, uint32> >::const_iterator i, end = types.end();
+	for (i=types.begin(); i!=end; i++) {
+		id_list_t &id_list = this->types[i->first];
+		id_list.assign(i->second.begin(), i->second.end());
+		map<int, uint32>::const_iterator j, id_end = i->second.end();
+		for (j=i->second.begin(); j!=id_end; j++)
+			offsets[std::make_pair(i->first, j->first)] = j->second;
+	}
 	return true;
 }
 
+bool res_file_t::read_map(const char *path)
+{
+	struct stat st;
+	bool cacheable = path && stat(path, &st) == 0;
+	if (cacheable) {
+		boost::unordered_map<std::string, res_map_cache_entry>::const_iterator i = res_map_cache.find(path);
+		if (i != res_map_cache.end() && i->second.size == st.st_size && i->second.mtime == st.st_mtime) {
+			logTrace("using cached resource map");
+			rmap = i->second.rmap;
+			return rmap.get() != NULL;
+		}
+	}
+
+	boost::shared_ptr<res_map_t> new_map(new res_map_t);
+	if (new_map->read(f))
+		rmap = new_map;
+	else
+		rmap.reset();
+
+	if (cacheable) {
+		res_map_cache_entry &entry = res_map_cache[path];
+		entry.size = st.st_size;
+		entry.mtime = st.st_mtime;
+		entry.rmap = rmap;
+	}
+	return rmap.get() != NULL;
+}
+
 /*
  *  Open resource file, set current file to the newly opened one
  */
  
-SDL_RWops*
-open_res_file_from_rwops(SDL_RWops* f) {
+static SDL_RWops*
+open_res_file_from_rwops(SDL_RWops* f, const char* inPath) {
     if (f) {
 
             // Successful, create res_file_t object and read resource map
             res_file_t *r = new res_file_t(f);
-            if (r->read_map()) {
+            if (r->read_map(inPath)) {
 
                     // Successful, add file to list of open files
                     res_file_list.push_back(r);
@@ -301,6 +379,7 @@ open_res_file_from_rwops(SDL_RWops* f) {
             } else {
 
                     // Error reading resource map
+                    delete r;
                     SDL_RWclose(f);
                     return NULL;
             }
@@ -310,10 +389,15 @@ open_res_file_from_rwops(SDL_RWops* f) {
     return f;
 }
 
+SDL_RWops*
+open_res_file_from_rwops(SDL_RWops* f) {
+	return open_res_file_from_rwops(f, NULL);
+}
+
 static SDL_RWops*
 open_res_file_from_path(const char* inPath) 
 {
-	return open_res_file_from_rwops(SDL_RWFromFile(inPath, "rb"));
+	return open_res_file_from_rwops(SDL_RWFromFile(inPath, "rb"), inPath);
 }
 
 SDL_RWops *open_res_file(FileSpecifier &file)
@@ -403,8 +487,8 @@ void use_res_file(SDL_RWops *file)
 
 size_t res_file_t::count_resources(uint32 type) const
 {
-	type_map_t::const_iterator i = types.find(type);
-	if (i == types.end())
+	res_map_t::type_map_t::const_iterator i = rmap->types.find(type);
+	if (i == rmap->types.end())
 		return 0;
 	else
 		return i->second.size();
@@ -435,9 +519,9 @@ size_t count_resources(uint32 type)
 
 void res_file_t::get_resource_id_list(uint32 type, vector<int> &ids) const
 {
-	type_map_t::const_iterator i = types.find(type);
-	if (i != types.end()) {
-		id_map_t::const_iterator j, end = i->second.end();
+	res_map_t::type_map_t::const_iterator i = rmap->types.find(type);
+	if (i != rmap->types.end()) {
+		res_map_t::id_list_t::const_iterator j, end = i->second.end();
 		for (j=i->second.begin(); j!=end; j++)
 			ids.push_back(j->first);
 	}
@@ -471,26 +555,23 @@ bool res_file_t::get_resource(uint32 type, int id, LoadedResource &rsrc) const
 	rsrc.Unload();
 
 	// Find resource in map
-	type_map_t::const_iterator i = types.find(type);
-	if (i != types.end()) {
-		id_map_t::const_iterator j = i->second.find(id);
-		if (j != i->second.end()) {
-
-			// Found, read data size
-			SDL_RWseek(f, j->second, SEEK_SET);
-			uint32 size = SDL_ReadBE32(f);
-
-			// Allocate memory and read data
-			void *p = malloc(size);
-			if (p == NULL)
-				return false;
-			SDL_RWread(f, p, 1, size);
-			rsrc.p = p;
-			rsrc.size = size;
+	const uint32 *offset = rmap->find(type, id);
+	if (offset) {
 
-//			fprintf(stderr, "get_resource type %c%c%c%c, id %d -> data %p, size %d\n", type >> 24, type >> 16, type >> 8, type, id, p, size);
-			return true;
-		}
+		// Found, read data size
+		SDL_RWseek(f, *offset, SEEK_SET);
+		uint32 size = SDL_ReadBE32(f);
+
+		// Allocate memory and read data
+		void *p = malloc(size);
+		if (p == NULL)
+			return false;
+		SDL_RWread(f, p, 1, size);
+		rsrc.p = p;
+		rsrc.size = size;
+
+//		fprintf(stderr, "get_resource type %c%c%c%c, id %d -> data %p, size %d\n", type >> 24, type >> 16, type >> 8, type, id, p, size);
+		return true;
 	}
 	return false;
 }
@@ -524,16 +605,13 @@ bool res_file_t::get_ind_resource(uint32 type, int index, LoadedResource &rsrc)
 	rsrc.Unload();
 
 	// Find resource in map
-	type_map_t::const_iterator i = types.find(type);
-	if (i != types.end()) {
+	res_map_t::type_map_t::const_iterator i = rmap->types.find(type);
+	if (i != rmap->types.end()) {
 		if (index < 1 || index > int(i->second.size()))
 			return false;
-		id_map_t::const_iterator j = i->second.begin();
-		for (int k=1; k<index; k++)
-			++j;
 
 		// Read data size
-		SDL_RWseek(f, j->second, SEEK_SET);
+		SDL_RWseek(f, i->second[index - 1].second, SEEK_SET);
 		uint32 size = SDL_ReadBE32(f);
 
 		// Allocate memory and read data
@@ -576,13 +654,7 @@ bool get_ind_resource(uint32 type, int index, LoadedResource &rsrc)
 
 bool res_file_t::has_resource(uint32 type, int id) const
 {
-	type_map_t::const_iterator i = types.find(type);
-	if (i != types.end()) {
-		id_map_t::const_iterator j = i->second.find(id);
-		if (j != i->second.end())
-			return true;
-	}
-	return false;
+	return rmap->find(type, id) != NULL;
 }
 
 bool has_1_resource(uint32 type, int id)
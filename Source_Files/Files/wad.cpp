@@ -90,6 +90,8 @@ Jan 25, 2002 (Br'fin (Jeremy Parsons)):
 #include "FileHandler.h"
 #include "Packing.h"
 
+#include <zlib.h>
+
 // Formerly in portable_files.h
 inline short memory_error() {return 0;}
 
@@ -155,7 +157,7 @@ bool read_wad_header(
 		success= false;
 	} else {
 		// Thomas Herzog made this error checking more careful
-		if((header->version>CURRENT_WADFILE_VERSION) || (header->data_version > 2) || (header->wad_count < 1))
+		if((header->version>MAXIMUM_WADFILE_VERSION) || (header->data_version > 2) || (header->wad_count < 1))
 		{
 			set_game_error(gameError, errUnknownWadVersion);
 			success= false;
@@ -774,6 +776,119 @@ int32 calculate_wad_length(
 	return running_length;
 }
 
+/* ------------ Compressed wads */
+/*
+	A compressed wad has a single COMPRESSED_WAD_TAG, holding
+	4 bytes -- expanded length
+	zlib stream of, for each tag:
+		4 bytes -- tag
+		4 bytes -- length
+		4 bytes -- offset
+		(length) bytes -- data
+*/
+const int SIZEOF_compressed_tag_header = 3*4;
+
+struct wad_data *compress_wad(
+	struct wad_data *wad,
+	int32 *expanded_length)
+{
+	assert(wad);
+	
+	uLong length= 0;
+	for (short index= 0; index<wad->tag_count; ++index)
+	{
+		length+= SIZEOF_compressed_tag_header + wad->tag_data[index].length;
+	}
+	
+	uint8 *expanded= (uint8 *) malloc(length);
+	uLong bound= compressBound(length);
+	uint8 *compressed= (uint8 *) malloc(4 + bound);
+	struct wad_data *compressed_wad= NULL;
+	
+	if (expanded && compressed)
+	{
+		uint8 *S= expanded;
+		for (short index= 0; index<wad->tag_count; ++index)
+		{
+			struct tag_data *tag= &wad->tag_data[index];
+			ValueToStream(S,tag->tag);
+			ValueToStream(S,tag->length);
+			ValueToStream(S,tag->offset);
+			BytesToStream(S,tag->data,tag->length);
+		}
+		assert(static_cast<uLong>(S - expanded) == length);
+		
+		S= compressed;
+		ValueToStream(S,uint32(length));
+		if (compress2(S, &bound, expanded, length, Z_DEFAULT_COMPRESSION) == Z_OK)
+		{
+			compressed_wad= create_empty_wad();
+			if (compressed_wad)
+				compressed_wad= append_data_to_wad(compressed_wad, COMPRESSED_WAD_TAG, compressed, 4 + bound, 0);
+		}
+	}
+	
+	free(expanded);
+	free(compressed);
+	
+	if (compressed_wad && expanded_length) *expanded_length= length;
+	return compressed_wad;
+}
+
+struct wad_data *expand_compressed_wad(
+	struct wad_data *wad)
+{
+	size_t length;
+	uint8 *compressed= (uint8 *) extract_type_from_wad(wad, COMPRESSED_WAD_TAG, &length);
+	if (!compressed || length < 4) return NULL;
+	
+	uint8 *S= compressed;
+	uint32 expanded_length;
+	StreamToValue(S,expanded_length);
+	
+	uint8 *expanded= (uint8 *) malloc(expanded_length ? expanded_length : 1);
+	if (!expanded)
+	{
+		set_game_error(systemError, memory_error());
+		return NULL;
+	}
+	
+	struct wad_data *expanded_wad= NULL;
+	uLongf actual_length= expanded_length;
+	if (uncompress(expanded, &actual_length, S, length - 4) == Z_OK && actual_length == expanded_length)
+	{
+		expanded_wad= create_empty_wad();
+		
+		S= expanded;
+		while (expanded_wad && S + SIZEOF_compressed_tag_header <= expanded + expanded_length)
+		{
+			WadDataType tag;
+			int32 tag_length, tag_offset;
+			StreamToValue(S,tag);
+			StreamToValue(S,tag_length);
+			StreamToValue(S,tag_offset);
+			if (tag_length < 0 || tag_length > (expanded + expanded_length) - S)
+			{
+				free_wad(expanded_wad);
+				expanded_wad= NULL;
+				break;
+			}
+			
+			if (tag_length)
+				expanded_wad= append_data_to_wad(expanded_wad, tag, S, tag_length, tag_offset);
+			S+= tag_length;
+		}
+	}
+	
+	if (!expanded_wad)
+	{
+		set_game_error(gameError, errUnknownWadVersion);
+	}
+	
+	free(expanded);
+	return expanded_wad;
+}
+
 /* ------------ Transfer type functions */
 #define CURRENT_FLAT_MAGIC_COOKIE (0xDEADDEAD)
 
@@ -895,6 +1010,56 @@ struct wad_data *inflate_flat_data(
 	return wad;
 }
 
+/* Packs an in-memory wad the way get_flat_data() packs one from a file */
+void *flatten_wad(
+	struct wad_header *header,
+	struct wad_data *wad)
+{
+	short entry_header_length= get_entry_header_length(header);
+	int32 length= calculate_wad_length(header, wad);
+	
+	uint8 *data= (uint8 *) malloc(length + SIZEOF_encapsulated_wad_data);
+	if (!data)
+	{
+		set_game_error(systemError, memory_error());
+		return NULL;
+	}
+	
+	uint8 *S = data;
+	ValueToStream(S,uint32(CURRENT_FLAT_MAGIC_COOKIE));
+	ValueToStream(S,int32(length + SIZEOF_encapsulated_wad_data));
+	S = pack_wad_header(S,header,1);
+	assert((S - data) == SIZEOF_encapsulated_wad_data);
+	
+	int32 running_offset= 0;
+	for (short index= 0; index<wad->tag_count; ++index)
+	{
+		struct entry_header entry;
+		entry.tag= wad->tag_data[index].tag;
+		entry.length= wad->tag_data[index].length;
+		entry.offset= wad->tag_data[index].offset;
+		
+		running_offset+= entry.length + entry_header_length;
+		entry.next_offset= (index==wad->tag_count-1) ? 0 : running_offset;
+		
+		switch (entry_header_length)
+		{
+		case SIZEOF_old_entry_header:
+			S = pack_old_entry_header(S,(old_entry_header *)&entry,1);
+			break;
+		case SIZEOF_entry_header:
+			S = pack_entry_header(S,&entry,1);
+			break;
+		default:
+			vassert(false,csprintf(temporary,"Unrecognized entry-header length: %d",entry_header_length));
+		}
+		BytesToStream(S,wad->tag_data[index].data,entry.length);
+	}
+	assert((S - data) == length + SIZEOF_encapsulated_wad_data);
+	
+	return data;
+}
+
 /* ---------- debugging routines. */
 void dump_wad(
 	struct wad_data *wad)
@@ -972,6 +1137,7 @@ static int32 calculate_directory_offset(
 		case WADFILE_SUPPORTS_OVERLAYS:
 		// LP addition:
 		case WADFILE_HAS_INFINITY_STUFF:
+		case WADFILE_HAS_COMPRESSED_SAVES:
 			assert(header->application_specific_directory_data_size>=0);
 			unit_size= header->application_specific_directory_data_size+get_directory_base_length(header);
 			break;
@@ -1016,7 +1182,7 @@ static short get_directory_base_length(
 	short size;
 	
 	assert(header);
-	assert(header->version<=CURRENT_WADFILE_VERSION);
+	assert(header->version<=MAXIMUM_WADFILE_VERSION);
 
 	switch(header->version)
 	{
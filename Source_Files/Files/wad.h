@@ -45,7 +45,9 @@ Aug 12, 2000 (Loren Petrich):
 #define WADFILE_HAS_DIRECTORY_ENTRY 1
 #define WADFILE_SUPPORTS_OVERLAYS 2
 #define WADFILE_HAS_INFINITY_STUFF 4
+#define WADFILE_HAS_COMPRESSED_SAVES 5 // only saved games, which may hold a single COMPRESSED_WAD_TAG
 #define CURRENT_WADFILE_VERSION (WADFILE_HAS_INFINITY_STUFF)
+#define MAXIMUM_WADFILE_VERSION (WADFILE_HAS_COMPRESSED_SAVES)
 
 #define MAXIMUM_DIRECTORY_ENTRIES_PER_FILE 64
 #define MAXIMUM_WADFILE_NAME_LENGTH 64
@@ -192,6 +194,16 @@ int32 get_flat_data_length(void *data);
 /* This is how you dispose of it-> you inflate it, then use free_wad() */
 struct wad_data *inflate_flat_data(void *data, struct wad_header *header);
 
+/* Same packing as get_flat_data(), for a wad that's already in memory */
+void *flatten_wad(struct wad_header *header, struct wad_data *wad);
+
+/* ------ Compressed wads */
+/* Returns a new wad holding all of wad's tags deflated into one; the expanded size is returned too */
+struct wad_data *compress_wad(struct wad_data *wad, int32 *expanded_length);
+
+/* Returns a new, modifiable copy of a compressed wad, or NULL if wad isn't one (or is damaged) */
+struct wad_data *expand_compressed_wad(struct wad_data *wad);
+
 /* ------------  Write File functions */
 struct wad_data *create_empty_wad(void);
 void fill_default_wad_header(FileSpecifier& File, short wadfile_version,
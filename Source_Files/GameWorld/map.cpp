@@ -240,6 +240,9 @@ bool LandscapesLoaded = true;
 // needed for infravision fog when landscapes are switched off
 short LoadedWallTexture = NONE;
 
+uint32 map_geometry_version = 0;
+uint32 map_layout_version = 0;
+
 /* ---------- private prototypes */
 
 static short _new_map_object(shape_descriptor shape, angle facing);
@@ -412,6 +415,7 @@ void initialize_map_for_new_level(
 
 	obj_clear(*static_world);
 	Console::instance()->clear_saves();
+	map_layout_version+= 1;
 	
 	// Clear all these out -- supposed to be none of the contents of these when starting a level.
 	objlist_clear(automap_lines, AutomapLineList.size());
@@ -2088,6 +2092,7 @@ bool change_polygon_height(
 		/* slam the polygon heights, directly */
 		polygon->floor_height= new_floor_height;
 		polygon->ceiling_height= new_ceiling_height;
+		map_geometry_version+= 1;
 		
 		/* the highest_adjacent_floor, lowest_adjacent_ceiling and supporting_polygon_index fields
 			of all of this polygons endpoints and lines are potentially invalid now.  to assure
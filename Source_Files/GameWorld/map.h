@@ -127,6 +127,16 @@ struct damage_definition
 };
 const int SIZEOF_damage_definition = 12;
 
+template<class Visitor> void packing_schema(Visitor& V, damage_definition& Object)
+{
+	V(Object.type);
+	V(Object.flags);
+	
+	V(Object.base);
+	V(Object.random);
+	V(Object.scale);
+}
+
 /* ---------- saved objects (initial map locations, etc.) */
 
 // #define MAXIMUM_SAVED_OBJECTS 384
@@ -932,6 +942,18 @@ struct game_data
 	int16 parameters[2]; /* Use these later. for now memset to 0 */
 };
 
+// The cheat flags aren't saved
+template<class Visitor> void packing_schema(Visitor& V, game_data& Object)
+{
+	V(Object.game_time_remaining);
+	V(Object.game_type);
+	V(Object.game_options);
+	V(Object.kill_limit);
+	V(Object.initial_random_seed);
+	V(Object.difficulty_level);
+	V(Object.parameters);
+}
+
 struct dynamic_data
 {
 	/* ticks since the beginning of the game */
@@ -1083,6 +1105,14 @@ extern bool LandscapesLoaded;
 // needed for infravision fog when landscapes are switched off
 extern short LoadedWallTexture;
 
+// Bumped whenever polygon or media heights, or which lines can be seen through, change;
+// the renderer keeps its visibility tree while this and the view stay the same
+extern uint32 map_geometry_version;
+
+// Bumped whenever a new map is loaded; anything built from the map's endpoints,
+// lines, sides and polygons (rather than their heights) is stale after that
+extern uint32 map_layout_version;
+
 /* ---------- prototypes/MARATHON.C */
 
 void initialize_marathon(void);
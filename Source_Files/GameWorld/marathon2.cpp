@@ -498,6 +498,7 @@ update_world()
 			sMostRecentFlagsForPlayer[i] = GameQueue->peekActionFlags(i, 0);
 
 		theUpdateResult = update_world_elements_one_tick();
+		update_film_state_hash();
 
                 theElapsedTime++;
 
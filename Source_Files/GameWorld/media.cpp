@@ -259,7 +259,12 @@ void update_one_media(
 	if (!definition) return;
 
 	/* update height */
-	media->height= (media->low + FIXED_INTEGERAL_PART((media->high-media->low)*get_light_intensity(media->light_index)));
+	world_distance height= (media->low + FIXED_INTEGERAL_PART((media->high-media->low)*get_light_intensity(media->light_index)));
+	if (height!=media->height)
+	{
+		media->height= height;
+		map_geometry_version+= 1;
+	}
 
 	/* update texture */	
 	media->texture= BUILD_DESCRIPTOR(definition->collection, definition->shape);
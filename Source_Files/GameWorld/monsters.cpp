@@ -3546,100 +3546,51 @@ void SetPlayerViewAttribs(int16 half_visual_arc, int16 half_vertical_visual_arc,
 }
 
 
-uint8 *unpack_monster_data(uint8 *Stream, monster_data *Objects, size_t Count)
+template<class Visitor> void packing_schema(Visitor& V, monster_data& Object)
 {
-	uint8* S = Stream;
-	monster_data* ObjPtr = Objects;
+	V(Object.type);
+	V(Object.vitality);
+	V(Object.flags);
 	
-	for (size_t k = 0; k < Count; k++, ObjPtr++)
-	{
-		StreamToValue(S,ObjPtr->type);
-		StreamToValue(S,ObjPtr->vitality);
-		StreamToValue(S,ObjPtr->flags);
-		
-		StreamToValue(S,ObjPtr->path);
-		StreamToValue(S,ObjPtr->path_segment_length);
-		StreamToValue(S,ObjPtr->desired_height);
-		
-		StreamToValue(S,ObjPtr->mode);
-		StreamToValue(S,ObjPtr->action);
-		StreamToValue(S,ObjPtr->target_index);
-		StreamToValue(S,ObjPtr->external_velocity);
-		StreamToValue(S,ObjPtr->vertical_velocity);
-		StreamToValue(S,ObjPtr->ticks_since_attack);
-		StreamToValue(S,ObjPtr->attack_repetitions);
-		StreamToValue(S,ObjPtr->changes_until_lock_lost);
-		
-		StreamToValue(S,ObjPtr->elevation);
-		
-		StreamToValue(S,ObjPtr->object_index);
-		
-		StreamToValue(S,ObjPtr->ticks_since_last_activation);
-		
-		StreamToValue(S,ObjPtr->activation_bias);
-		
-		StreamToValue(S,ObjPtr->goal_polygon_index);
-		
-		StreamToValue(S,ObjPtr->sound_location.x);
-		StreamToValue(S,ObjPtr->sound_location.y);
-		StreamToValue(S,ObjPtr->sound_location.z);
-		StreamToValue(S,ObjPtr->sound_polygon_index);
-		
-		StreamToValue(S,ObjPtr->random_desired_height);
-		
-		S += 7*2;
-	}
+	V(Object.path);
+	V(Object.path_segment_length);
+	V(Object.desired_height);
 	
-	assert((S - Stream) == static_cast<ptrdiff_t>(Count*SIZEOF_monster_data));
-	return S;
+	V(Object.mode);
+	V(Object.action);
+	V(Object.target_index);
+	V(Object.external_velocity);
+	V(Object.vertical_velocity);
+	V(Object.ticks_since_attack);
+	V(Object.attack_repetitions);
+	V(Object.changes_until_lock_lost);
+	
+	V(Object.elevation);
+	
+	V(Object.object_index);
+	
+	V(Object.ticks_since_last_activation);
+	
+	V(Object.activation_bias);
+	
+	V(Object.goal_polygon_index);
+	
+	V(Object.sound_location);
+	V(Object.sound_polygon_index);
+	
+	V(Object.random_desired_height);
+	
+	V.unused(Object.unused);
+}
+
+uint8 *unpack_monster_data(uint8 *Stream, monster_data *Objects, size_t Count)
+{
+	return unpack_with_schema(Stream,Objects,Count,SIZEOF_monster_data);
 }
 
 uint8 *pack_monster_data(uint8 *Stream, monster_data *Objects, size_t Count)
 {
-	uint8* S = Stream;
-	monster_data* ObjPtr = Objects;
-	
-	for (size_t k = 0; k < Count; k++, ObjPtr++)
-	{
-		ValueToStream(S,ObjPtr->type);
-		ValueToStream(S,ObjPtr->vitality);
-		ValueToStream(S,ObjPtr->flags);
-		
-		ValueToStream(S,ObjPtr->path);
-		ValueToStream(S,ObjPtr->path_segment_length);
-		ValueToStream(S,ObjPtr->desired_height);
-		
-		ValueToStream(S,ObjPtr->mode);
-		ValueToStream(S,ObjPtr->action);
-		ValueToStream(S,ObjPtr->target_index);
-		ValueToStream(S,ObjPtr->external_velocity);
-		ValueToStream(S,ObjPtr->vertical_velocity);
-		ValueToStream(S,ObjPtr->ticks_since_attack);
-		ValueToStream(S,ObjPtr->attack_repetitions);
-		ValueToStream(S,ObjPtr->changes_until_lock_lost);
-		
-		ValueToStream(S,ObjPtr->elevation);
-		
-		ValueToStream(S,ObjPtr->object_index);
-		
-		ValueToStream(S,ObjPtr->ticks_since_last_activation);
-		
-		ValueToStream(S,ObjPtr->activation_bias);
-		
-		ValueToStream(S,ObjPtr->goal_polygon_index);
-		
-		ValueToStream(S,ObjPtr->sound_location.x);
-		ValueToStream(S,ObjPtr->sound_location.y);
-		ValueToStream(S,ObjPtr->sound_location.z);
-		ValueToStream(S,ObjPtr->sound_polygon_index);
-		
-		ValueToStream(S,ObjPtr->random_desired_height);
-		
-		S += 7*2;
-	}
-	
-	assert((S - Stream) == static_cast<ptrdiff_t>(Count*SIZEOF_monster_data));
-	return S;
+	return pack_with_schema(Stream,Objects,Count,SIZEOF_monster_data);
 }
 
 
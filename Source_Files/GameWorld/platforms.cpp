@@ -856,6 +856,7 @@ void adjust_platform_endpoint_and_line_heights(
 	struct polygon_data *polygon= get_polygon_data(platform->polygon_index);
 	short i;
 	
+	map_geometry_version+= 1;
 	for (i= 0; i<polygon->vertex_count; ++i)
 	{
 		struct endpoint_data *endpoint= get_endpoint_data(polygon->endpoint_indexes[i]);
@@ -1072,78 +1072,42 @@ bool ProjectileIsGuided(short Type)
 }
 
 
-uint8 *unpack_projectile_data(uint8 *Stream, projectile_data* Objects, size_t Count)
+template<class Visitor> void packing_schema(Visitor& V, projectile_data& Object)
 {
-	uint8* S = Stream;
-	projectile_data* ObjPtr = Objects;
+	V(Object.type);
 	
-	for (size_t k = 0; k < Count; k++, ObjPtr++)
-	{
-		StreamToValue(S,ObjPtr->type);
-		
-		StreamToValue(S,ObjPtr->object_index);
-		
-		StreamToValue(S,ObjPtr->target_index);
-		
-		StreamToValue(S,ObjPtr->elevation);
-		
-		StreamToValue(S,ObjPtr->owner_index);
-		StreamToValue(S,ObjPtr->owner_type);
-		StreamToValue(S,ObjPtr->flags);
-		
-		StreamToValue(S,ObjPtr->ticks_since_last_contrail);
-		StreamToValue(S,ObjPtr->contrail_count);
-		
-		StreamToValue(S,ObjPtr->distance_travelled);
-		
-		StreamToValue(S,ObjPtr->gravity);
-		
-		StreamToValue(S,ObjPtr->damage_scale);
-		
-		StreamToValue(S,ObjPtr->permutation);
-		
-		S += 2*2;
-	}
+	V(Object.object_index);
 	
-	assert((S - Stream) == static_cast<ptrdiff_t>(Count*SIZEOF_projectile_data));
-	return S;
+	V(Object.target_index);
+	
+	V(Object.elevation);
+	
+	V(Object.owner_index);
+	V(Object.owner_type);
+	V(Object.flags);
+	
+	V(Object.ticks_since_last_contrail);
+	V(Object.contrail_count);
+	
+	V(Object.distance_travelled);
+	
+	V(Object.gravity);
+	
+	V(Object.damage_scale);
+	
+	V(Object.permutation);
+	
+	V.unused(Object.unused);
+}
+
+uint8 *unpack_projectile_data(uint8 *Stream, projectile_data* Objects, size_t Count)
+{
+	return unpack_with_schema(Stream,Objects,Count,SIZEOF_projectile_data);
 }
 
 uint8 *pack_projectile_data(uint8 *Stream, projectile_data* Objects, size_t Count)
 {
-	uint8* S = Stream;
-	projectile_data* ObjPtr = Objects;
-	
-	for (size_t k = 0; k < Count; k++, ObjPtr++)
-	{
-		ValueToStream(S,ObjPtr->type);
-		
-		ValueToStream(S,ObjPtr->object_index);
-		
-		ValueToStream(S,ObjPtr->target_index);
-		
-		ValueToStream(S,ObjPtr->elevation);
-		
-		ValueToStream(S,ObjPtr->owner_index);
-		ValueToStream(S,ObjPtr->owner_type);
-		ValueToStream(S,ObjPtr->flags);
-		
-		ValueToStream(S,ObjPtr->ticks_since_last_contrail);
-		ValueToStream(S,ObjPtr->contrail_count);
-		
-		ValueToStream(S,ObjPtr->distance_travelled);
-		
-		ValueToStream(S,ObjPtr->gravity);
-		
-		ValueToStream(S,ObjPtr->damage_scale);
-		
-		ValueToStream(S,ObjPtr->permutation);
-		
-		S += 2*2;
-	}
-	
-	assert((S - Stream) == static_cast<ptrdiff_t>(Count*SIZEOF_projectile_data));
-	return S;
+	return pack_with_schema(Stream,Objects,Count,SIZEOF_projectile_data);
 }
 
 
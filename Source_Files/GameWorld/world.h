@@ -101,6 +101,20 @@ struct world_point3d
 };
 typedef struct world_point3d world_point3d;
 
+// Packed layouts (see Packing.h)
+template<class Visitor> void packing_schema(Visitor& V, world_point2d& Object)
+{
+	V(Object.x);
+	V(Object.y);
+}
+
+template<class Visitor> void packing_schema(Visitor& V, world_point3d& Object)
+{
+	V(Object.x);
+	V(Object.y);
+	V(Object.z);
+}
+
 struct fixed_point3d
 {
 	_fixed x, y, z;
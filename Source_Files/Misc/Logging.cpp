@@ -36,6 +36,8 @@
 #include "FileHandler.h"
 #include "InfoTree.h"
 
+#include "SDL_thread.h"
+
 #ifndef NO_STD_NAMESPACE
 using std::vector;
 using std::string;
@@ -99,9 +101,11 @@ Logger::~Logger() {
 
 
 
+// Some loading happens on other threads, which log too; they share the
+// one context stack and file, so every call holds the lock
 class TopLevelLogger : public Logger {
 public:
-    TopLevelLogger() : mMostRecentCommonStackDepth(0), mMostRecentlyPrintedStackDepth(0) {}
+    TopLevelLogger() : mMostRecentCommonStackDepth(0), mMostRecentlyPrintedStackDepth(0), mLock(SDL_CreateMutex()) {}
     virtual void pushLogContextV(const char* inFile, int inLine, const char* inContext, va_list inArgs);
     virtual void popLogContext();
     virtual void logMessageV(const char* inDomain, int inLevel, const char* inFile, int inLine, const char* inMessage, va_list inArgs);
@@ -110,6 +114,15 @@ protected:
     vector<string>	mContextStack;
     size_t	mMostRecentCommonStackDepth;
     size_t	mMostRecentlyPrintedStackDepth;
+    SDL_mutex*	mLock;
+};
+
+class LoggerLock {
+public:
+    LoggerLock(SDL_mutex* inLock) : mLock(inLock) { SDL_LockMutex(mLock); }
+    ~LoggerLock() { SDL_UnlockMutex(mLock); }
+private:
+    SDL_mutex*	mLock;
 };
 
 
@@ -118,6 +131,7 @@ TopLevelLogger::pushLogContextV(const char* inFile, int inLine, const char* inCo
         char 	stringBuffer[kStringBufferSize];
         vsnprintf(stringBuffer, kStringBufferSize, inContext, inArgs);
         string	theContextString(stringBuffer);
+        LoggerLock	theLock(mLock);
         if(sShowLocations) {
                 // Strictly speaking, the choice of whether to include location info should be
                 // deferred until the context actually gets logged, just in case the setting
@@ -131,6 +145,7 @@ TopLevelLogger::pushLogContextV(const char* inFile, int inLine, const char* inCo
 
 void
 TopLevelLogger::popLogContext() {
+    LoggerLock	theLock(mLock);
     mContextStack.pop_back();
     if(mContextStack.size() < mMostRecentCommonStackDepth)
         mMostRecentCommonStackDepth = mContextStack.size();
@@ -150,6 +165,7 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
     // Obviously eventually this will be settable more dynamically...
     // Also eventually some logged messages could be posted in a dialog in addition to appended to the file.
     if(sOutputFile != NULL && inLevel < sLoggingThreshhold) {
+        LoggerLock	theLock(mLock);
         char	stringBuffer[kStringBufferSize];
         size_t firstDepthToPrint = mMostRecentCommonStackDepth;
     /*
@@ -195,6 +211,7 @@ void TopLevelLogger::flush()
 {
 	if (sOutputFile)
 	{
+		LoggerLock theLock(mLock);
 		fflush(sOutputFile);
 	}
 }
@@ -171,10 +171,11 @@ enum recording_version {
 	RECORDING_VERSION_ALEPH_ONE_PRE_PIN = 6,
 	RECORDING_VERSION_ALEPH_ONE_1_0 = 7,
 	RECORDING_VERSION_ALEPH_ONE_1_1 = 8,
-	RECORDING_VERSION_ALEPH_ONE_1_2 = 9
+	RECORDING_VERSION_ALEPH_ONE_1_2 = 9,
+	RECORDING_VERSION_ALEPH_ONE_1_3 = 10 // compressed, indexed version-2 films
 };
-const short default_recording_version = RECORDING_VERSION_ALEPH_ONE_1_2;
-const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_2;
+const short default_recording_version = RECORDING_VERSION_ALEPH_ONE_1_3;
+const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_3;
 
 #include "screen_definitions.h"
 #include "interface_menus.h"
@@ -954,7 +955,7 @@ bool load_and_start_game(FileSpecifier& File)
 				success = NetStart();
 				if (success)
 				{
-					byte* theSavedGameFlatData = (byte*)get_flat_data(File, false /* union wad? */, 0 /* level # */);
+					byte* theSavedGameFlatData = (byte*)get_saved_game_for_net_transfer(File);
 					if (theSavedGameFlatData == NULL)
 					{
 						success = false;
@@ -1081,6 +1082,8 @@ bool idle_game_state(uint32 time)
 {
 	int machine_ticks_elapsed = time - game_state.last_ticks_on_idle;
 
+	poll_saved_game_write();
+
 	if(machine_ticks_elapsed || game_state.phase==0)
 	{
 		if(game_state.phase != INDEFINATE_TIME_DELAY)
@@ -1188,7 +1191,10 @@ bool idle_game_state(uint32 time)
 	{
 		// ZZZ change: update_world() whether or not get_keyboard_controller_status() is true
 		// This way we won't fill up queues and stall netgames if one player switches out for a bit.
+		frame_profile_begin(_frame_stage_update_world);
 		std::pair<bool, int16> theUpdateResult= update_world();
+		if (theUpdateResult.first || theUpdateResult.second)
+			frame_profile_end(_frame_stage_update_world);
 		short ticks_elapsed= theUpdateResult.second;
 
 		if (get_keyboard_controller_status())
@@ -2038,6 +2044,7 @@ static bool begin_game(
 						load_film_profile(FILM_PROFILE_ALEPH_ONE_1_1);
 						break;
 					case RECORDING_VERSION_ALEPH_ONE_1_2:
+					case RECORDING_VERSION_ALEPH_ONE_1_3:
 						load_film_profile(FILM_PROFILE_DEFAULT);
 						break;
 					default:
@@ -3273,6 +3280,251 @@ size_t should_restore_game_networked(FileSpecifier& file)
         return theResult;
 }
 
+/*
+ *  Offscreen render benchmark
+ *
+ *  Either plays a film as fast as it will go, rendering every frame, or
+ *  reads a script of fixed camera positions:
+ *
+ *	# comment
+ *	map <path>			(otherwise the current map)
+ *	level <n>
+ *	size <width> <height>		(640 480 by default)
+ *	repeat <n>			(times to render each camera)
+ *	camera <x> <y> <z> <yaw> <pitch>	(world units, degrees)
+ *
+ *  Every frame is rendered by the software renderer and reported with
+ *  its per-stage timings and a checksum of the pixels it produced.
+ */
+
+struct benchmark_totals {
+	int frames;
+	Uint64 total;
+	render_view_timings stages;
+
+	benchmark_totals() : frames(0), total(0) { obj_clear(stages); }
+};
+
+struct benchmark_camera {
+	world_point3d origin;
+	short yaw, pitch;
+};
+
+static void benchmark_frame(benchmark_totals& totals, short width, short height, const world_point3d *origin, short polygon_index, short yaw, short pitch)
+{
+	render_view_timings timings;
+	obj_clear(timings);
+
+	Uint64 start = machine_microsecond_count();
+	uint32 checksum = render_benchmark_view(width, height, origin, polygon_index, yaw, pitch, timings);
+	Uint64 total = machine_microsecond_count() - start;
+
+	printf("frame %5d  %8.3f ms  (vis %.3f  sort %.3f  place %.3f  raster %.3f)  %08x\n",
+	       totals.frames, total / 1000.0,
+	       timings.build_render_tree / 1000.0, timings.sort_render_tree / 1000.0,
+	       timings.build_render_object_list / 1000.0, timings.render_tree / 1000.0,
+	       checksum);
+
+	totals.frames++;
+	totals.total += total;
+	totals.stages.build_render_tree += timings.build_render_tree;
+	totals.stages.sort_render_tree += timings.sort_render_tree;
+	totals.stages.build_render_object_list += timings.build_render_object_list;
+	totals.stages.render_tree += timings.render_tree;
+}
+
+static bool benchmark_film(FileSpecifier& File, benchmark_totals& totals, short width, short height)
+{
+	DraggedReplayFile = File;
+	if (!begin_game(_replay_from_file, false))
+		return false;
+
+	for (;;)
+	{
+		short state = get_game_state();
+		if (state == _change_level)
+		{
+			// let the idle task load the next level, as it would in play
+			idle_game_state(machine_tick_count());
+			continue;
+		}
+		if (state != _game_in_progress)
+			break;
+
+		input_controller();
+		if (update_world().second > 0)
+			benchmark_frame(totals, width, height, NULL, NONE, 0, 0);
+	}
+
+	if (get_game_state() == _switch_demo)
+		finish_game(false);
+	return true;
+}
+
+static bool benchmark_script(FileSpecifier& File, benchmark_totals& totals)
+{
+	OpenedFile script;
+	if (!File.Open(script))
+	{
+		printf("Couldn't open %s\n", File.GetPath());
+		return false;
+	}
+
+	int32 length = 0;
+	script.GetLength(length);
+	std::vector<char> text(length);
+	if (length && !script.Read(length, &text[0]))
+	{
+		printf("Couldn't read %s\n", File.GetPath());
+		return false;
+	}
+	script.Close();
+
+	std::vector<benchmark_camera> cameras;
+	short level = 0;
+	short width = 640, height = 480;
+	int repeat = 1;
+
+	std::istringstream lines(std::string(text.begin(), text.end()));
+	std::string line;
+	int line_number = 0;
+	while (std::getline(lines, line))
+	{
+		line_number++;
+		std::istringstream words(line);
+		std::string command;
+		if (!(words >> command) || command[0] == '#')
+			continue;
+
+		bool ok = true;
+		if (command == "map")
+		{
+			std::string path;
+			ok = std::getline(words >> std::ws, path) && !path.empty();
+			if (ok)
+			{
+				FileSpecifier map(path);
+				set_map_file(map);
+			}
+		}
+		else if (command == "level")
+			ok = (words >> level) && level >= 0;
+		else if (command == "size")
+			ok = (words >> width >> height) && width > 0 && height > 0 &&
+				width <= MAXIMUM_WORLD_WIDTH && height <= MAXIMUM_WORLD_HEIGHT;
+		else if (command == "repeat")
+			ok = (words >> repeat) && repeat > 0;
+		else if (command == "camera")
+		{
+			double x, y, z, yaw, pitch;
+			ok = (words >> x >> y >> z >> yaw >> pitch);
+			if (ok)
+			{
+				benchmark_camera c;
+				c.origin.x = static_cast<world_distance>(x * WORLD_ONE);
+				c.origin.y = static_cast<world_distance>(y * WORLD_ONE);
+				c.origin.z = static_cast<world_distance>(z * WORLD_ONE);
+				c.yaw = NORMALIZE_ANGLE(static_cast<short>(yaw * NUMBER_OF_ANGLES / 360));
+				c.pitch = static_cast<short>(pitch * NUMBER_OF_ANGLES / 360);
+				cameras.push_back(c);
+			}
+		}
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			printf("%s:%d: couldn't understand \"%s\"\n", File.GetPath(), line_number, line.c_str());
+			return false;
+		}
+	}
+
+	if (!get_map_file().Exists())
+	{
+		printf("No map to benchmark\n");
+		return false;
+	}
+
+	struct entry_point entry;
+	struct player_start_data starts[MAXIMUM_NUMBER_OF_PLAYERS];
+	struct game_data game_information;
+	short number_of_players;
+
+	objlist_clear(starts, MAXIMUM_NUMBER_OF_PLAYERS);
+	obj_clear(entry);
+	entry.level_number = level;
+	construct_single_player_start(starts, &number_of_players);
+
+	game_information.game_time_remaining = INT32_MAX;
+	game_information.kill_limit = 0;
+	game_information.game_type = _game_of_kill_monsters;
+	game_information.game_options = _burn_items_on_death|_ammo_replenishes|_weapons_replenish|_monsters_replenish;
+	// a fixed seed, so that runs are comparable
+	game_information.initial_random_seed = 0;
+	game_information.difficulty_level = get_difficulty_level();
+	std::fill_n(game_information.parameters, 2, 0);
+
+	if (!new_game(number_of_players, false, &game_information, starts, &entry))
+	{
+		printf("Couldn't start level %d\n", level);
+		return false;
+	}
+	start_game(_single_player, false);
+
+	for (std::vector<benchmark_camera>::iterator it = cameras.begin(); it != cameras.end(); ++it)
+	{
+		world_point2d location = { it->origin.x, it->origin.y };
+		short polygon_index = world_point_to_polygon_index(&location);
+		if (polygon_index == NONE)
+		{
+			printf("camera at (%d, %d) is outside the map; skipping it\n", it->origin.x, it->origin.y);
+			continue;
+		}
+
+		for (int i = 0; i < repeat; i++)
+			benchmark_frame(totals, width, height, &it->origin, polygon_index, it->yaw, it->pitch);
+	}
+
+	finish_game(false);
+	return true;
+}
+
+bool run_render_benchmark(FileSpecifier& File)
+{
+	// OpenGL draws straight to the window; only the software renderer
+	// can be timed offscreen
+	short acceleration = graphics_preferences->screen_mode.acceleration;
+	graphics_preferences->screen_mode.acceleration = _no_acceleration;
+
+	benchmark_totals totals;
+	bool success;
+	if (File.GetType() == _typecode_film)
+		success = benchmark_film(File, totals, 640, 480);
+	else
+		success = benchmark_script(File, totals);
+
+	graphics_preferences->screen_mode.acceleration = acceleration;
+
+	if (success && totals.frames)
+	{
+		double frames = totals.frames;
+		printf("%d frames, %.3f ms per frame (%.1f fps)\n", totals.frames,
+		       totals.total / frames / 1000.0, totals.total ? frames * 1000000.0 / totals.total : 0.0);
+		printf("average: vis %.3f  sort %.3f  place %.3f  raster %.3f ms\n",
+		       totals.stages.build_render_tree / frames / 1000.0,
+		       totals.stages.sort_render_tree / frames / 1000.0,
+		       totals.stages.build_render_object_list / frames / 1000.0,
+		       totals.stages.render_tree / frames / 1000.0);
+		
+		const render_tree_statistics& trees = get_render_tree_statistics();
+		printf("visibility trees: %u built, %u reused; %u sprites occluded\n", (unsigned)trees.built, (unsigned)trees.reused, (unsigned)trees.occluded_sprites);
+		
+		const shading_table_statistics& shading = get_shading_table_statistics();
+		printf("shading tables: %u of %u built, %u KB\n", (unsigned)shading.built, (unsigned)shading.tables, (unsigned)(shading.bytes / 1024));
+	}
+	return success;
+}
+
 OpenedResourceFile ExternalResources;
 
 void set_external_resources_file(FileSpecifier& f)
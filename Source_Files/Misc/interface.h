@@ -330,6 +330,17 @@ int count_replacement_collections();
 void load_replacement_collections();
 void unload_all_collections(void);
 
+// How many shading and tint tables the loaded collections have, how many of them have
+// been asked for (and so built) so far, and the memory those take up
+struct shading_table_statistics
+{
+	uint32 tables;
+	uint32 built;
+	uint32 bytes;
+};
+
+const struct shading_table_statistics& get_shading_table_statistics(void);
+
 void set_shapes_patch_data(uint8 *data, size_t length);
 uint8* get_shapes_patch_data(size_t &length);
 
@@ -376,6 +387,7 @@ void stop_recording(void);
 void stop_replay(void);
 void move_replay(void);
 void check_recording_replaying(void);
+void update_film_state_hash(void);
 short find_key_setup(short *keycodes);
 void set_default_keys(short *keycodes, short which_default);
 void set_keys(short *keycodes);
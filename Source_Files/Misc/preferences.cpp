@@ -2357,6 +2357,22 @@ struct get_latency_tolerance
 	}
 };
 
+struct set_texture_budget
+{
+	void operator() (const std::string& arg) const {
+		graphics_preferences->OGL_Configure.TextureBudget = PIN(atoi(arg.c_str()), 0, SHRT_MAX);
+		screen_printf("texture budget is now %i MB", graphics_preferences->OGL_Configure.TextureBudget);
+		write_preferences();
+	}
+};
+
+struct get_texture_budget
+{
+	void operator() (const std::string&) const {
+		screen_printf("texture budget is %i MB", graphics_preferences->OGL_Configure.TextureBudget);
+	}
+};
+
 void transition_preferences(const DirectorySpecifier& legacy_preferences_dir)
 {
 	FileSpecifier prefs;
@@ -2398,8 +2414,10 @@ void initialize_preferences(
 
 		CommandParser PreferenceSetCommandParser;
 		PreferenceSetCommandParser.register_command("latency_tolerance", set_latency_tolerance());
+		PreferenceSetCommandParser.register_command("texture_budget", set_texture_budget());
 		CommandParser PreferenceGetCommandParser;
 		PreferenceGetCommandParser.register_command("latency_tolerance", get_latency_tolerance());
+		PreferenceGetCommandParser.register_command("texture_budget", get_texture_budget());
 
 		CommandParser PreferenceCommandParser;
 		PreferenceCommandParser.register_command("set", PreferenceSetCommandParser);
@@ -2539,10 +2557,13 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("scmode_fix_h_not_v", graphics_preferences->screen_mode.fix_h_not_v);
 	root.put_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.put_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
+	root.put_attr("software_render_threads", graphics_preferences->software_render_threads);
+	root.put_attr("software_render_pipelining", graphics_preferences->software_render_pipelining);
 	root.put_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.put_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
 	root.put_attr("geforce_fix", graphics_preferences->OGL_Configure.GeForceFix);
 	root.put_attr("wait_for_vsync", graphics_preferences->OGL_Configure.WaitForVSync);
+	root.put_attr("texture_budget", graphics_preferences->OGL_Configure.TextureBudget);
 	root.put_attr("gamma_corrected_blending", graphics_preferences->OGL_Configure.Use_sRGB);
 	root.put_attr("use_npot", graphics_preferences->OGL_Configure.Use_NPOT);
 	root.put_attr("double_corpse_limit", graphics_preferences->double_corpse_limit);
@@ -2833,6 +2854,8 @@ static void default_graphics_preferences(graphics_preferences_data *preferences)
 	preferences->hog_the_cpu = false;
 
 	preferences->software_alpha_blending = _sw_alpha_off;
+	preferences->software_render_threads = 0;
+	preferences->software_render_pipelining = false;
 
 	preferences->movie_export_video_quality = 50;
 	preferences->movie_export_audio_quality = 50;
@@ -3325,10 +3348,13 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr("scmode_gamma", graphics_preferences->screen_mode.gamma_level);
 	root.read_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.read_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
+	root.read_attr_bounded<int16>("software_render_threads", graphics_preferences->software_render_threads, 0, 64);
+	root.read_attr("software_render_pipelining", graphics_preferences->software_render_pipelining);
 	root.read_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.read_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
 	root.read_attr("geforce_fix", graphics_preferences->OGL_Configure.GeForceFix);
 	root.read_attr("wait_for_vsync", graphics_preferences->OGL_Configure.WaitForVSync);
+	root.read_attr_bounded<int16>("texture_budget", graphics_preferences->OGL_Configure.TextureBudget, 0, SHRT_MAX);
 	root.read_attr("gamma_corrected_blending", graphics_preferences->OGL_Configure.Use_sRGB);
 	root.read_attr("use_npot", graphics_preferences->OGL_Configure.Use_NPOT);
 	root.read_attr("double_corpse_limit", graphics_preferences->double_corpse_limit);
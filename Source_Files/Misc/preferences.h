@@ -77,6 +77,8 @@ struct graphics_preferences_data
 	bool double_corpse_limit;
 
 	int16 software_alpha_blending;
+	int16 software_render_threads; // 0 means one per processor
+	bool software_render_pipelining; // draw each view while the next tick is computed
 
 	bool hog_the_cpu;
 
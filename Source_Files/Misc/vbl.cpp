@@ -74,11 +74,18 @@ Aug 26, 2000 (Loren Petrich):
 
 Feb 20, 2002 (Woody Zenfell):
     Uses GetRealActionQueues()->enqueueActionFlags() rather than queue_action_flags().
+
+2016:
+	Version-2 films: compressed chunks written by a background thread, with
+	world state hashes.  Version-1 films still play.
 */
 
 #include "cseries.h"
 #include <string.h>
 #include <stdlib.h>
+#include <zlib.h>
+
+#include <deque>
 
 #include "map.h"
 #include "interface.h"
@@ -99,6 +106,8 @@ Feb 20, 2002 (Woody Zenfell):
 #include "Movie.h"
 #include "InfoTree.h"
 
+#include "SDL_thread.h"
+
 /* ---------- constants */
 
 #define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
@@ -109,6 +118,12 @@ Feb 20, 2002 (Woody Zenfell):
 #define MAXIMUM_REPLAY_SPEED         5
 #define MINIMUM_REPLAY_SPEED        -5
 
+#define FILM_MAGIC                  FOUR_CHARS_TO_INT('f', 'l', 'm', '2')
+#define FILM_VERSION                2
+#define MAXIMUM_FILM_CHUNK_HASHES   SHRT_MAX
+#define MAXIMUM_FILM_CHUNK_LENGTH   (MAXIMUM_FILM_CHUNK_HASHES*sizeof(uint16) + \
+	MAXIMUM_NUMBER_OF_PLAYERS*(RECORD_CHUNK_SIZE+1)*(sizeof(int16)+sizeof(uint32)))
+
 /* ---------- macros */
 
 #define INCREMENT_QUEUE_COUNTER(c) { (c)++; if ((c)>=MAXIMUM_QUEUE_SIZE) (c) = 0; }
@@ -134,6 +149,44 @@ struct key_definition current_key_definitions[NUMBER_OF_STANDARD_KEY_DEFINITIONS
 
 struct replay_private_data replay;
 
+// Version-2 films (see vbl_definitions.h)
+struct film_chunk_job
+{
+	film_chunk_header header;
+	std::vector<uint8> data; /* the hashes, then every player's run-length encoded flags */
+};
+
+// While a film is being recorded, FilmFile belongs to the writer thread
+static struct film_writer_data
+{
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *wakeup;
+	std::deque<film_chunk_job *> jobs;
+	bool quit;
+	bool failed; /* set under the lock once there's a writer thread */
+	int32 offset; /* where the next chunk goes */
+} film_writer;
+
+// the chunk being assembled by save_recording_queue_chunk()
+static std::vector<uint8> film_pending_flags;
+static int16 film_pending_ticks;
+static std::vector<uint16> film_pending_hashes;
+static int32 film_pending_first_hash;
+static int32 film_ticks_recorded;
+
+// the chunk being replayed; vblFSRead() reads through it
+static bool film_is_version_2;
+static int32 film_read_offset, film_read_end;
+static std::vector<uint8> film_expanded;
+static size_t film_expanded_position;
+static std::deque<uint16> film_expected_hashes;
+static int32 film_expected_first_hash;
+static bool film_desync_reported;
+
+// real world ticks since the recording or replay began
+static int32 film_world_ticks;
+
 #ifdef DEBUG
 ActionQueue *get_player_recording_queue(
 	short player_index)
@@ -156,6 +209,18 @@ static bool vblFSRead(OpenedFile& File, int32 *count, void *dest, bool& HitEOF);
 static void record_action_flags(short player_identifier, const uint32 *action_flags, short count);
 static short get_recording_queue_size(short which_queue);
 
+static void begin_film_chunks(void);
+static void queue_film_chunk(void);
+static void write_film_chunk(film_chunk_job *job);
+static int film_writer_thread(void *);
+static void start_film_writer(int32 offset);
+static bool stop_film_writer(void);
+static bool read_film_header(OpenedFile& File, film_header& Header);
+static bool read_film_chunk(OpenedFile& File, int32 offset, int32 end, film_chunk_header& Header, std::vector<uint8>& expanded);
+static bool load_next_film_chunk(void);
+static int32 read_film_bytes(char *dest, int32 count);
+static uint16 world_state_hash(void);
+
 static uint8 *unpack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 static uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 
@@ -479,8 +544,9 @@ void save_recording_queue_chunk(
 		num_flags_saved += RECORD_CHUNK_SIZE-max_flags;
 	}
 	
-	FilmFile.Write(count,buffer);
-	replay.header.length+= count;
+	film_pending_flags.insert(film_pending_flags.end(), buffer, buffer + count);
+	if (player_index == 0)
+		film_pending_ticks= max_flags;
 		
 	vwarn(num_flags_saved == RECORD_CHUNK_SIZE,
 		csprintf(temporary, "bad recording: %d flags, max=%d, count = %u;dm #%p #%u", num_flags_saved, max_flags,
@@ -494,6 +560,339 @@ void save_recording_queue_chunk(
  * Returns:  true if it pulled the flags, false if it didn't
  *
  *********************************************************************************************/
+/*********************************************************************************************
+ *
+ * Function: queue_film_chunk
+ * Purpose:  hands the chunks saved since the last call to the film writer, as one
+ *           compressed film chunk.
+ *
+ *********************************************************************************************/
+static void queue_film_chunk(
+	void)
+{
+	if (film_pending_flags.empty() && film_pending_hashes.empty()) return;
+
+	film_chunk_job *job= new film_chunk_job;
+	job->header.first_tick= film_ticks_recorded;
+	job->header.tick_count= film_pending_ticks;
+	job->header.hash_count= static_cast<int16>(film_pending_hashes.size());
+	job->header.first_hash= film_pending_first_hash;
+	job->header.compressed_length= 0;
+
+	job->data.resize(film_pending_hashes.size()*sizeof(uint16) + film_pending_flags.size());
+	uint8 *S= &job->data[0];
+	if (!film_pending_hashes.empty())
+		ListToStream(S, &film_pending_hashes[0], film_pending_hashes.size());
+	if (!film_pending_flags.empty())
+		memcpy(S, &film_pending_flags[0], film_pending_flags.size());
+	job->header.expanded_length= static_cast<int32>(job->data.size());
+
+	film_ticks_recorded+= film_pending_ticks;
+	film_pending_ticks= 0;
+	film_pending_flags.clear();
+	film_pending_hashes.clear();
+
+	if (film_writer.thread)
+	{
+		SDL_LockMutex(film_writer.lock);
+		film_writer.jobs.push_back(job);
+		SDL_CondSignal(film_writer.wakeup);
+		SDL_UnlockMutex(film_writer.lock);
+	}
+	else
+	{
+		write_film_chunk(job);
+		delete job;
+	}
+}
+
+static void film_writer_failed(
+	void)
+{
+	if (film_writer.lock) SDL_LockMutex(film_writer.lock);
+	film_writer.failed= true;
+	if (film_writer.lock) SDL_UnlockMutex(film_writer.lock);
+}
+
+/* Runs on the writer thread, which owns FilmFile and film_writer.offset;
+   only it sets failed, so it can read that without the lock */
+static void write_film_chunk(
+	film_chunk_job *job)
+{
+	if (film_writer.failed) return;
+
+	uLongf compressed_length= compressBound(job->data.size());
+	std::vector<uint8> buffer(SIZEOF_film_chunk_header + compressed_length);
+	if (compress2(&buffer[SIZEOF_film_chunk_header], &compressed_length, &job->data[0], job->data.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		film_writer_failed();
+		return;
+	}
+
+	job->header.compressed_length= static_cast<int32>(compressed_length);
+	pack_with_schema(&buffer[0], &job->header, 1, SIZEOF_film_chunk_header);
+
+	int32 length= SIZEOF_film_chunk_header + job->header.compressed_length;
+	if (!FilmFile.Write(length, &buffer[0]))
+	{
+		film_writer_failed();
+		return;
+	}
+
+	film_writer.offset+= length;
+}
+
+static int film_writer_thread(
+	void *)
+{
+	SDL_LockMutex(film_writer.lock);
+	for (;;)
+	{
+		while (film_writer.jobs.empty() && !film_writer.quit)
+			SDL_CondWait(film_writer.wakeup, film_writer.lock);
+		if (film_writer.jobs.empty()) break;
+
+		film_chunk_job *job= film_writer.jobs.front();
+		film_writer.jobs.pop_front();
+		SDL_UnlockMutex(film_writer.lock);
+
+		write_film_chunk(job);
+		delete job;
+
+		SDL_LockMutex(film_writer.lock);
+	}
+	SDL_UnlockMutex(film_writer.lock);
+
+	return 0;
+}
+
+static void start_film_writer(
+	int32 offset)
+{
+	assert(!film_writer.thread);
+	film_writer.quit= false;
+	film_writer.failed= false;
+	film_writer.offset= offset;
+
+	film_writer.lock= SDL_CreateMutex();
+	film_writer.wakeup= SDL_CreateCond();
+	if (film_writer.lock && film_writer.wakeup)
+		film_writer.thread= SDL_CreateThread(film_writer_thread, NULL);
+
+	if (!film_writer.thread)
+		logWarning("couldn't start the film writer thread; film chunks will be written synchronously");
+}
+
+/* Returns once every queued chunk is on disk; false if any of them couldn't be written */
+static bool stop_film_writer(
+	void)
+{
+	if (film_writer.thread)
+	{
+		SDL_LockMutex(film_writer.lock);
+		film_writer.quit= true;
+		SDL_CondSignal(film_writer.wakeup);
+		SDL_UnlockMutex(film_writer.lock);
+
+		SDL_WaitThread(film_writer.thread, NULL);
+		film_writer.thread= NULL;
+	}
+
+	if (film_writer.wakeup)
+	{
+		SDL_DestroyCond(film_writer.wakeup);
+		film_writer.wakeup= NULL;
+	}
+	bool failed= film_writer.failed;
+	if (film_writer.lock)
+	{
+		SDL_LockMutex(film_writer.lock);
+		failed= film_writer.failed;
+		SDL_UnlockMutex(film_writer.lock);
+		SDL_DestroyMutex(film_writer.lock);
+		film_writer.lock= NULL;
+	}
+	return !failed;
+}
+
+/* Writes an empty film header after the recording header, and starts the chunk stream */
+static void begin_film_chunks(
+	void)
+{
+	film_header Header;
+	obj_clear(Header);
+	Header.magic= FILM_MAGIC;
+	Header.version= FILM_VERSION;
+	Header.player_count= replay.header.num_players;
+
+	uint8 Buffer[SIZEOF_film_header];
+	pack_with_schema(Buffer, &Header, 1, SIZEOF_film_header);
+	FilmFile.Write(SIZEOF_film_header, Buffer);
+
+	film_pending_flags.clear();
+	film_pending_hashes.clear();
+	film_pending_ticks= 0;
+	film_ticks_recorded= 0;
+	film_world_ticks= 0;
+
+	start_film_writer(SIZEOF_recording_header + SIZEOF_film_header);
+}
+
+/* Leaves File after the film header; false (and File where it was) for version-1 films */
+static bool read_film_header(
+	OpenedFile& File,
+	film_header& Header)
+{
+	int32 position;
+	uint8 Buffer[SIZEOF_film_header];
+
+	if (!File.GetPosition(position)) return false;
+	if (File.Read(SIZEOF_film_header, Buffer))
+	{
+		unpack_with_schema(Buffer, &Header, 1, SIZEOF_film_header);
+		if (Header.magic == FILM_MAGIC) return true;
+	}
+
+	File.SetPosition(position);
+	return false;
+}
+
+static bool read_film_chunk(
+	OpenedFile& File,
+	int32 offset,
+	int32 end,
+	film_chunk_header& Header,
+	std::vector<uint8>& expanded)
+{
+	uint8 Buffer[SIZEOF_film_chunk_header];
+	if (!File.SetPosition(offset) || !File.Read(SIZEOF_film_chunk_header, Buffer)) return false;
+	unpack_with_schema(Buffer, &Header, 1, SIZEOF_film_chunk_header);
+
+	if (Header.compressed_length <= 0 || Header.compressed_length > end - offset - SIZEOF_film_chunk_header) return false;
+	if (Header.expanded_length <= 0 || Header.expanded_length > int32(MAXIMUM_FILM_CHUNK_LENGTH)) return false;
+	if (Header.hash_count < 0 || Header.hash_count*int32(sizeof(uint16)) > Header.expanded_length) return false;
+
+	std::vector<uint8> compressed(Header.compressed_length);
+	if (!File.Read(Header.compressed_length, &compressed[0])) return false;
+
+	expanded.resize(Header.expanded_length);
+	uLongf expanded_length= Header.expanded_length;
+	return uncompress(&expanded[0], &expanded_length, &compressed[0], compressed.size()) == Z_OK &&
+		expanded_length == uLongf(Header.expanded_length);
+}
+
+static bool load_next_film_chunk(
+	void)
+{
+	if (film_read_offset + SIZEOF_film_chunk_header > film_read_end) return false;
+
+	film_chunk_header Header;
+	if (!read_film_chunk(FilmFile, film_read_offset, film_read_end, Header, film_expanded))
+	{
+		logError("film chunk at offset %d is damaged", film_read_offset);
+		film_read_offset= film_read_end;
+		film_expanded.clear();
+		film_expanded_position= 0;
+		return false;
+	}
+	film_read_offset+= SIZEOF_film_chunk_header + Header.compressed_length;
+
+	// the hashes are read ahead of the ticks they belong to; keep them for update_film_state_hash()
+	if (film_expected_hashes.empty() || film_expected_first_hash + int32(film_expected_hashes.size()) != Header.first_hash)
+	{
+		film_expected_hashes.clear();
+		film_expected_first_hash= Header.first_hash;
+	}
+	uint8 *S= &film_expanded[0];
+	for (int16 i= 0; i<Header.hash_count; i++)
+	{
+		uint16 hash;
+		StreamToValue(S, hash);
+		film_expected_hashes.push_back(hash);
+	}
+	film_expanded_position= Header.hash_count*sizeof(uint16);
+
+	return true;
+}
+
+/* The version-2 equivalent of reading the film file; returns how much it read */
+static int32 read_film_bytes(
+	char *dest,
+	int32 count)
+{
+	int32 copied= 0;
+
+	while (copied < count)
+	{
+		if (film_expanded_position == film_expanded.size() && !load_next_film_chunk()) break;
+
+		int32 available= MIN(count - copied, int32(film_expanded.size() - film_expanded_position));
+		memcpy(dest + copied, &film_expanded[film_expanded_position], available);
+		film_expanded_position+= available;
+		copied+= available;
+	}
+
+	return copied;
+}
+
+static inline void mix_state_hash(uint32& hash, uint32 value)
+{
+	hash= (hash ^ value) * 16777619U;
+}
+
+/* Cheap, but anything that desyncs a film soon shows up in the random seed or a player */
+static uint16 world_state_hash(
+	void)
+{
+	uint32 hash= 2166136261U;
+
+	mix_state_hash(hash, dynamic_world->tick_count);
+	mix_state_hash(hash, get_random_seed());
+	for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		player_data *player= get_player_data(player_index);
+		mix_state_hash(hash, uint16(player->location.x) | (uint32(uint16(player->location.y)) << 16));
+		mix_state_hash(hash, uint16(player->location.z) | (uint32(uint16(player->facing)) << 16));
+		mix_state_hash(hash, uint16(player->suit_energy));
+	}
+
+	return uint16(hash ^ (hash >> 16));
+}
+
+void update_film_state_hash(
+	void)
+{
+	if (replay.game_is_being_recorded)
+	{
+		if (film_pending_hashes.empty())
+			film_pending_first_hash= film_world_ticks;
+		if (film_pending_hashes.size() < MAXIMUM_FILM_CHUNK_HASHES)
+			film_pending_hashes.push_back(world_state_hash());
+	}
+	else if (replay.game_is_being_replayed && film_is_version_2)
+	{
+		while (!film_expected_hashes.empty() && film_expected_first_hash < film_world_ticks)
+		{
+			film_expected_hashes.pop_front();
+			film_expected_first_hash++;
+		}
+
+		if (!film_expected_hashes.empty() && film_expected_first_hash == film_world_ticks)
+		{
+			if (film_expected_hashes.front() != world_state_hash() && !film_desync_reported)
+			{
+				logWarning("film is out of sync at world tick %d", film_world_ticks);
+				screen_printf("Film is out of sync");
+				film_desync_reported= true;
+			}
+			film_expected_hashes.pop_front();
+			film_expected_first_hash++;
+		}
+	}
+
+	film_world_ticks++;
+}
+
 static bool pull_flags_from_recording(
 	short count)
 {
@@ -614,9 +1013,29 @@ bool setup_for_replay_from_file(
 		FilmFile.Read(SIZEOF_recording_header,Header);
 		unpack_recording_header(Header,&replay.header,1);
 		replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
+
+		film_header Film;
+		film_is_version_2= read_film_header(FilmFile, Film);
+		if (film_is_version_2)
+		{
+			film_read_offset= SIZEOF_recording_header + SIZEOF_film_header;
+			FilmFile.GetLength(film_read_end);
+		}
+		film_expanded.clear();
+		film_expanded_position= 0;
+		film_expected_hashes.clear();
+		film_desync_reported= false;
+		film_world_ticks= 0;
 	
+		if (film_is_version_2 && Film.version > FILM_VERSION)
+		{
+			alert_user(infoError, strERRORS, replayVersionTooNew, 0);
+			replay.valid= false;
+			replay.game_is_being_replayed= false;
+			FilmFile.Close();
+		}
 		/* Set to the mapfile this replay came from.. */
-		if(use_map_file(replay.header.map_checksum))
+		else if(use_map_file(replay.header.map_checksum))
 		{
 			replay.fsread_buffer= new char[DISK_CACHE_SIZE]; 
 			assert(replay.fsread_buffer);
@@ -664,6 +1083,7 @@ void start_recording(
 			byte Header[SIZEOF_recording_header];
 			pack_recording_header(Header,&replay.header,1);
 			FilmFile.Write(SIZEOF_recording_header,Header);
+			begin_film_chunks();
 		}
 	}
 }
@@ -683,20 +1103,34 @@ void stop_recording(
 		{
 			save_recording_queue_chunk(player_index);
 		}
+		queue_film_chunk();
+		bool successfulWrite= stop_film_writer();
+
+		film_header Film;
+		Film.magic= FILM_MAGIC;
+		Film.version= FILM_VERSION;
+		Film.player_count= replay.header.num_players;
+		Film.tick_count= film_ticks_recorded;
+		replay.header.length= film_writer.offset;
 
 		/* Rewrite the header, since it has the new length */
-		FilmFile.SetPosition(0);
-		byte Header[SIZEOF_recording_header];
+		byte Header[SIZEOF_recording_header + SIZEOF_film_header];
 		pack_recording_header(Header,&replay.header,1);
+		pack_with_schema(Header + SIZEOF_recording_header, &Film, 1, SIZEOF_film_header);
+		if (successfulWrite)
+			successfulWrite= FilmFile.SetPosition(0) && FilmFile.Write(sizeof(Header),Header);
 
-		// ZZZ: removing code that does stuff from assert() argument.  BUT...
-		// should we really be asserting on this anyway?  I mean, the write could fail
-		// in 'normal operation' too, not just when we screwed something up in writing the program?
-		bool successfulWrite = FilmFile.Write(SIZEOF_recording_header,Header);
-		assert(successfulWrite);
-		
-		FilmFile.GetLength(total_length);
-		assert(total_length==replay.header.length);
+		// ZZZ: the write could fail in 'normal operation' too, not just when we
+		// screwed something up in writing the program, so don't assert on it
+		if (successfulWrite)
+		{
+			FilmFile.GetLength(total_length);
+			assert(total_length==replay.header.length);
+		}
+		else
+		{
+			logError("couldn't finish writing the film (error %d)", FilmFile.GetError());
+		}
 		
 		FilmFile.Close();
 	}
@@ -716,6 +1150,7 @@ void rewind_recording(
 		FilmFile.SetPosition(sizeof(recording_header));
 		*/
 		// Alternative that does not use "SetLength", but instead creates and re-creates the file.
+		stop_film_writer();
 		FilmFile.SetPosition(0);
 		byte Header[SIZEOF_recording_header];
 		FilmFile.Read(SIZEOF_recording_header,Header);
@@ -727,6 +1162,7 @@ void rewind_recording(
 		
 		// Use the packed length here!!!
 		replay.header.length= SIZEOF_recording_header;
+		begin_film_chunks();
 	}
 }
 
@@ -761,6 +1197,7 @@ void check_recording_replaying(
 				{
 					save_recording_queue_chunk(player_index);
 				}
+				queue_film_chunk();
 			}
 		}
 	}
@@ -930,25 +1367,33 @@ static bool vblFSRead(
 		}
 		replay.location_in_cache = replay.fsread_buffer;
 		fsread_count= DISK_CACHE_SIZE - replay.bytes_in_cache;
-		int32 PrevPos;
-		File.GetPosition(PrevPos);
-		int32 replay_left= replay.header.length - PrevPos;
-		if(replay_left < fsread_count)
-			fsread_count= replay_left;
-		if(fsread_count > 0)
+		if (film_is_version_2)
 		{
-			assert(fsread_count > 0);
-			// LP: wrapped the routines with some for finding out the file positions;
-			// this finds out how much is read indirectly
-			status = File.Read(fsread_count,replay.fsread_buffer+replay.bytes_in_cache);
-			int32 CurrPos;
-			File.GetPosition(CurrPos);
-			int32 new_fsread_count = CurrPos - PrevPos;
-			int32 FileLen;
-			File.GetLength(FileLen);
-			HitEOF = (new_fsread_count < fsread_count) && (CurrPos == FileLen);
-			fsread_count = new_fsread_count;
-			if(status) replay.bytes_in_cache += fsread_count;
+			// version-2 films are read a chunk at a time
+			replay.bytes_in_cache += read_film_bytes(replay.fsread_buffer+replay.bytes_in_cache, fsread_count);
+		}
+		else
+		{
+			int32 PrevPos;
+			File.GetPosition(PrevPos);
+			int32 replay_left= replay.header.length - PrevPos;
+			if(replay_left < fsread_count)
+				fsread_count= replay_left;
+			if(fsread_count > 0)
+			{
+				assert(fsread_count > 0);
+				// LP: wrapped the routines with some for finding out the file positions;
+				// this finds out how much is read indirectly
+				status = File.Read(fsread_count,replay.fsread_buffer+replay.bytes_in_cache);
+				int32 CurrPos;
+				File.GetPosition(CurrPos);
+				int32 new_fsread_count = CurrPos - PrevPos;
+				int32 FileLen;
+				File.GetLength(FileLen);
+				HitEOF = (new_fsread_count < fsread_count) && (CurrPos == FileLen);
+				fsread_count = new_fsread_count;
+				if(status) replay.bytes_in_cache += fsread_count;
+			}
 		}
 	}
 
@@ -1046,26 +1491,17 @@ static void PlayerStartToStream(uint8* &S, player_start_data& Object)
 }
 
 
+// game_data's packed layout is shared with the map's dynamic data
 static void StreamToGameData(uint8* &S, game_data& Object)
 {
-	StreamToValue(S,Object.game_time_remaining);
-	StreamToValue(S,Object.game_type);
-	StreamToValue(S,Object.game_options);
-	StreamToValue(S,Object.kill_limit);
-	StreamToValue(S,Object.initial_random_seed);
-	StreamToValue(S,Object.difficulty_level);
-	StreamToList(S,Object.parameters,2);
+	PackingUnpacker Unpacker(S);
+	packing_schema(Unpacker,Object);
 }
 
 static void GameDataToStream(uint8* &S, game_data& Object)
 {
-	ValueToStream(S,Object.game_time_remaining);
-	ValueToStream(S,Object.game_type);
-	ValueToStream(S,Object.game_options);
-	ValueToStream(S,Object.kill_limit);
-	ValueToStream(S,Object.initial_random_seed);
-	ValueToStream(S,Object.difficulty_level);
-	ListToStream(S,Object.parameters,2);
+	PackingPacker Packer(S);
+	packing_schema(Packer,Object);
 }
 
 
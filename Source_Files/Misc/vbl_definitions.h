@@ -49,6 +49,50 @@ struct recording_header
 };
 const int SIZEOF_recording_header = 352;
 
+/* Version-2 films: the recording header is followed by a film_header and a
+   stream of zlib-compressed chunks, each holding one round of action flags
+   for every player plus the world state hashes taken while they were
+   recorded.  The chunks run to the end of the file; tick_count is filled in
+   when the recording stops, and stays 0 in a film that was never finished. */
+struct film_header
+{
+	uint32 magic;
+	int16 version;
+	int16 player_count;
+	int32 tick_count;
+};
+const int SIZEOF_film_header = 12;
+
+struct film_chunk_header
+{
+	int32 first_tick;
+	int16 tick_count;
+	int16 hash_count;
+	int32 first_hash; /* world tick of the first (uint16) hash */
+	int32 expanded_length;
+	int32 compressed_length;
+};
+const int SIZEOF_film_chunk_header = 20;
+
+// Packed layouts (see Packing.h)
+template<class Visitor> void packing_schema(Visitor& V, film_header& Object)
+{
+	V(Object.magic);
+	V(Object.version);
+	V(Object.player_count);
+	V(Object.tick_count);
+}
+
+template<class Visitor> void packing_schema(Visitor& V, film_chunk_header& Object)
+{
+	V(Object.first_tick);
+	V(Object.tick_count);
+	V(Object.hash_count);
+	V(Object.first_hash);
+	V(Object.expanded_length);
+	V(Object.compressed_length);
+}
+
 struct replay_private_data {
 	bool valid;
 	struct recording_header header;
@@ -49,6 +49,75 @@
 static vector<Model3D_Transform> BoneMatrices;
 static vector<size_t> BoneStack;
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SSE_MODEL_TRANSFORMS
+#include <xmmintrin.h>
+#endif
+
+// A transform laid out by columns, the last one being the offset, each padded to 4;
+// a transformed point is then the sum of the columns scaled by the point's coordinates
+struct Model3D_Columns
+{
+	GLfloat C[4][4];
+};
+
+// Per-bone columns with the overall position and normal transforms folded in
+static vector<Model3D_Columns> PosColumns;
+static vector<Model3D_Columns> NormColumns;
+
+static void FindColumns(Model3D_Columns& Cols, Model3D_Transform& T)
+{
+	for (int ic=0; ic<4; ic++)
+	{
+		for (int ir=0; ir<3; ir++)
+			Cols.C[ic][ir] = T.M[ir][ic];
+		Cols.C[ic][3] = 0;
+	}
+}
+
+#ifdef SSE_MODEL_TRANSFORMS
+inline __m128 ColumnsProduct(const Model3D_Columns& T, __m128 X, __m128 Y, __m128 Z, bool Offset)
+{
+	__m128 R = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(T.C[0]),X),_mm_mul_ps(_mm_loadu_ps(T.C[1]),Y)),
+		_mm_mul_ps(_mm_loadu_ps(T.C[2]),Z));
+	return Offset ? _mm_add_ps(R,_mm_loadu_ps(T.C[3])) : R;
+}
+#endif
+
+// Dest = T0 * Src, blended toward T1 * Src by Blend if T1 is present;
+// points get the offset and vectors don't (source and dest must be different arrays)
+inline void BlendedTransform(GLfloat *Dest, const GLfloat *Src,
+	const Model3D_Columns& T0, const Model3D_Columns *T1, GLfloat Blend, bool Offset)
+{
+#ifdef SSE_MODEL_TRANSFORMS
+	__m128 X = _mm_set1_ps(Src[0]);
+	__m128 Y = _mm_set1_ps(Src[1]);
+	__m128 Z = _mm_set1_ps(Src[2]);
+	__m128 R = ColumnsProduct(T0,X,Y,Z,Offset);
+	if (T1)
+	{
+		__m128 R1 = ColumnsProduct(*T1,X,Y,Z,Offset);
+		R = _mm_add_ps(R,_mm_mul_ps(_mm_sub_ps(R1,R),_mm_set1_ps(Blend)));
+	}
+	GLfloat Res[4];
+	_mm_storeu_ps(Res,R);
+	VecCopy(Res,Dest);
+#else
+	for (int ic=0; ic<3; ic++)
+	{
+		GLfloat V = T0.C[0][ic]*Src[0] + T0.C[1][ic]*Src[1] + T0.C[2][ic]*Src[2];
+		if (Offset) V += T0.C[3][ic];
+		if (T1)
+		{
+			GLfloat V1 = T1->C[0][ic]*Src[0] + T1->C[1][ic]*Src[1] + T1->C[2][ic]*Src[2];
+			if (Offset) V1 += T1->C[3][ic];
+			V += Blend*(V1 - V);
+		}
+		Dest[ic] = V;
+	}
+#endif
+}
 
 // Find transform of point (source and dest must be different arrays)
 inline void TransformPoint(GLfloat *Dest, GLfloat *Src, Model3D_Transform& T)
@@ -101,6 +170,7 @@ void Model3D::Clear()
 	Frames.clear();
 	SeqFrames.clear();
 	SeqFrmPointers.clear();
+	Poses.clear();
 	FindBoundingBox();
 }
 
@@ -779,6 +849,19 @@ bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 // Frame case
 bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
+{
+	if (UseModelTransform)
+		return FindPositions_Posed(TransformPos,TransformNorm,FrameIndex,MixFrac,AddlFrameIndex);
+	
+	Model3D_Transform Identity;
+	Identity.Identity();
+	return FindPositions_Posed(Identity,Identity,FrameIndex,MixFrac,AddlFrameIndex);
+}
+
+// Shared by the frame and sequence cases; the overall transforms are folded into
+// the bone matrices, so that each vertex source and normal is only transformed once
+bool Model3D::FindPositions_Posed(Model3D_Transform& PosTransform, Model3D_Transform& NormTransform,
+	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
 {
 	// Bad inputs: do nothing and return false
 	
@@ -795,6 +878,8 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	// Set sizes:
 	BoneMatrices.resize(NumBones);
 	BoneStack.resize(NumBones);
+	PosColumns.resize(NumBones);
+	NormColumns.resize(NumBones);
 	
 	// Find which frame; remember that frame data comes in [NumBones] sets
 	Model3D_Frame *FramePtr = &Frames[NumBones*FrameIndex];
@@ -838,90 +923,59 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 		// Default: parent of next bone is current bone
 		Parent = ib;
 	}
+	
+	// Apply the overall transforms to the bones rather than to the vertices
+	for (size_t ib=0; ib<NumBones; ib++)
+	{
+		Model3D_Transform Res;
+		TMatMultiply(Res,PosTransform,BoneMatrices[ib]);
+		FindColumns(PosColumns[ib],Res);
+		TMatMultiply(Res,NormTransform,BoneMatrices[ib]);
+		FindColumns(NormColumns[ib],Res);
+	}
+	
+	// The assumed root bone has only the overall transforms
+	Model3D_Columns RootPosColumns, RootNormColumns;
+	FindColumns(RootPosColumns,PosTransform);
+	FindColumns(RootNormColumns,NormTransform);
 		
 	bool NormalsPresent = !NormSources.empty();
 	if (NormalsPresent) Normals.resize(NormSources.size());
 	
+	GLfloat *PosPtr = Positions.empty() ? NULL : PosBase();
+	GLfloat *NormPtr = NormalsPresent ? NormBase() : NULL;
+	GLfloat *NormSrcPtr = NormalsPresent ? NormSrcBase() : NULL;
+	GLushort *InvIndices = InverseVSIndices.empty() ? NULL : InverseVIBase();
+	
 	for (unsigned ivs=0; ivs<VtxSources.size(); ivs++)
 	{
 		Model3D_VertexSource& VS = VtxSources[ivs];
-		GLfloat Position[3];
 		
+		Model3D_Columns *PT0 = &RootPosColumns, *PT1 = NULL;
+		Model3D_Columns *NT0 = &RootNormColumns, *NT1 = NULL;
+		GLfloat Blend = 0;
 		if (VS.Bone0 >= 0)
 		{
-			Model3D_Transform& T0 = BoneMatrices[VS.Bone0];
-			TransformPoint(Position,VS.Position,T0);
-
-			if (NormalsPresent)
-			{
-				for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-				{
-					int Indx = 3*InverseVSIndices[iv];
-					TransformVector(NormBase() + Indx, NormSrcBase() + Indx, T0);
-				}
-			}			
-			
-			GLfloat Blend = VS.Blend;
-			if (VS.Bone1 >= 0 && Blend != 0)
-			{
-				Model3D_Transform& T1 = BoneMatrices[VS.Bone1];
-				GLfloat PosExtra[3];
-				GLfloat PosDiff[3];
-				TransformPoint(PosExtra,VS.Position,T1);
-				VecSub(PosExtra,Position,PosDiff);
-				VecScalarMultTo(PosDiff,Blend);
-				VecAddTo(Position,PosDiff);
-				
-				if (NormalsPresent)
-				{
-					for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-					{
-						int Indx = 3*InverseVSIndices[iv];
-						GLfloat NormExtra[3];
-						GLfloat NormDiff[3];
-						GLfloat *OrigNorm = NormSrcBase() + Indx;
-						GLfloat *Norm = NormBase() + Indx;
-						TransformVector(NormExtra,OrigNorm,T1);
-						VecSub(NormExtra,Norm,NormDiff);
-						VecScalarMultTo(NormDiff,Blend);
-						VecAddTo(Norm,NormDiff);
-					}
-				}			
-			}
-		}
-		else	// The assumed root bone (identity transformation)
-		{
-			VecCopy(VS.Position,Position);
-			if (NormalsPresent)
+			PT0 = &PosColumns[VS.Bone0];
+			NT0 = &NormColumns[VS.Bone0];
+			if (VS.Bone1 >= 0 && VS.Blend != 0)
 			{
-				for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-				{
-					int Indx = 3*InverseVSIndices[iv];
-					VecCopy(NormSrcBase() + Indx, NormBase() + Indx);
-				}
+				PT1 = &PosColumns[VS.Bone1];
+				NT1 = &NormColumns[VS.Bone1];
+				Blend = VS.Blend;
 			}
 		}
 		
-		// Copy found position into vertex array!
+		GLfloat Position[3];
+		BlendedTransform(Position,VS.Position,*PT0,PT1,Blend,true);
+		
+		// Copy found position into vertex array, and do the normals along the way
 		for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-			VecCopy(Position,PosBase() + 3*InverseVSIndices[iv]);
-	}
-	
-	if (UseModelTransform)
-	{
-		GLfloat *PP = PosBase();
-		for (size_t k=0; k<Positions.size()/3; k++, PP+=3)
 		{
-			GLfloat Position[3];
-			TransformPoint(Position,PP,TransformPos);
-			VecCopy(Position,PP);
-		}
-		GLfloat *NP = NormBase();
-		for (size_t k=0; k<Normals.size()/3; k++, NP+=3)
-		{
-			GLfloat Normal[3];
-			TransformVector(Normal,NP,TransformNorm);
-			VecCopy(Normal,NP);
+			int Indx = 3*InvIndices[iv];
+			VecCopy(Position,PosPtr + Indx);
+			if (NormalsPresent)
+				BlendedTransform(NormPtr + Indx,NormSrcPtr + Indx,*NT0,NT1,Blend,false);
 		}
 	}
 	
@@ -947,61 +1001,105 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 	
 	if (FrameIndex < 0 || FrameIndex >= NumSF) return false;
 	
+	// Without a crossfade, the additional frame is irrelevant
+	if (MixFrac == 0 || AddlFrameIndex == FrameIndex)
+	{
+		MixFrac = 0;
+		AddlFrameIndex = FrameIndex;
+	}
+	else if (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF) return false;
+	
+	// Every instance of this model in the same pose can share the results
+	Model3D_PoseKey Key(SeqIndex,FrameIndex,UseModelTransform);
+	bool Cacheable = (MixFrac == 0);
+	Model3D_Pose *Pose = Cacheable ? FindPose(Key) : NULL;
+	if (Pose)
+	{
+		Positions = Pose->Positions;
+		Normals = Pose->Normals;
+		return true;
+	}
+	
 	Model3D_Transform TSF;
 	
 	Model3D_SeqFrame& SF = SeqFrames[SeqFrmPointers[SeqIndex] + FrameIndex];
+	Model3D_SeqFrame& ASF = SeqFrames[SeqFrmPointers[SeqIndex] + AddlFrameIndex];
+	FindFrameTransform(TSF,SF,MixFrac,ASF);
 	
-	if (MixFrac != 0 && AddlFrameIndex != FrameIndex)
+	// The sequence-frame transform goes after the bones and before the overall transform
+	Model3D_Transform TPos, TNorm;
+	if (UseModelTransform)
 	{
-		if (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF) return false;
-		
-		Model3D_SeqFrame& ASF = SeqFrames[SeqFrmPointers[SeqIndex] + AddlFrameIndex];
-		FindFrameTransform(TSF,SF,MixFrac,ASF);
-		
-		if (!FindPositions_Frame(false,SF.Frame,MixFrac,ASF.Frame)) return false;
+		TMatMultiply(TPos,TransformPos,TSF);
+		TMatMultiply(TNorm,TransformNorm,TSF);
 	}
 	else
 	{
-		if (!FindPositions_Frame(false,SF.Frame)) return false;
-		FindFrameTransform(TSF,SF,0,SF);
+		obj_copy(TPos,TSF);
+		obj_copy(TNorm,TSF);
 	}
 	
-	Model3D_Transform TTot;
-	if (UseModelTransform)
-		TMatMultiply(TTot,TransformPos,TSF);
-	else
-		obj_copy(TTot,TSF);
+	if (!FindPositions_Posed(TPos,TNorm,SF.Frame,MixFrac,ASF.Frame)) return false;
 	
-	size_t NumVerts = Positions.size()/3;
-	GLfloat *Pos = PosBase();
-	for (size_t iv=0; iv<NumVerts; iv++)
-	{
-		GLfloat NewPos[3];
-		TransformPoint(NewPos,Pos,TTot);
-		VecCopy(NewPos,Pos);
-		Pos += 3;
-	}
+	if (Cacheable) KeepPose(Key);
+	return true;
+}
+
+
+// Pose cache: how many unbaked poses to keep, going by memory use
+const size_t MINIMUM_CACHED_POSES = 8;
+const size_t MAXIMUM_POSE_CACHE_BYTES = 2 << 20;
+
+Model3D_Pose *Model3D::FindPose(const Model3D_PoseKey& Key)
+{
+	PoseClock++;
+	PoseMap::iterator it = Poses.find(Key);
+	if (it == Poses.end()) return NULL;
 	
-	bool NormalsPresent = !NormSources.empty();
-	if (NormalsPresent)
-	{	
-		// OK, since the bones don't change bulk
-		if (UseModelTransform)
-			TMatMultiply(TTot,TransformNorm,TSF);
-		else
-			obj_copy(TTot,TSF);
-				
-		GLfloat *Norm = NormBase();
-		for (size_t iv=0; iv<NumVerts; iv++)
+	it->second.LastUsed = PoseClock;
+	return &it->second;
+}
+
+void Model3D::KeepPose(const Model3D_PoseKey& Key)
+{
+	size_t PoseBytes = (Positions.size() + Normals.size())*sizeof(GLfloat);
+	size_t MaxPoses = MAX(MINIMUM_CACHED_POSES, MAXIMUM_POSE_CACHE_BYTES/MAX(PoseBytes,size_t(1)));
+	
+	// Drop the least-recently-used unbaked pose if there are too many of them;
+	// this only happens on a miss
+	if (!BakingPoses)
+	{
+		size_t NumUnbaked = 0;
+		PoseMap::iterator Oldest = Poses.end();
+		for (PoseMap::iterator it = Poses.begin(); it != Poses.end(); ++it)
 		{
-			GLfloat NewNorm[3];
-			TransformVector(NewNorm,Norm,TTot);
-			VecCopy(NewNorm,Norm);
-			Norm += 3;
+			if (it->second.Baked) continue;
+			NumUnbaked++;
+			if (Oldest == Poses.end() || it->second.LastUsed < Oldest->second.LastUsed)
+				Oldest = it;
 		}
+		
+		if (NumUnbaked >= MaxPoses && Oldest != Poses.end())
+			Poses.erase(Oldest);
 	}
 	
-	return true;
+	Model3D_Pose& Pose = Poses[Key];
+	Pose.Baked = BakingPoses;
+	Pose.LastUsed = PoseClock;
+	Pose.Positions = Positions;
+	Pose.Normals = Normals;
+}
+
+void Model3D::BakePoses()
+{
+	BakingPoses = true;
+	for (GLshort is=0; is<TrueNumSeqs(); is++)
+	{
+		GLshort NumSF = NumSeqFrames(is);
+		for (GLshort ifr=0; ifr<NumSF; ifr++)
+			FindPositions_Sequence(true,is,ifr);
+	}
+	BakingPoses = false;
 }
 
 
@@ -34,6 +34,7 @@ using namespace std;
 #endif
 
 #include <vector>
+#include <map>
 #include "vec3.h"
 
 
@@ -95,6 +96,34 @@ struct Model3D_Transform
 };
 
 
+// Which sequence frame a cached pose is for; crossfades aren't cached
+struct Model3D_PoseKey
+{
+	GLshort Sequence, Frame;
+	bool UseModelTransform;
+	
+	Model3D_PoseKey(GLshort _Sequence, GLshort _Frame, bool _UseModelTransform):
+		Sequence(_Sequence), Frame(_Frame), UseModelTransform(_UseModelTransform) {}
+	
+	bool operator<(const Model3D_PoseKey& k) const
+	{
+		if (Sequence != k.Sequence) return Sequence < k.Sequence;
+		if (Frame != k.Frame) return Frame < k.Frame;
+		return UseModelTransform < k.UseModelTransform;
+	}
+};
+
+// A cached result of finding the positions for a sequence frame
+struct Model3D_Pose
+{
+	bool Baked;			// Found when the model was loaded; never evicted
+	GLuint LastUsed;
+	
+	vector<GLfloat> Positions;
+	vector<GLfloat> Normals;
+};
+
+
 struct Model3D
 {
 	// Assumed dimensions:
@@ -246,11 +275,32 @@ struct Model3D
 	GLshort NumSeqFrames(GLshort SeqIndex);
 	
 	// Returns whether or not the indices were in range.
+	// The results are cached by pose, since every instance of a model
+	// in the same pose gets the same positions; crossfades vary
+	// continuously, so they are always found afresh.
 	bool FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		GLshort FrameIndex, GLfloat MixFrac = 0, GLshort AddlFrameIndex = 0);
 	
+	// Find every sequence frame (without crossfading) in advance;
+	// these poses are kept for as long as the model is
+	void BakePoses();
+	
+	// Cached poses
+	typedef map<Model3D_PoseKey, Model3D_Pose> PoseMap;
+	PoseMap Poses;
+	GLuint PoseClock;
+	bool BakingPoses;
+	
 	// Constructor
-	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+	Model3D(): PoseClock(0), BakingPoses(false) {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+	
+private:
+	// Does the frame case, with the given overall transforms for positions and normals
+	bool FindPositions_Posed(Model3D_Transform& PosTransform, Model3D_Transform& NormTransform,
+		GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex);
+	
+	Model3D_Pose *FindPose(const Model3D_PoseKey& Key);
+	void KeepPose(const Model3D_PoseKey& Key);
 };
 
 #endif
@@ -86,6 +86,14 @@ public:
 	void Resize(int _Width, int _Height, int _TotalBytes);
 
 	bool Minify();
+	
+	// Builds the rest of an RGBA8 image's mipmap chain
+	bool MakeMipMaps();
+	
+	// For caching processed images: appends this one to a buffer,
+	// or reads it back from one, advancing the pointer past it
+	void Pack(std::vector<uint8>& Buffer) const;
+	bool Unpack(const uint8 *&Data, const uint8 *End);
 
 	bool MakeRGBA();
 	bool MakeDXTC3();
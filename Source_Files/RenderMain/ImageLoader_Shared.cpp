@@ -36,15 +36,33 @@
 #include "SDL_endian.h"
 #include "Logging.h"
 
-
-#ifdef HAVE_OPENGL
-#include "OGL_Headers.h"
-#include "OGL_Setup.h" // OGL_IsActive
-#endif
-
 #include <cmath>
 static inline float log2(int x) { return std::log((float) x) / std::log(2.0); };
 
+// Box-filters an RGBA 8888 image down to half its size in each direction
+// (but no less than 1); a direction of odd size loses its last row or column
+static void HalveRGBA8(const uint32 *in, int width, int height, uint32 *out)
+{
+	int newWidth = MAX(1, width >> 1);
+	int newHeight = MAX(1, height >> 1);
+	int across = (width > 1) ? 1 : 0;
+	int down = (height > 1) ? width : 0;
+	
+	for (int y = 0; y < newHeight; y++)
+	{
+		for (int x = 0; x < newWidth; x++)
+		{
+			const uint8 *p0 = (const uint8 *) &in[(2 * y) * width + 2 * x];
+			const uint8 *p1 = p0 + across * 4;
+			const uint8 *p2 = p0 + down * 4;
+			const uint8 *p3 = p2 + across * 4;
+			uint8 *q = (uint8 *) &out[y * newWidth + x];
+			for (int c = 0; c < 4; c++)
+				q[c] = (p0[c] + p1[c] + p2[c] + p3[c] + 2) >> 2;
+		}
+	}
+}
+
 #include <stdlib.h>
 
 int ImageDescriptor::GetMipMapSize(int level) const
@@ -137,34 +155,120 @@ bool ImageDescriptor::Minify()
 	else if (Format == RGBA8)
 	{
 		if (!(Width > 1 || Height > 1)) return false;
-		int newWidth = Width >> 1;
-		int newHeight = Height >> 1;
-#ifdef HAVE_OPENGL
-		if (OGL_IsActive())
-		{
-			
-			uint32 *newPixels = new uint32[newWidth * newHeight];
-			gluScaleImage(GL_RGBA, Width, Height, GL_UNSIGNED_BYTE, Pixels, newWidth, newHeight, GL_UNSIGNED_BYTE, newPixels);
-			delete []Pixels;
-			Pixels = newPixels;
-			Width = newWidth;
-			Height = newHeight;
-			Size = newWidth * newHeight;
-			return true;
-			
-		} 
-		else 
-#endif
-		{
-			fprintf(stderr, "GL not active\n");
-			return false;
-		}
+		int newWidth = MAX(1, Width >> 1);
+		int newHeight = MAX(1, Height >> 1);
+		
+		// Done in software, so that images can be loaded off the main thread
+		uint32 *newPixels = new uint32[newWidth * newHeight];
+		HalveRGBA8(Pixels, Width, Height, newPixels);
+		delete []Pixels;
+		Pixels = newPixels;
+		Width = newWidth;
+		Height = newHeight;
+		Size = newWidth * newHeight * 4;
+		MipMapCount = 0;
+		return true;
 	} 
 	else 
 	{
 		return false;
 	}
 }
+
+// How an image is laid out in a packed buffer; its pixels follow
+struct packed_image_header
+{
+	int32 Width, Height;
+	double VScale, UScale;
+	int32 Size;
+	int32 MipMapCount;
+	int32 Format;
+	int32 PremultipliedAlpha;
+};
+
+void ImageDescriptor::Pack(std::vector<uint8>& Buffer) const
+{
+	packed_image_header Header;
+	memset(&Header, 0, sizeof(Header));
+	if (IsPresent())
+	{
+		Header.Width = Width;
+		Header.Height = Height;
+		Header.VScale = VScale;
+		Header.UScale = UScale;
+		Header.Size = Size;
+		Header.MipMapCount = MipMapCount;
+		Header.Format = Format;
+		Header.PremultipliedAlpha = PremultipliedAlpha;
+	}
+	
+	size_t Start = Buffer.size();
+	Buffer.resize(Start + sizeof(Header) + Header.Size);
+	memcpy(&Buffer[Start], &Header, sizeof(Header));
+	if (Header.Size)
+		memcpy(&Buffer[Start + sizeof(Header)], Pixels, Header.Size);
+}
+
+bool ImageDescriptor::Unpack(const uint8 *&Data, const uint8 *End)
+{
+	packed_image_header Header;
+	if (End - Data < int(sizeof(Header))) return false;
+	memcpy(&Header, Data, sizeof(Header));
+	if (Header.Size < 0 || End - Data - int(sizeof(Header)) < Header.Size) return false;
+	Data += sizeof(Header);
+	
+	Clear();
+	if (Header.Size)
+	{
+		Pixels = new uint32[(Header.Size + 3) / 4];
+		memcpy(Pixels, Data, Header.Size);
+		Data += Header.Size;
+	}
+	Width = Header.Width;
+	Height = Header.Height;
+	VScale = Header.VScale;
+	UScale = Header.UScale;
+	Size = Header.Size;
+	MipMapCount = Header.MipMapCount;
+	Format = static_cast<ImageFormat>(Header.Format);
+	PremultipliedAlpha = (Header.PremultipliedAlpha != 0);
+	return true;
+}
+
+bool ImageDescriptor::MakeMipMaps()
+{
+	if (Format != RGBA8 || !IsPresent()) return false;
+	if (MipMapCount > 1) return true;
+	
+	int Levels = 1;
+	int TotalBytes = Width * Height * 4;
+	while ((Width >> Levels) > 0 || (Height >> Levels) > 0)
+	{
+		TotalBytes += MAX(1, Width >> Levels) * MAX(1, Height >> Levels) * 4;
+		Levels++;
+	}
+	
+	uint32 *newPixels = new uint32[TotalBytes / 4];
+	memcpy(newPixels, Pixels, Width * Height * 4);
+	
+	uint32 *Level = newPixels;
+	int LevelWidth = Width;
+	int LevelHeight = Height;
+	for (int i = 1; i < Levels; i++)
+	{
+		uint32 *NextLevel = Level + LevelWidth * LevelHeight;
+		HalveRGBA8(Level, LevelWidth, LevelHeight, NextLevel);
+		Level = NextLevel;
+		LevelWidth = MAX(1, LevelWidth >> 1);
+		LevelHeight = MAX(1, LevelHeight >> 1);
+	}
+	
+	delete []Pixels;
+	Pixels = newPixels;
+	Size = TotalBytes;
+	MipMapCount = Levels;
+	return true;
+}
 	
 
 ImageDescriptor::ImageDescriptor(const ImageDescriptor &copyFrom) :
@@ -31,6 +31,15 @@
 #ifdef HAVE_OPENGL
 
 #include <cmath>
+#include <string.h>
+
+#if defined(HAVE_UNISTD_H) && !defined(__WIN32__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MODEL_CACHE_MMAP
+#endif
 
 #include "Dim3_Loader.h"
 #include "StudioLoader.h"
@@ -370,6 +379,213 @@ static bool StringsEqual(const char *String1, const char *String2, int MaxStrLen
 }
 
 
+/*
+	Loaded models are kept in the image cache directory in their final form,
+	after the rotations, the normal processing and the tangents, in files
+	named for a hash of the source files' contents and the loading options.
+	Later loads map the file and copy the arrays straight out of it.
+	The arrays are stored as they are in memory, so the key also has
+	the structure sizes and the byte order.
+	Like the texture cache, it's trimmed to a limit after loads that add to it.
+*/
+static const uint32 MODEL_CACHE_VERSION = 1;
+static const char MODEL_CACHE_DIR[] = "Models";
+static const Uint64 MODEL_CACHE_LIMIT = 300000000;
+
+static bool model_cache_written = false;
+
+static bool make_model_cache_key(OGL_ModelData& Data, std::string& key)
+{
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer), "%u;%d;%d,%d,%d,%d,%d;%.9g;%.9g,%.9g,%.9g;%.9g,%.9g,%.9g;%d,%.9g;",
+		MODEL_CACHE_VERSION, SDL_BYTEORDER,
+		int(sizeof(Model3D_VertexSource)), int(sizeof(Model3D_Bone)), int(sizeof(Model3D_Frame)),
+		int(sizeof(Model3D_SeqFrame)), int(sizeof(vec4)),
+		Data.Scale, Data.XRot, Data.YRot, Data.ZRot,
+		Data.XShift, Data.YShift, Data.ZShift, Data.NormalType, Data.NormalSplit);
+	key = buffer;
+	// The type comes from MML, so it can be any length
+	key += &Data.ModelType[0];
+	key += ';';
+	return (OGL_AddFileToCacheKey(key, Data.ModelFile) &&
+		OGL_AddFileToCacheKey(key, Data.ModelFile1) &&
+		OGL_AddFileToCacheKey(key, Data.ModelFile2));
+}
+
+static FileSpecifier model_cache_file(const std::string& key)
+{
+	Uint64 hash = OGL_CacheHash(key.data(), key.size());
+	char name[32];
+	sprintf(name, "%08x%08x", uint32(hash >> 32), uint32(hash));
+	
+	FileSpecifier File;
+	File.SetToImageCacheDir();
+	File.AddPart(MODEL_CACHE_DIR);
+	File.AddPart(name);
+	return File;
+}
+
+static void pack_model_bytes(std::vector<uint8>& contents, const void *data, size_t length)
+{
+	const uint8 *p = static_cast<const uint8 *>(data);
+	contents.insert(contents.end(), p, p + length);
+}
+
+static bool unpack_model_bytes(const uint8*& p, const uint8 *end, void *data, size_t length)
+{
+	if (size_t(end - p) < length) return false;
+	memcpy(data, p, length);
+	p += length;
+	return true;
+}
+
+// Arrays are a count followed by the members
+template<class T> static void pack_model_array(std::vector<uint8>& contents, vector<T>& Array)
+{
+	uint32 count = Array.size();
+	pack_model_bytes(contents, &count, sizeof(count));
+	if (count) pack_model_bytes(contents, &Array[0], count*sizeof(T));
+}
+
+template<class T> static bool unpack_model_array(const uint8*& p, const uint8 *end, vector<T>& Array)
+{
+	uint32 count;
+	if (!unpack_model_bytes(p, end, &count, sizeof(count))) return false;
+	if (size_t(end - p)/sizeof(T) < count) return false;
+	Array.resize(count);
+	return count == 0 || unpack_model_bytes(p, end, &Array[0], count*sizeof(T));
+}
+
+static void pack_model(std::vector<uint8>& contents, Model3D& Model)
+{
+	pack_model_array(contents, Model.Positions);
+	pack_model_array(contents, Model.TxtrCoords);
+	pack_model_array(contents, Model.Normals);
+	pack_model_array(contents, Model.Tangents);
+	pack_model_array(contents, Model.Colors);
+	pack_model_array(contents, Model.VtxSrcIndices);
+	pack_model_array(contents, Model.VtxSources);
+	pack_model_array(contents, Model.NormSources);
+	pack_model_array(contents, Model.InverseVSIndices);
+	pack_model_array(contents, Model.InvVSIPointers);
+	pack_model_array(contents, Model.Bones);
+	pack_model_array(contents, Model.VertIndices);
+	pack_model_array(contents, Model.Frames);
+	pack_model_array(contents, Model.SeqFrames);
+	pack_model_array(contents, Model.SeqFrmPointers);
+	pack_model_bytes(contents, &Model.TransformPos, sizeof(Model.TransformPos));
+	pack_model_bytes(contents, &Model.TransformNorm, sizeof(Model.TransformNorm));
+	pack_model_bytes(contents, Model.BoundingBox, sizeof(Model.BoundingBox));
+}
+
+static bool unpack_model(const uint8 *p, const uint8 *end, Model3D& Model)
+{
+	return (unpack_model_array(p, end, Model.Positions) &&
+		unpack_model_array(p, end, Model.TxtrCoords) &&
+		unpack_model_array(p, end, Model.Normals) &&
+		unpack_model_array(p, end, Model.Tangents) &&
+		unpack_model_array(p, end, Model.Colors) &&
+		unpack_model_array(p, end, Model.VtxSrcIndices) &&
+		unpack_model_array(p, end, Model.VtxSources) &&
+		unpack_model_array(p, end, Model.NormSources) &&
+		unpack_model_array(p, end, Model.InverseVSIndices) &&
+		unpack_model_array(p, end, Model.InvVSIPointers) &&
+		unpack_model_array(p, end, Model.Bones) &&
+		unpack_model_array(p, end, Model.VertIndices) &&
+		unpack_model_array(p, end, Model.Frames) &&
+		unpack_model_array(p, end, Model.SeqFrames) &&
+		unpack_model_array(p, end, Model.SeqFrmPointers) &&
+		unpack_model_bytes(p, end, &Model.TransformPos, sizeof(Model.TransformPos)) &&
+		unpack_model_bytes(p, end, &Model.TransformNorm, sizeof(Model.TransformNorm)) &&
+		unpack_model_bytes(p, end, Model.BoundingBox, sizeof(Model.BoundingBox)) &&
+		p == end);
+}
+
+// The file holds the whole key, to rule out hash collisions, then the model
+static bool load_from_model_cache(Model3D& Model, const std::string& key)
+{
+	FileSpecifier File = model_cache_file(key);
+	if (!File.Exists()) return false;
+	
+	const uint8 *data = NULL;
+	size_t length = 0;
+	
+#ifdef HAVE_MODEL_CACHE_MMAP
+	void *map = MAP_FAILED;
+	int fd = open(File.GetPath(), O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		{
+			map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED)
+			{
+				data = static_cast<const uint8 *>(map);
+				length = st.st_size;
+			}
+		}
+		close(fd);
+	}
+#endif
+	
+	// Otherwise, read it in
+	std::vector<uint8> contents;
+	if (!data)
+	{
+		OpenedFile OFile;
+		int32 file_length;
+		if (!File.Open(OFile) || !OFile.GetLength(file_length) || file_length <= 0) return false;
+		
+		contents.resize(file_length);
+		if (!OFile.Read(file_length, &contents[0])) return false;
+		data = &contents[0];
+		length = file_length;
+	}
+	
+	bool loaded = (length > key.size() &&
+		memcmp(data, key.c_str(), key.size() + 1) == 0 &&
+		unpack_model(data + key.size() + 1, data + length, Model));
+	
+#ifdef HAVE_MODEL_CACHE_MMAP
+	if (map != MAP_FAILED)
+		munmap(map, length);
+#endif
+	
+	if (loaded)
+		OGL_TouchCacheFile(File);
+	else
+		Model.Clear();
+	return loaded;
+}
+
+static void save_to_model_cache(Model3D& Model, const std::string& key)
+{
+	std::vector<uint8> contents(key.c_str(), key.c_str() + key.size() + 1);
+	pack_model(contents, Model);
+	
+	FileSpecifier Dir;
+	Dir.SetToImageCacheDir();
+	Dir.AddPart(MODEL_CACHE_DIR);
+	if (!Dir.Exists())
+		Dir.CreateDirectory();
+	
+	// Written under another name first, so no other load sees half a file
+	FileSpecifier File = model_cache_file(key);
+	FileSpecifier TempFile;
+	TempFile.SetTempName(File);
+	
+	OpenedFile OFile;
+	if (!TempFile.Open(OFile, true)) return;
+	bool written = OFile.Write(contents.size(), &contents[0]);
+	OFile.Close();
+	if (written && TempFile.Rename(File))
+		model_cache_written = true;
+	else
+		TempFile.Delete();
+}
+
+
 void OGL_ModelData::Load()
 {
 	// Already loaded?
@@ -380,7 +596,29 @@ void OGL_ModelData::Load()
 
 	if (ModelFile == FileSpecifier()) return;
 	if (!ModelFile.Exists()) return;
+	
+	// If this was done before, use the result
+	std::string cache_key;
+	if (!make_model_cache_key(*this, cache_key))
+		cache_key.clear();
+	if (cache_key.empty() || !load_from_model_cache(Model, cache_key))
+	{
+		if (!LoadModel()) return;
+		
+		// These are otherwise found when first animating
+		Model.BuildInverseVSIndices();
+		if (!cache_key.empty())
+			save_to_model_cache(Model, cache_key);
+	}
+	
+	if (BakePoses) Model.BakePoses();
+	
+	// Don't forget the skins
+	OGL_SkinManager::Load();
+}
 
+bool OGL_ModelData::LoadModel()
+{
 	bool Success = false;
 	
 	char *Type = &ModelType[0];
@@ -439,7 +677,7 @@ void OGL_ModelData::Load()
 	if (!Success)
 	{
 		Model.Clear();
-		return;
+		return false;
 	}
 	
 	// Calculate transformation matrix
@@ -575,8 +813,7 @@ void OGL_ModelData::Load()
 	Model.AdjustNormals(NormalType,NormalSplit);
 	Model.CalculateTangents();
 	
-	// Don't forget the skins
-	OGL_SkinManager::Load();
+	return true;
 }
 
 
@@ -613,6 +850,12 @@ void OGL_LoadModels(short Collection)
 		}
 		OGL_ProgressCallback(1);
 	}
+	
+	if (model_cache_written)
+	{
+		OGL_LimitCacheDir(MODEL_CACHE_DIR, MODEL_CACHE_LIMIT);
+		model_cache_written = false;
+	}
 }
 
 void OGL_UnloadModels(short Collection)
@@ -698,6 +941,7 @@ void parse_mml_opengl_model(const InfoTree& root)
 	root.read_indexed("light_type", def.LightType, NUMBER_OF_MODEL_LIGHT_TYPES);
 	read_sign_val(root, "depth_type", def.DepthType);
 	root.read_attr("force_sprite_depth", def.ForceSpriteDepth);
+	root.read_attr("bake_poses", def.BakePoses);
 	root.read_path("file", def.ModelFile);
 	root.read_path("file1", def.ModelFile1);
 	root.read_path("file2", def.ModelFile2);
@@ -112,6 +112,7 @@ public:
 	short DepthType;				// What sort of depth reference to use?
 									// (+: farthest point, -: nearest point, 0: center point)
 	bool  ForceSpriteDepth;			// Force sprites to be depth-sorted between model polys? (shader only)
+	bool  BakePoses;				// Find all the animation frames' positions when loading?
 	
 	// Should a rotation rate be included, in order to get that Quake look?
 	
@@ -125,7 +126,11 @@ public:
 	
 	OGL_ModelData():
 		Scale(1), XRot(0), YRot(0), ZRot(0), XShift(0), YShift(0), ZShift(0), Sidedness(1),
-			NormalType(1), NormalSplit(0.5), LightType(0), DepthType(0), ForceSpriteDepth(false) {}
+			NormalType(1), NormalSplit(0.5), LightType(0), DepthType(0), ForceSpriteDepth(false), BakePoses(false) {}
+	
+private:
+	// Reads the model file(s) and processes the model; false if that failed
+	bool LoadModel();
 };
 
 
@@ -505,6 +505,7 @@ bool OGL_ClearScreen()
 }
 
 void OGL_Rasterizer_Init();
+void OGL_Rasterizer_Stop();
 
 // Start an OpenGL run (creates a rendering context)
 bool OGL_StartRun()
@@ -657,6 +658,7 @@ bool OGL_StopRun()
 {
 	if (!OGL_IsActive() || !_OGL_IsActive) return false;
 	
+	OGL_Rasterizer_Stop();
 	OGL_StopTextures();
 	Shader::unloadAll();
 	
@@ -968,6 +970,9 @@ bool OGL_EndMain()
 	// Render OpenGL faders, if in use
 	OGL_DoFades(0,0,ViewWidth,ViewHeight);
 	
+	// Age the textures, and release some if over budget
+	OGL_FrameTickTextures();
+	
 	return true;
 }
 
@@ -70,10 +70,16 @@ Feb 5, 2002 (Br'fin (Jeremy Parsons)):
 */
 
 #include <vector>
+#include <algorithm>
 #include <string.h>
 #include <math.h>
 #include "cseries.h"
 
+#if defined(HAVE_UNISTD_H) && !defined(__WIN32__)
+#include <utime.h>
+#define HAVE_CACHE_FILE_TOUCH
+#endif
+
 #ifdef HAVE_OPENGL
 
 #include "OGL_Headers.h"
@@ -86,6 +92,7 @@ Feb 5, 2002 (Br'fin (Jeremy Parsons)):
 #include "OGL_LoadScreen.h"
 #include "progress.h"
 #include "InfoTree.h"
+#include "Logging.h"
 
 // Whether or not OpenGL is present and usable
 static bool _OGL_IsPresent = false;
@@ -252,6 +259,7 @@ void OGL_SetDefaults(OGL_ConfigureData& Data)
 
 	Data.GeForceFix = false;
 	Data.WaitForVSync = true;
+	Data.TextureBudget = 0;
 	Data.Use_sRGB = false;
 	Data.Use_NPOT = false;
 }
@@ -267,6 +275,207 @@ inline bool StringPresent(vector<char>& String)
 GLint glMaxTextureSize = 0;
 bool hasS3TC = false;
 
+/*
+	Finished replacement images are kept in the image cache directory, in files
+	named for a hash of everything that went into them: the contents of the
+	source files and the loading options. So a change to either simply misses,
+	and later loads read the images back in one go instead of decoding,
+	shrinking and mipmapping them again.
+	Loading happens on several threads, hence the lock on the statistics.
+	Whenever loading has added to the cache, the least recently used files
+	are deleted until the rest fit in the limit.
+*/
+static const uint32 TEXTURE_CACHE_VERSION = 1;
+static const char TEXTURE_CACHE_DIR[] = "Textures";
+static const Uint64 TEXTURE_CACHE_LIMIT = 300000000;
+
+static int texture_cache_hits = 0;
+static int texture_cache_misses = 0;
+static uint32 texture_load_ticks = 0;
+
+// Made by OGL_LoadModelsImages() before any loading threads start
+static SDL_mutex* texture_cache_mutex = NULL;
+
+static void count_texture_cache_lookup(bool hit)
+{
+	SDL_LockMutex(texture_cache_mutex);
+	if (hit)
+		texture_cache_hits++;
+	else
+		texture_cache_misses++;
+	SDL_UnlockMutex(texture_cache_mutex);
+}
+
+// 64-bit FNV-1a
+Uint64 OGL_CacheHash(const void *data, size_t length)
+{
+	Uint64 hash = (Uint64(0xcbf29ce4) << 32) | 0x84222325;
+	const Uint64 prime = (Uint64(0x100) << 32) | 0x1b3;
+	const uint8 *p = static_cast<const uint8 *>(data);
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= p[i];
+		hash *= prime;
+	}
+	return hash;
+}
+
+bool OGL_AddFileToCacheKey(std::string& key, FileSpecifier& File)
+{
+	if (File == FileSpecifier() || !File.Exists())
+	{
+		key += "-;";
+		return true;
+	}
+	
+	OpenedFile OFile;
+	int32 length;
+	if (!File.Open(OFile) || !OFile.GetLength(length)) return false;
+	
+	std::vector<uint8> contents(length);
+	if (length && !OFile.Read(length, &contents[0])) return false;
+	
+	Uint64 hash = OGL_CacheHash(contents.empty() ? NULL : &contents[0], contents.size());
+	char buffer[64];
+	sprintf(buffer, "%08x%08x:%d;", uint32(hash >> 32), uint32(hash), int(length));
+	key += buffer;
+	return true;
+}
+
+void OGL_TouchCacheFile(FileSpecifier& File)
+{
+#ifdef HAVE_CACHE_FILE_TOUCH
+	utime(File.GetPath(), NULL);
+#endif
+}
+
+static bool least_recently_used_file(const dir_entry& a, const dir_entry& b)
+{
+	return a.date < b.date;
+}
+
+void OGL_LimitCacheDir(const char *Name, Uint64 Limit)
+{
+	FileSpecifier Dir;
+	Dir.SetToImageCacheDir();
+	Dir.AddPart(Name);
+	
+	vector<dir_entry> Entries;
+	if (!Dir.ReadDirectory(Entries)) return;
+	
+	Uint64 Total = 0;
+	for (size_t k = 0; k < Entries.size(); k++)
+	{
+		if (!Entries[k].is_directory)
+			Total += Entries[k].size;
+	}
+	if (Total <= Limit) return;
+	
+	sort(Entries.begin(), Entries.end(), least_recently_used_file);
+	int Deleted = 0;
+	for (size_t k = 0; k < Entries.size() && Total > Limit; k++)
+	{
+		if (Entries[k].is_directory) continue;
+		
+		FileSpecifier File = Dir;
+		File.AddPart(Entries[k].name);
+		if (File.Delete())
+		{
+			Total -= Entries[k].size;
+			Deleted++;
+		}
+	}
+	logNote("deleted %d files from the %s cache to keep it under %d MB", Deleted, Name, int(Limit / 1000000));
+}
+
+static bool make_texture_cache_key(OGL_TextureOptionsBase& options, int flags, int maxTextureSize, std::string& key)
+{
+	char buffer[128];
+	sprintf(buffer, "%u;%x;%d;%dx%d;%d%d;", TEXTURE_CACHE_VERSION, flags, maxTextureSize, options.actual_width, options.actual_height, options.NormalIsPremultiplied, options.GlowIsPremultiplied);
+	key = buffer;
+	return (OGL_AddFileToCacheKey(key, options.NormalColors) &&
+		OGL_AddFileToCacheKey(key, options.NormalMask) &&
+		OGL_AddFileToCacheKey(key, options.GlowColors) &&
+		OGL_AddFileToCacheKey(key, options.GlowMask) &&
+		OGL_AddFileToCacheKey(key, options.OffsetMap));
+}
+
+static FileSpecifier texture_cache_file(const std::string& key)
+{
+	Uint64 hash = OGL_CacheHash(key.data(), key.size());
+	char name[32];
+	sprintf(name, "%08x%08x", uint32(hash >> 32), uint32(hash));
+	
+	FileSpecifier File;
+	File.SetToImageCacheDir();
+	File.AddPart(TEXTURE_CACHE_DIR);
+	File.AddPart(name);
+	return File;
+}
+
+// The file holds the whole key, to rule out hash collisions, then the images
+static bool load_from_texture_cache(OGL_TextureOptionsBase& options, const std::string& key)
+{
+	FileSpecifier File = texture_cache_file(key);
+	if (!File.Exists()) return false;
+	
+	OpenedFile OFile;
+	int32 length;
+	if (!File.Open(OFile) || !OFile.GetLength(length) || length < int32(key.size() + 1)) return false;
+	
+	std::vector<uint8> contents(length);
+	if (!OFile.Read(length, &contents[0])) return false;
+	
+	const uint8 *p = &contents[0];
+	const uint8 *end = p + length;
+	if (memcmp(p, key.c_str(), key.size() + 1) != 0) return false;
+	p += key.size() + 1;
+	
+	if (options.NormalImg.Unpack(p, end) && options.GlowImg.Unpack(p, end) && options.OffsetImg.Unpack(p, end) && options.NormalImg.IsPresent())
+	{
+		OGL_TouchCacheFile(File);
+		return true;
+	}
+	
+	options.Unload();
+	return false;
+}
+
+static void save_to_texture_cache(OGL_TextureOptionsBase& options, const std::string& key)
+{
+	std::vector<uint8> contents(key.c_str(), key.c_str() + key.size() + 1);
+	options.NormalImg.Pack(contents);
+	options.GlowImg.Pack(contents);
+	options.OffsetImg.Pack(contents);
+	
+	FileSpecifier Dir;
+	Dir.SetToImageCacheDir();
+	Dir.AddPart(TEXTURE_CACHE_DIR);
+	if (!Dir.Exists())
+		Dir.CreateDirectory();
+	
+	// Written under another name first, so no other load sees half a file
+	FileSpecifier File = texture_cache_file(key);
+	FileSpecifier TempFile;
+	TempFile.SetTempName(File);
+	
+	OpenedFile OFile;
+	if (!TempFile.Open(OFile, true)) return;
+	bool written = OFile.Write(contents.size(), &contents[0]);
+	OFile.Close();
+	if (!written || !TempFile.Rename(File))
+		TempFile.Delete();
+}
+
+void OGL_LogTextureLoading()
+{
+	if (texture_cache_hits + texture_cache_misses == 0) return;
+	
+	logNote("loaded %d replacement textures in %u ms; %d of them from the texture cache", texture_cache_hits + texture_cache_misses, texture_load_ticks, texture_cache_hits);
+	texture_cache_hits = texture_cache_misses = 0;
+	texture_load_ticks = 0;
+}
+
 void OGL_TextureOptionsBase::Load()
 {
 	FileSpecifier File;
@@ -305,14 +514,25 @@ void OGL_TextureOptionsBase::Load()
 	// Load the normal image if it has a filename specified for it
 	if (NormalColors != FileSpecifier() && NormalColors.Exists())
 	{
-		if (!NormalImg.LoadFromFile(NormalColors,ImageLoader_Colors, flags | (NormalIsPremultiplied ? ImageLoader_ImageIsAlreadyPremultiplied : 0), actual_width, actual_height, maxTextureSize))
-		{
-			// A texture must have a normal colored part
-			return;
-		}
+		// If this was done before, use the result
+		std::string cache_key;
+		if (!make_texture_cache_key(*this, flags, maxTextureSize, cache_key))
+			cache_key.clear();
+		bool cached = !cache_key.empty() && load_from_texture_cache(*this, cache_key);
+		count_texture_cache_lookup(cached);
+		if (cached) return;
+		
+		LoadImages(flags, maxTextureSize);
+		if (NormalImg.IsPresent() && !cache_key.empty())
+			save_to_texture_cache(*this, cache_key);
 	}
-	else
+}
+
+void OGL_TextureOptionsBase::LoadImages(int flags, int maxTextureSize)
+{
+	if (!NormalImg.LoadFromFile(NormalColors,ImageLoader_Colors, flags | (NormalIsPremultiplied ? ImageLoader_ImageIsAlreadyPremultiplied : 0), actual_width, actual_height, maxTextureSize))
 	{
+		// A texture must have a normal colored part
 		return;
 	}
 
@@ -390,6 +610,16 @@ void OGL_TextureOptionsBase::Load()
 		GlowImg.Clear();
 	}
 
+	// Build the mipmaps here rather than have OpenGL do it when the texture is
+	// first placed, so that it happens wherever the image was loaded
+	if (flags & ImageLoader_LoadMipMaps)
+	{
+		NormalImg.MakeMipMaps();
+		if (GlowImg.IsPresent())
+			GlowImg.MakeMipMaps();
+		if (OffsetImg.IsPresent())
+			OffsetImg.MakeMipMaps();
+	}
 }
 
 void OGL_TextureOptionsBase::Unload()
@@ -425,8 +655,16 @@ void OGL_LoadModelsImages(short Collection)
 	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &glMaxTextureSize);
 	hasS3TC = OGL_CheckExtension("GL_ARB_texture_compression") && OGL_CheckExtension("GL_EXT_texture_compression_s3tc");
 	
+	if (!texture_cache_mutex)
+		texture_cache_mutex = SDL_CreateMutex();
+	
 	// For wall/sprite images
+	uint32 ticks = SDL_GetTicks();
+	int misses = texture_cache_misses;
 	OGL_LoadTextures(Collection);
+	texture_load_ticks += SDL_GetTicks() - ticks;
+	if (texture_cache_misses != misses)
+		OGL_LimitCacheDir(TEXTURE_CACHE_DIR, TEXTURE_CACHE_LIMIT);
 	
 	// For models, skins
 	bool UseModels = TEST_FLAG(Get_OGL_ConfigureData().Flags,OGL_Flag_3D_Models) ? true : false;
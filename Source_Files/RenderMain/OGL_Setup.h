@@ -251,6 +251,7 @@ struct OGL_ConfigureData
 
 	bool GeForceFix;
 	bool WaitForVSync;
+	int16 TextureBudget;	// In megabytes; 0 for no limit
   bool Use_sRGB;
 	bool Use_NPOT;
 };
@@ -269,6 +270,19 @@ int OGL_CountModelsImages(short Collection);
 void OGL_LoadModelsImages(short Collection);
 void OGL_UnloadModelsImages(short Collection);
 
+// Logs how long replacement textures took to load, and how many came from the cache
+void OGL_LogTextureLoading();
+
+// For naming files in the image cache directory:
+// a hash of some data, and adding a source file's contents to a cache key
+// (false if the file can't be read)
+Uint64 OGL_CacheHash(const void *data, size_t length);
+bool OGL_AddFileToCacheKey(std::string& key, FileSpecifier& File);
+// Marks a cache file as just used, and deletes the least recently used files
+// in an image cache subdirectory until the rest fit in Limit bytes
+void OGL_TouchCacheFile(FileSpecifier& File);
+void OGL_LimitCacheDir(const char *Name, Uint64 Limit);
+
 // Reset the textures (walls, sprites, and model skins) (good if they start to crap out)
 // Implemented in OGL_Textures.cpp
 void OGL_ResetTextures();
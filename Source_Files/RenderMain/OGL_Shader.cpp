@@ -21,6 +21,7 @@
  */
 #include <algorithm>
 #include <iostream>
+#include <string.h>
 
 #include "OGL_Shader.h"
 #include "FileHandler.h"
@@ -209,6 +210,140 @@ GLhandleARB parseShader(const GLcharARB* str, GLenum shaderType) {
 	}
 }
 
+/*
+ Linked programs are kept in the image cache directory where the driver
+ can hand them back (GL_ARB_get_program_binary), so later starts skip
+ compiling and linking. Binaries are only good for the driver that made
+ them, so the key has the driver strings as well as the source and the
+ definitions added to it; anything that doesn't load is compiled instead.
+ */
+#ifdef GL_ARB_get_program_binary
+#define HAVE_PROGRAM_BINARY_CACHE
+
+static const uint32 PROGRAM_CACHE_VERSION = 1;
+static const char PROGRAM_CACHE_DIR[] = "Shaders";
+// Each driver update leaves a set of binaries behind
+static const Uint64 PROGRAM_CACHE_LIMIT = 16000000;
+
+static bool program_cache_written = false;
+
+// The program's name, for the non-ARB-object functions
+static GLuint program_name(GLhandleARB programObj) {
+	return GLuint(size_t(programObj));
+}
+
+static bool program_binaries_supported() {
+	if (!OGL_CheckExtension("GL_ARB_get_program_binary"))
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static void add_gl_string(std::string& key, GLenum name) {
+	const GLubyte* s = glGetString(name);
+	if (s)
+		key += reinterpret_cast<const char*>(s);
+	key += ";";
+}
+
+static void make_program_cache_key(const std::string& vert, const std::string& frag, std::string& key) {
+	char buffer[64];
+	sprintf(buffer, "%u;%d%d%d;", PROGRAM_CACHE_VERSION, DisableClipVertex(), Wanting_sRGB, Bloom_sRGB);
+	key = buffer;
+	add_gl_string(key, GL_VENDOR);
+	add_gl_string(key, GL_RENDERER);
+	add_gl_string(key, GL_VERSION);
+	key += vert;
+	key += '\0';
+	key += frag;
+}
+
+static FileSpecifier program_cache_file(const std::string& key) {
+	Uint64 hash = OGL_CacheHash(key.data(), key.size());
+	char name[32];
+	sprintf(name, "%08x%08x", uint32(hash >> 32), uint32(hash));
+
+	FileSpecifier File;
+	File.SetToImageCacheDir();
+	File.AddPart(PROGRAM_CACHE_DIR);
+	File.AddPart(name);
+	return File;
+}
+
+// The file holds the key, then the binary format, then the binary
+static bool load_program_binary(GLhandleARB programObj, const std::string& key) {
+	FileSpecifier File = program_cache_file(key);
+	if (!File.Exists())
+		return false;
+
+	OpenedFile OFile;
+	int32 length;
+	int32 header = key.size() + sizeof(GLenum);
+	if (!File.Open(OFile) || !OFile.GetLength(length) || length <= header)
+		return false;
+
+	std::vector<uint8> contents(length);
+	if (!OFile.Read(length, &contents[0]))
+		return false;
+	if (memcmp(&contents[0], key.data(), key.size()) != 0)
+		return false;
+
+	GLenum format;
+	memcpy(&format, &contents[key.size()], sizeof(format));
+	glProgramBinary(program_name(programObj), format, &contents[header], length - header);
+
+	// Driver updates can make old binaries unusable
+	GLint status = 0;
+	glGetObjectParameterivARB(programObj, GL_OBJECT_LINK_STATUS_ARB, &status);
+	if (!status)
+		return false;
+	OGL_TouchCacheFile(File);
+	return true;
+}
+
+static void save_program_binary(GLhandleARB programObj, const std::string& key) {
+	GLuint program = program_name(programObj);
+	GLint status = 0;
+	glGetObjectParameterivARB(programObj, GL_OBJECT_LINK_STATUS_ARB, &status);
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!status || length <= 0)
+		return;
+
+	std::vector<uint8> contents(key.begin(), key.end());
+	size_t header = contents.size() + sizeof(GLenum);
+	contents.resize(header + length);
+	GLenum format;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, &contents[header]);
+	if (written <= 0)
+		return;
+	memcpy(&contents[key.size()], &format, sizeof(format));
+	contents.resize(header + written);
+
+	FileSpecifier Dir;
+	Dir.SetToImageCacheDir();
+	Dir.AddPart(PROGRAM_CACHE_DIR);
+	if (!Dir.Exists())
+		Dir.CreateDirectory();
+
+	FileSpecifier File = program_cache_file(key);
+	FileSpecifier TempFile;
+	TempFile.SetTempName(File);
+
+	OpenedFile OFile;
+	if (!TempFile.Open(OFile, true))
+		return;
+	bool ok = OFile.Write(contents.size(), &contents[0]);
+	OFile.Close();
+	if (ok && TempFile.Rename(File))
+		program_cache_written = true;
+	else
+		TempFile.Delete();
+}
+#endif
+
 void Shader::loadAll() {
 	initDefaultPrograms();
 	if (!_shaders.size()) 
@@ -226,6 +361,16 @@ void Shader::unloadAll() {
 	{
 		_shaders[i].unload();
 	}
+
+#ifdef HAVE_PROGRAM_BINARY_CACHE
+	// Programs are linked on first use, so this is when a run's
+	// binaries have all been written
+	if (program_cache_written)
+	{
+		OGL_LimitCacheDir(PROGRAM_CACHE_DIR, PROGRAM_CACHE_LIMIT);
+		program_cache_written = false;
+	}
+#endif
 }
 
 Shader::Shader(const std::string& name) : _programObj(0), _passes(-1), _loaded(false) {
@@ -262,22 +407,46 @@ void Shader::init() {
 	_loaded = true;
 
 	_programObj = glCreateProgramObjectARB();
+	assert(_programObj);
+
+	bool linked = false;
+#ifdef HAVE_PROGRAM_BINARY_CACHE
+	std::string cache_key;
+	if (program_binaries_supported()) {
+		make_program_cache_key(_vert, _frag, cache_key);
+		linked = load_program_binary(_programObj, cache_key);
+	}
+#endif
 
-	assert(!_vert.empty());
-	GLhandleARB vertexShader = parseShader(_vert.c_str(), GL_VERTEX_SHADER_ARB);
-	assert(vertexShader);
-	glAttachObjectARB(_programObj, vertexShader);
-	glDeleteObjectARB(vertexShader);
-
-	assert(!_frag.empty());
-	GLhandleARB fragmentShader = parseShader(_frag.c_str(), GL_FRAGMENT_SHADER_ARB);
-	assert(fragmentShader);
-	glAttachObjectARB(_programObj, fragmentShader);
-	glDeleteObjectARB(fragmentShader);
+	if (!linked) {
+		assert(!_vert.empty());
+		GLhandleARB vertexShader = parseShader(_vert.c_str(), GL_VERTEX_SHADER_ARB);
+		assert(vertexShader);
+		glAttachObjectARB(_programObj, vertexShader);
+		glDeleteObjectARB(vertexShader);
+
+		assert(!_frag.empty());
+		GLhandleARB fragmentShader = parseShader(_frag.c_str(), GL_FRAGMENT_SHADER_ARB);
+		assert(fragmentShader);
+		glAttachObjectARB(_programObj, fragmentShader);
+		glDeleteObjectARB(fragmentShader);
+
+#ifdef HAVE_PROGRAM_BINARY_CACHE
+		if (!cache_key.empty())
+			glProgramParameteri(program_name(_programObj), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 	
-	glLinkProgramARB(_programObj);
+		glLinkProgramARB(_programObj);
 
-	assert(_programObj);
+#ifdef HAVE_PROGRAM_BINARY_CACHE
+		if (!cache_key.empty())
+			save_program_binary(_programObj, cache_key);
+#endif
+	}
+
+	// Look up every uniform now, so drawing never has to
+	for (int i = 0; i < NUMBER_OF_UNIFORM_LOCATIONS; ++i)
+		_uniform_locations[i] = glGetUniformLocationARB(_programObj, _uniform_names[i]);
 
 	glUseProgramObjectARB(_programObj);
 
@@ -96,12 +96,8 @@ private:
 	GLint _uniform_locations[NUMBER_OF_UNIFORM_LOCATIONS];
 	float _cached_floats[NUMBER_OF_UNIFORM_LOCATIONS];
 
-	GLint getUniformLocation(UniformName name) { 
-		if (_uniform_locations[name] == -1) {
-			_uniform_locations[name] = glGetUniformLocationARB(_programObj, _uniform_names[name]);
-		}
-		return _uniform_locations[name];
-	}
+	// found when the program is linked
+	GLint getUniformLocation(UniformName name) { return _uniform_locations[name]; }
 	
 public:
 
@@ -32,7 +32,9 @@
 
 #include <set>
 #include <string>
+#include <vector>
 #include <boost/unordered_map.hpp>
+#include <SDL_thread.h>
 
 #ifdef HAVE_OPENGL
 
@@ -63,15 +65,96 @@ int OGL_CountTextures(short Collection)
 
 extern void OGL_ProgressCallback(int);
 
-void OGL_LoadTextures(short Collection)
+// Replacement images are read, decoded and mipmapped by several threads at once;
+// none of that touches OpenGL, which only sees them when they are first placed
+const int MAXIMUM_TEXTURE_LOAD_THREADS = 8;
+
+struct texture_load_jobs
+{
+	std::vector<OGL_TextureOptions *> options;
+	size_t next;
+	size_t done;
+	SDL_mutex *lock;
+};
+
+// Counts the job just finished, if any, and hands out another one (NULL if none left)
+static OGL_TextureOptions *next_texture_load_job(texture_load_jobs& jobs, bool finished_one)
 {
+	SDL_LockMutex(jobs.lock);
+	if (finished_one) jobs.done++;
+	OGL_TextureOptions *options = (jobs.next < jobs.options.size()) ? jobs.options[jobs.next++] : NULL;
+	SDL_UnlockMutex(jobs.lock);
+	return options;
+}
 
+static int texture_load_thread(void *data)
+{
+	texture_load_jobs& jobs = *static_cast<texture_load_jobs *>(data);
+	bool finished_one = false;
+	while (OGL_TextureOptions *options = next_texture_load_job(jobs, finished_one))
+	{
+		options->Load();
+		finished_one = true;
+	}
+	return 0;
+}
+
+void OGL_LoadTextures(short Collection)
+{
+	texture_load_jobs jobs;
 	for (TOHash::iterator it = Collections[Collection].begin(); it != Collections[Collection].end(); ++it)
 	{
-		it->second.Load();
-		OGL_ProgressCallback(1);
+		jobs.options.push_back(&it->second);
+	}
+	jobs.next = jobs.done = 0;
+	jobs.lock = (jobs.options.size() > 1) ? SDL_CreateMutex() : NULL;
+	
+	if (!jobs.lock)
+	{
+		for (size_t i = 0; i < jobs.options.size(); i++)
+		{
+			jobs.options[i]->Load();
+			OGL_ProgressCallback(1);
+		}
+		return;
+	}
+	
+	int thread_count = MIN(get_processor_count(), MAXIMUM_TEXTURE_LOAD_THREADS) - 1;
+	thread_count = MIN(thread_count, int(jobs.options.size()) - 1);
+	std::vector<SDL_Thread *> threads;
+	for (int i = 0; i < thread_count; i++)
+	{
+		SDL_Thread *thread = SDL_CreateThread(texture_load_thread, &jobs);
+		if (!thread)
+		{
+			logWarning("couldn't start a texture loading thread (%s)", SDL_GetError());
+			break;
+		}
+		threads.push_back(thread);
+	}
+	
+	// This thread takes its share of the jobs too, and keeps the progress
+	// display up to date with everyone's
+	int reported = 0;
+	bool finished_one = false;
+	while (OGL_TextureOptions *options = next_texture_load_job(jobs, finished_one))
+	{
+		options->Load();
+		finished_one = true;
 		
+		SDL_LockMutex(jobs.lock);
+		int done = jobs.done;
+		SDL_UnlockMutex(jobs.lock);
+		OGL_ProgressCallback(done - reported);
+		reported = done;
+	}
+	
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		SDL_WaitThread(threads[i], NULL);
 	}
+	SDL_DestroyMutex(jobs.lock);
+	OGL_ProgressCallback(int(jobs.options.size()) - reported);
 }
 
 
@@ -148,6 +148,12 @@ struct OGL_TextureOptionsBase
 
 	virtual int GetMaxSize();
 	
+private:
+	// Does the decoding, for Load() to cache
+	void LoadImages(int flags, int maxTextureSize);
+
+public:
+	
 	OGL_TextureOptionsBase():
 	OpacityType(OGL_OpacType_Crisp), OpacityScale(1), OpacityShift(0),
 		NormalBlend(OGL_BlendType_Crossfade), GlowBlend(OGL_BlendType_Crossfade), Substitution(false), NormalIsPremultiplied(false), GlowIsPremultiplied(false), actual_height(0), actual_width(0), Type(-1), BloomScale(0), BloomShift(0), GlowBloomScale(1), GlowBloomShift(0), LandscapeBloom(0.5), MinGlowIntensity(1)
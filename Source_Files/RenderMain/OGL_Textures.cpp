@@ -80,6 +80,9 @@ May 3, 2003 (Br'fin (Jeremy Parsons))
 #include <stdarg.h>
 #include <math.h>
 #include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #include "cseries.h"
 
@@ -100,6 +103,8 @@ May 3, 2003 (Br'fin (Jeremy Parsons))
 #include "OGL_Render.h"
 #include "OGL_Textures.h"
 #include "screen.h"
+#include "shell.h"
+#include "Console.h"
 
 OGL_TexturesStats gGLTxStats = {0,0,0,500000,0,0, 0};
 
@@ -169,6 +174,93 @@ static bool InfravisionActive = false;
 
 static list<TextureState*> sgActiveTextureStates;
 
+/*
+	Sprites made from the shapes file are padded out to powers of two,
+	with a transparent border; frames of the same size in one collection and
+	color table share a texture, each in its own cell of an atlas page,
+	with their texture-coordinate scales and offsets remapped into the cell.
+	A page only has cells of one size, so each cell gets its own mipmaps
+	down to where it's one pixel thin. A page's memory is counted as a whole,
+	from when its texture is created until it's deleted with its last cell.
+*/
+struct SpriteAtlasPage
+{
+	GLuint ID;					// Zero until the first cell is loaded
+	short Collection, CTable;
+	GLenum Format;
+	short Width, Height;
+	short CellWidth, CellHeight;
+	short Levels;
+	int32 Bytes;				// All its mipmap levels
+	vector<bool> CellUsed;
+	int CellsUsed;
+};
+
+// How many cells across and down a page has, at most
+const int SPRITE_ATLAS_CELLS_ACROSS = 8;
+
+static list<SpriteAtlasPage> sgSpriteAtlasPages;
+
+static void FreeSpriteAtlasCell(SpriteAtlasPage *Page, int Cell)
+{
+	Page->CellUsed[Cell] = false;
+	if (--Page->CellsUsed > 0) return;
+	
+	if (Page->ID)
+	{
+		glDeleteTextures(1, &Page->ID);
+		gGLTxStats.residentBytes -= Page->Bytes;
+	}
+	for (list<SpriteAtlasPage>::iterator i = sgSpriteAtlasPages.begin(); i != sgSpriteAtlasPages.end(); ++i)
+	{
+		if (&*i == Page)
+		{
+			sgSpriteAtlasPages.erase(i);
+			break;
+		}
+	}
+}
+
+// Creates and binds a page's texture
+static void AllocateSpriteAtlasPage(SpriteAtlasPage& Page, GLenum NearFilter, GLenum FarFilter)
+{
+	glGenTextures(1, &Page.ID);
+	glBindTexture(GL_TEXTURE_2D, Page.ID);
+	for (int i = 0; i < Page.Levels; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, Page.Format, Page.Width >> i, Page.Height >> i, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	gGLTxStats.residentBytes += Page.Bytes;
+	
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, Page.Levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, NearFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (Page.Levels > 1) ? FarFilter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+}
+
+// Box-filters an RGBA 8888 image down to the next mipmap level
+static void HalveSpriteImage(vector<uint32>& Pixels, int Width, int Height)
+{
+	int HalfWidth = MAX(Width >> 1, 1);
+	int HalfHeight = MAX(Height >> 1, 1);
+	int Across = (Width > 1) ? 1 : 0;
+	int Down = (Height > 1) ? Width : 0;
+	
+	vector<uint32> Half(HalfWidth * HalfHeight);
+	for (int y = 0; y < HalfHeight; y++)
+		for (int x = 0; x < HalfWidth; x++)
+		{
+			int k = (2*y)*Width + 2*x;
+			uint8 *p0 = (uint8 *)&Pixels[k];
+			uint8 *p1 = (uint8 *)&Pixels[k + Across];
+			uint8 *p2 = (uint8 *)&Pixels[k + Down];
+			uint8 *p3 = (uint8 *)&Pixels[k + Across + Down];
+			uint8 *q = (uint8 *)&Half[y*HalfWidth + x];
+			for (int c = 0; c < 4; c++)
+				q[c] = (p0[c] + p1[c] + p2[c] + p3[c] + 2) >> 2;
+		}
+	Pixels.swap(Half);
+}
+
 
 // Allocate some textures and indicate whether an allocation had happened.
 bool TextureState::Allocate(short txType)
@@ -189,7 +281,18 @@ bool TextureState::Allocate(short txType)
 // Use a texture and indicate whether to load it
 bool TextureState::Use(int Which)
 {
-	glBindTexture(GL_TEXTURE_2D,IDs[Which]);
+	if (Which == Normal && AtlasPage)
+	{
+		if (AtlasPage->ID)
+			glBindTexture(GL_TEXTURE_2D,AtlasPage->ID);
+		else
+		{
+			TxtrTypeInfoData& TxtrTypeInfo = TxtrTypeInfoList[TextureType];
+			AllocateSpriteAtlasPage(*AtlasPage, TxtrTypeInfo.NearFilter, TxtrTypeInfo.FarFilter);
+		}
+	}
+	else
+		glBindTexture(GL_TEXTURE_2D,IDs[Which]);
 	bool result = !TexGened[Which];
 	TexGened[Which] = true;
 	IDUsage[Which]++;
@@ -206,6 +309,13 @@ void TextureState::Reset()
 		gGLTxStats.inUse--;
 		glDeleteTextures(NUMBER_OF_TEXTURES,IDs);
 	}
+	if (AtlasPage)
+	{
+		FreeSpriteAtlasCell(AtlasPage, AtlasCell);
+		AtlasPage = NULL;
+	}
+	gGLTxStats.residentBytes -= Bytes;
+	Bytes = 0;
 	IsUsed = IsGlowing = IsBumped = TexGened[Normal] = TexGened[Glowing] = TexGened[Bump] = false;
 	IDUsage[Normal] = IDUsage[Glowing] = IDUsage[Bump] = unusedFrames = 0;
 }
@@ -221,25 +331,40 @@ void TextureState::FrameTick() {
 		if (IDUsage[i] != 0) used = true;
 	
 	if (used) {
-		IDUsage[Normal] = IDUsage[Glowing] = unusedFrames = 0;
+		IDUsage[Normal] = IDUsage[Glowing] = IDUsage[Bump] = unusedFrames = 0;
 		
 	} else {
+		// Released by OGL_FrameTickTextures() if need be
 		unusedFrames++;
-		assert(TextureType != NONE);
-		switch (TextureType) {
-		case OGL_Txtr_Wall:
-				if (unusedFrames > 300) Reset(); // at least 10 seconds till wall textures are released
-				break;
-		case OGL_Txtr_Landscape:
-				// never release landscapes
-				break;
-		case OGL_Txtr_Inhabitant:
-				if (unusedFrames > 450) Reset(); // release unused sprites in 15 seconds
-				break;
-		case OGL_Txtr_WeaponsInHand:
-				if (unusedFrames > 600) Reset(); // release weapons in hand in 20 seconds
-				break;
-		}
+	}
+}
+
+// Counts a texture placed for a texture state
+static void CountTextureUpload(TextureState& State, int32 Bytes)
+{
+	State.Bytes += Bytes;
+	gGLTxStats.residentBytes += Bytes;
+	gGLTxStats.uploadBytes += Bytes;
+}
+
+struct print_texture_stats
+{
+	void operator() (const std::string&) const {
+		screen_printf("%d textures, %.1f MB; %d KB placed last frame; %d released", gGLTxStats.inUse, gGLTxStats.residentBytes / 1048576.0, gGLTxStats.lastFrameUploadBytes / 1024, gGLTxStats.evictions);
+	}
+};
+
+// How much memory a texel of an uncompressed texture likely takes up
+static int TexelBytes(GLenum InternalFormat)
+{
+	switch (InternalFormat)
+	{
+	case GL_RGBA4:
+	case GL_RGB5:
+	case GL_RGB5_A1:
+		return 2;
+	default:
+		return 4;
 	}
 }
 
@@ -369,6 +494,8 @@ void OGL_StartTextures()
 #if defined GL_ARB_texture_mirrored_repeat
 	useMirroredRepeat = OGL_CheckExtension("GL_ARB_texture_mirrored_repeat");
 #endif
+
+	Console::instance()->register_command("textures", print_texture_stats());
 }
 
 
@@ -389,6 +516,13 @@ void OGL_StopTextures()
     
     // clear leftover infravision
     InfravisionActive = false;
+
+	Console::instance()->unregister_command("textures");
+}
+
+static bool LeastRecentlyUsed(const TextureState *a, const TextureState *b)
+{
+	return a->unusedFrames > b->unusedFrames;
 }
 
 void OGL_FrameTickTextures()
@@ -398,6 +532,35 @@ void OGL_FrameTickTextures()
 	for (i=sgActiveTextureStates.begin() ; i!= sgActiveTextureStates.end() ; i++) {
 		(*i)->FrameTick();
 	}
+	
+	gGLTxStats.lastFrameUploadBytes = gGLTxStats.uploadBytes;
+	gGLTxStats.uploadBytes = 0;
+	
+	// When over the budget, release the textures that have gone unused the longest;
+	// never those used in the last frame, nor landscapes, which are seldom many
+	Uint64 Budget = Uint64(Get_OGL_ConfigureData().TextureBudget) << 20;
+	if (!Budget || gGLTxStats.residentBytes <= Budget) return;
+	
+	vector<TextureState*> Unused;
+	map<SpriteAtlasPage*, int> UnusedCells;
+	for (i=sgActiveTextureStates.begin() ; i!= sgActiveTextureStates.end() ; i++) {
+		if ((*i)->unusedFrames > 0 && (*i)->TextureType != OGL_Txtr_Landscape)
+		{
+			Unused.push_back(*i);
+			if ((*i)->AtlasPage) UnusedCells[(*i)->AtlasPage]++;
+		}
+	}
+	sort(Unused.begin(), Unused.end(), LeastRecentlyUsed);
+	
+	for (size_t k = 0; k < Unused.size() && gGLTxStats.residentBytes > Budget; k++) {
+		// A sprite in an atlas page gives nothing back until the whole page goes,
+		// so only release those on pages that are entirely unused
+		SpriteAtlasPage *Page = Unused[k]->AtlasPage;
+		if (Page && UnusedCells[Page] < Page->CellsUsed) continue;
+		
+		Unused[k]->Reset();
+		gGLTxStats.evictions++;
+	}
 }
 
 // Find an OpenGL-friendly color table from a Marathon shading table
@@ -585,6 +748,24 @@ bool TextureManager::Setup()
 			}			
 		}
 		
+		// Remap the sprite into its atlas cell
+		if (!substitute && (CTState.AtlasPage || FindAtlasCell()))
+		{
+			SpriteAtlasPage& Page = *CTState.AtlasPage;
+			int Columns = Page.Width / Page.CellWidth;
+			double UCell = double(Page.CellWidth) / Page.Width;
+			double VCell = double(Page.CellHeight) / Page.Height;
+			U_Offset = (CTState.AtlasCell % Columns + U_Offset) * UCell;
+			U_Scale *= UCell;
+			V_Offset = (CTState.AtlasCell / Columns + V_Offset) * VCell;
+			V_Scale *= VCell;
+			
+			CTState.U_Scale = U_Scale;
+			CTState.V_Scale = V_Scale;
+			CTState.U_Offset = U_Offset;
+			CTState.V_Offset = V_Offset;
+		}
+		
 		// Kludge for making top and bottom look flat
 		/*
 		if (TextureType == OGL_Txtr_Landscape)
@@ -1205,13 +1386,10 @@ uint32 *TextureManager::Shrink(uint32 *Buffer)
 }
 
 
-// This places a texture into the OpenGL software and gives it the right
-// mapping attributes
-void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
+// The internal format a texture of this type gets, and whether it's being
+// loaded as sRGB
+GLenum TextureManager::GetInternalFormat(bool normal_map, bool& load_as_sRGB)
 {
-
-	bool mipmapsLoaded = false;
-
 	TxtrTypeInfoData& TxtrTypeInfo = TxtrTypeInfoList[TextureType];
 
 	GLenum internalFormat = TxtrTypeInfo.ColorFormat;
@@ -1228,7 +1406,7 @@ void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
 		internalFormat = GL_RGB5_A1;
 	}
 
-	bool load_as_sRGB = (Wanting_sRGB && !normal_map &&
+	load_as_sRGB = (Wanting_sRGB && !normal_map &&
 						 Collection != _collection_interface &&
 						 Collection != _collection_weapons_in_hand);
 	
@@ -1272,6 +1450,21 @@ void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
 	  }
 	}
 
+	return internalFormat;
+}
+
+// This places a texture into the OpenGL software and gives it the right
+// mapping attributes
+void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
+{
+
+	bool mipmapsLoaded = false;
+
+	TxtrTypeInfoData& TxtrTypeInfo = TxtrTypeInfoList[TextureType];
+
+	bool load_as_sRGB;
+	GLenum internalFormat = GetInternalFormat(normal_map, load_as_sRGB);
+
 	if (Image->GetFormat() == ImageDescriptor::RGBA8) {
 		switch (TxtrTypeInfo.FarFilter)
 		{
@@ -1419,6 +1612,116 @@ void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 		break;
 	}
+
+	// Keep count of roughly how much memory this took
+	int32 Bytes = (Image->GetFormat() == ImageDescriptor::RGBA8) ?
+		Image->GetWidth() * Image->GetHeight() * TexelBytes(internalFormat) :
+		Image->GetMipMapSize(0);
+	if (mipmapsLoaded) Bytes += Bytes / 3;
+	CountTextureUpload(*TxtrStatePtr, Bytes);
+}
+
+// Finds a free cell for this sprite in an atlas page with others of its size,
+// starting a new page if need be
+bool TextureManager::FindAtlasCell()
+{
+	if (TextureType != OGL_Txtr_Inhabitant || npotTextures || IsGlowing) return false;
+	
+	const ImageDescriptor *Image = NormalImage.get();
+	if (!Image || Image->GetFormat() != ImageDescriptor::RGBA8 || Image->GetMipMapCount() > 1) return false;
+	
+	bool load_as_sRGB;
+	GLenum Format = GetInternalFormat(false, load_as_sRGB);
+	short CellWidth = Image->GetWidth();
+	short CellHeight = Image->GetHeight();
+	
+	SpriteAtlasPage *Page = NULL;
+	for (list<SpriteAtlasPage>::iterator i = sgSpriteAtlasPages.begin(); i != sgSpriteAtlasPages.end(); ++i)
+	{
+		if (i->Collection == Collection && i->CTable == CTable && i->Format == Format &&
+			i->CellWidth == CellWidth && i->CellHeight == CellHeight &&
+			i->CellsUsed < int(i->CellUsed.size()))
+		{
+			Page = &*i;
+			break;
+		}
+	}
+	
+	if (!Page)
+	{
+		GLint MaxTextureSize;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE,&MaxTextureSize);
+		int Width = MIN(CellWidth*SPRITE_ATLAS_CELLS_ACROSS, int(MaxTextureSize));
+		int Height = MIN(CellHeight*SPRITE_ATLAS_CELLS_ACROSS, int(MaxTextureSize));
+		int Cells = (Width/CellWidth)*(Height/CellHeight);
+		
+		// Not worth sharing
+		if (Cells < 2) return false;
+		
+		SpriteAtlasPage NewPage;
+		NewPage.ID = 0;
+		NewPage.Collection = Collection;
+		NewPage.CTable = CTable;
+		NewPage.Format = Format;
+		NewPage.Width = Width;
+		NewPage.Height = Height;
+		NewPage.CellWidth = CellWidth;
+		NewPage.CellHeight = CellHeight;
+		NewPage.Levels = 1;
+		switch (TxtrTypeInfoList[TextureType].FarFilter)
+		{
+		case GL_NEAREST_MIPMAP_NEAREST:
+		case GL_LINEAR_MIPMAP_NEAREST:
+		case GL_NEAREST_MIPMAP_LINEAR:
+		case GL_LINEAR_MIPMAP_LINEAR:
+			while ((MIN(CellWidth, CellHeight) >> NewPage.Levels) > 0)
+				NewPage.Levels++;
+			break;
+		}
+		NewPage.Bytes = 0;
+		for (int i = 0; i < NewPage.Levels; i++)
+			NewPage.Bytes += MAX(Width >> i, 1) * MAX(Height >> i, 1) * TexelBytes(Format);
+		NewPage.CellUsed.resize(Cells, false);
+		NewPage.CellsUsed = 0;
+		
+		sgSpriteAtlasPages.push_front(NewPage);
+		Page = &sgSpriteAtlasPages.front();
+	}
+	
+	int Cell = 0;
+	while (Page->CellUsed[Cell]) Cell++;
+	Page->CellUsed[Cell] = true;
+	Page->CellsUsed++;
+	
+	TxtrStatePtr->AtlasPage = Page;
+	TxtrStatePtr->AtlasCell = Cell;
+	return true;
+}
+
+// Loads a sprite into its atlas cell, with its own mipmaps
+void TextureManager::PlaceAtlasCell(const ImageDescriptor *Image)
+{
+	SpriteAtlasPage& Page = *TxtrStatePtr->AtlasPage;
+	int Columns = Page.Width / Page.CellWidth;
+	int x = (TxtrStatePtr->AtlasCell % Columns) * Page.CellWidth;
+	int y = (TxtrStatePtr->AtlasCell / Columns) * Page.CellHeight;
+	int Width = Page.CellWidth;
+	int Height = Page.CellHeight;
+	
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, Image->GetBuffer());
+	// Resident memory is the page's, counted once when it was created
+	int32 Bytes = Width * Height * TexelBytes(Page.Format);
+	gGLTxStats.uploadBytes += (Page.Levels > 1) ? Bytes + Bytes / 3 : Bytes;
+	if (Page.Levels < 2) return;
+	
+	vector<uint32> Pixels(Image->GetBuffer(), Image->GetBuffer() + Width*Height);
+	for (int i = 1; i < Page.Levels; i++)
+	{
+		HalveSpriteImage(Pixels, Width, Height);
+		Width = MAX(Width >> 1, 1);
+		Height = MAX(Height >> 1, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, i, x >> i, y >> i, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, &Pixels[0]);
+	}
 }
 
 // What to render:
@@ -1434,7 +1737,10 @@ void TextureManager::RenderNormal()
 	{
 		assert(NormalBuffer || (NormalImage.get() && NormalImage.get()->IsPresent()));
 		if (NormalImage.get() && NormalImage.get()->IsPresent()) {
-			PlaceTexture(NormalImage.get());
+			if (TxtrStatePtr->AtlasPage)
+				PlaceAtlasCell(NormalImage.get());
+			else
+				PlaceTexture(NormalImage.get());
 		}
 	}
 	
@@ -43,6 +43,9 @@ void OGL_StopTextures();
 // Call this after every frame for housekeeping stuff
 void OGL_FrameTickTextures();
 
+// A texture shared by same-sized sprites; see OGL_Textures.cpp
+struct SpriteAtlasPage;
+
 // State of an individual texture set:
 struct TextureState
 {
@@ -61,14 +64,19 @@ struct TextureState
 	bool TexGened[NUMBER_OF_TEXTURES];	// Which ID's have had their textures generated?
 	int IDUsage[NUMBER_OF_TEXTURES];	// Which ID's are being used?  Reset every frame.
 	int unusedFrames;					// How many frames have passed since we were last used.
+	int32 Bytes;						// Roughly how much texture memory the ID's take up
 	short TextureType;
+
+	// If the normal texture is a cell of a sprite atlas page rather than its own texture
+	SpriteAtlasPage *AtlasPage;
+	int AtlasCell;
     
     GLdouble U_Scale;
     GLdouble V_Scale;
     GLdouble U_Offset;
     GLdouble V_Offset;
 	
-	TextureState() {IsUsed = false; Reset(); TextureType = NONE; U_Scale = V_Scale = 1; U_Offset = V_Offset = 0;}
+	TextureState() {IsUsed = false; AtlasPage = NULL; Bytes = 0; Reset(); TextureType = NONE; U_Scale = V_Scale = 1; U_Offset = V_Offset = 0;}
 	~TextureState() {Reset();}
 	
 	// Allocate some textures and indicate whether an allocation had happened.
@@ -187,9 +195,17 @@ class TextureManager
 	// This is for shrinking a texture
 	uint32 *Shrink(uint32 *Buffer);
 	
+	// The OpenGL internal format for a texture;
+	// also whether it's to be loaded as sRGB
+	GLenum GetInternalFormat(bool normal_map, bool& load_as_sRGB);
+
 	// This is for placing a texture in OpenGL
 	void PlaceTexture(const ImageDescriptor *, bool normal_map = false);
 
+	// These are for sharing a texture among same-sized sprites
+	bool FindAtlasCell();
+	void PlaceAtlasCell(const ImageDescriptor *);
+
 public:
 
 	// Inputs: get off of texture object passed to scottish_textures.
@@ -351,6 +367,13 @@ struct OGL_TexturesStats {
 	int binds, totalBind, minBind, maxBind;
 	int longNormalSetups, longGlowSetups, longBumpSetups;
 	int totalAge;
+	
+	// Estimated from the sizes and formats of the textures placed
+	Uint64 residentBytes;
+	int32 uploadBytes, lastFrameUploadBytes;
+	
+	// Textures released to keep under the texture budget
+	int evictions;
 };
 
 extern OGL_TexturesStats gGLTxStats;
@@ -27,6 +27,15 @@
 
 #include "Rasterizer.h"
 
+#include <vector>
+
+// Scratch space for rasterizing one polygon; every strip has its own
+struct sw_scratch_tables
+{
+	short *table0, *table1;
+	void *precalculation;
+};
+
 
 class Rasterizer_SW_Class: public RasterizerClass
 {
@@ -41,6 +50,18 @@ public:
 	// be sure to call it before doing any rendering
 	void SetView(view_data& View) {view = &View;}
 	
+	// The polygons and rectangles are recorded between Begin() and End(); End()
+	// then skips the sprites nearer ones hide, splits the screen into vertical
+	// strips and rasterizes every strip on its own thread, if there's more than one.
+	// The result is the same, pixel for pixel, as rasterizing them in order.
+	void Begin();
+	void End();
+	
+	// A deferred view is always recorded, and End() leaves it for Rasterize(),
+	// which may be called on another thread while the world moves on
+	bool deferred;
+	void Rasterize();
+	
 	// Rendering calls
 	// These are defined in scottish_textures.c (too great a name to change)
 	
@@ -49,6 +70,47 @@ public:
 	void texture_vertical_polygon(polygon_definition& textured_polygon);
 	
 	void texture_rectangle(rectangle_definition& textured_rectangle);
+
+	// Rasterizes recorded commands [first, last), clipped to the columns [left, right)
+	void draw_strip(size_t first, size_t last, sw_scratch_tables& scratch, short left, short right);
+
+	// How many sprites have been skipped because others drawn over them hid them
+	uint32 occluded_rectangles;
+
+	Rasterizer_SW_Class() : deferred(false), occluded_rectangles(0), recording(false) {}
+
+private:
+	void draw_horizontal_polygon(polygon_definition& textured_polygon, sw_scratch_tables& scratch, short left, short right);
+	void draw_vertical_polygon(polygon_definition& textured_polygon, sw_scratch_tables& scratch, short left, short right);
+	void draw_rectangle(rectangle_definition& textured_rectangle, sw_scratch_tables& scratch, short left, short right);
+	void record_polygon(int16 type, polygon_definition& textured_polygon);
+	void draw_strips(size_t first, size_t last);
+	void cull_occluded_rectangles();
+	void cover_columns(const rectangle_definition& rectangle, short left, short right, short top, short bottom);
+
+	enum {
+		_horizontal_polygon_command,
+		_vertical_polygon_command,
+		_rectangle_command
+	};
+
+	struct command
+	{
+		int16 type;
+		int16 left, right;	// columns it can touch
+		bool serial;		// draws static, which can't be split into strips
+		bool culled;		// hidden by what's drawn after it
+		size_t index;		// into polygons or rectangles
+	};
+
+	bool recording;
+	view_data deferred_view;	// the view may change before a deferred one is rasterized
+	std::vector<command> commands;
+	std::vector<polygon_definition> polygons;
+	std::vector<rectangle_definition> rectangles;
+
+	// the rows [top, bottom) of each column that sprites drawn later cover completely
+	std::vector<short> covered_top, covered_bottom;
 };
 
 
@@ -192,7 +192,7 @@ void RenderRasterizerClass::render_node(
 			if (ceiling_surface.height>view->origin.z)
 			{
 				// LP change: indicated that the void is on other side
-				render_node_floor_or_ceiling(window, polygon, &ceiling_surface, true, true, renderStep);
+				render_node_floor_or_ceiling(window, polygon, &ceiling_surface, true, true, false, renderStep);
 			}
 			
 			/* render visible sides */
@@ -207,9 +207,10 @@ void RenderRasterizerClass::render_node(
 					vertical_surface_data surface;
 					
 					surface.length= line->length;
-					store_endpoint(get_endpoint_data(polygon->endpoint_indexes[i]), surface.p0);
-					store_endpoint(get_endpoint_data(polygon->endpoint_indexes[WRAP_HIGH(i, polygon->vertex_count-1)]), surface.p1);
+					store_endpoint(polygon->endpoint_indexes[i], surface.p0);
+					store_endpoint(polygon->endpoint_indexes[WRAP_HIGH(i, polygon->vertex_count-1)], surface.p1);
 					surface.ambient_delta= side->ambient_delta;
+					surface.side_index= side_index;
 					
 					// LP change: indicate in all cases whether the void is on the other side;
 					// added a workaround for full-side textures with a polygon on the other side
@@ -282,7 +283,7 @@ void RenderRasterizerClass::render_node(
 			if (floor_surface.height<view->origin.z)
 			{
 				// LP change: indicated that the void is on other side
-				render_node_floor_or_ceiling(window, polygon, &floor_surface, true, false, renderStep);
+				render_node_floor_or_ceiling(window, polygon, &floor_surface, true, false, false, renderStep);
 			}
 		}
 	}
@@ -320,7 +321,7 @@ void RenderRasterizerClass::render_node(
 			
 			for (window= node->clipping_windows; window; window= window->next_window)
 			{
-				render_node_floor_or_ceiling(window, polygon, &LiquidSurface, false, ceil, renderStep);
+				render_node_floor_or_ceiling(window, polygon, &LiquidSurface, false, ceil, true, renderStep);
 			}
 		}
 	}
@@ -334,10 +335,10 @@ void RenderRasterizerClass::render_node(
 }
 
 void RenderRasterizerClass::store_endpoint(
-	endpoint_data *endpoint,
+	short endpoint_index,
 	long_vector2d& p)
 {
-	overflow_short_to_long_2d(endpoint->transformed, endpoint->flags, p);
+	p= RSPtr->RVPtr->transformed_endpoints[endpoint_index];
 }
 
 
@@ -350,6 +351,7 @@ void RenderRasterizerClass::render_node_floor_or_ceiling(
 	horizontal_surface_data *surface,
 	bool void_present,
 	bool ceil,
+	bool liquid,
 	RenderStep renderStep)
 {
 	// LP addition: animated-texture support
@@ -366,12 +368,10 @@ void RenderRasterizerClass::render_node_floor_or_ceiling(
 	
 		/* build transformed vertex list */
 		vertex_count= polygon->vertex_count;
+		const vector<long_vector2d>& transformed_endpoints= RSPtr->RVPtr->transformed_endpoints;
 		for (i=0;i<vertex_count;++i)
 		{
-			// LP change: expanded the transformed-endpoint access
-			long_vector2d temp_vertex;
-			endpoint_data *endpoint = get_endpoint_data(polygon->endpoint_indexes[i]);
-			overflow_short_to_long_2d(endpoint->transformed,endpoint->flags,temp_vertex);
+			const long_vector2d& temp_vertex= transformed_endpoints[polygon->endpoint_indexes[i]];
 			vertices[i].x = temp_vertex.i;
 			vertices[i].y = temp_vertex.j;
 			vertices[i].flags= 0;
@@ -76,6 +76,7 @@ struct vertical_surface_data
 	
 	struct side_texture_definition *texture_definition;
 	short transfer_mode;
+	short side_index; /* the side texture_definition belongs to */
 };
 
 typedef enum {
@@ -89,13 +90,14 @@ protected:
 	// Auxiliary data and routines:
 	virtual void render_tree(RenderStep renderStep);
 	virtual void render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep);
-	virtual void store_endpoint(endpoint_data *endpoint, long_vector2d& p);
+	virtual void store_endpoint(short endpoint_index, long_vector2d& p);
 	
 	// LP change: indicate whether the void is present on one side;
-	// useful for suppressing semitransparency to the void
+	// useful for suppressing semitransparency to the void.
+	// liquid: the surface is the polygon's liquid, not its floor or ceiling
 	virtual void render_node_floor_or_ceiling(
 		clipping_window_data *window, polygon_data *polygon, horizontal_surface_data *surface,
-		bool void_present, bool ceil, RenderStep renderStep);
+		bool void_present, bool ceil, bool liquid, RenderStep renderStep);
 	virtual void render_node_side(
 		clipping_window_data *window, vertical_surface_data *surface,
 		bool void_present, RenderStep renderStep);
@@ -8,7 +8,9 @@
 
 #include "OGL_Headers.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 
 #include "RenderRasterize_Shader.h"
 
@@ -20,6 +22,7 @@
 #include "OGL_Faders.h"
 #include "OGL_Textures.h"
 #include "OGL_Shader.h"
+#include "OGL_Setup.h"
 #include "ChaseCam.h"
 #include "preferences.h"
 
@@ -81,6 +84,267 @@ public:
 	}
 };
 
+/*
+ * the level's walls, floors and ceilings, kept in a vertex buffer for the
+ * life of the map
+ *
+ * each polygon has a ring of vertices for its floor, its ceiling and its
+ * liquid surface, and each side a quad for each of its three textures; a
+ * ring or quad is only rewritten when the heights or texture offsets it was
+ * built for change (platforms, liquids, sliding textures)
+ */
+class SurfaceBuffer {
+
+public:
+	enum {
+		kFloor,
+		kCeiling,
+		kLiquid,
+		NUMBER_OF_RINGS
+	};
+
+	enum {
+		kPrimary,
+		kSecondary,
+		kTransparent,
+		NUMBER_OF_SIDE_TEXTURES
+	};
+
+private:
+	struct vertex {
+		GLfloat x, y, z;
+		GLfloat s, t;
+	};
+
+	// what a ring or quad was last written for
+	struct key {
+		bool valid;
+		int32 values[4];
+
+		bool matches(int32 a, int32 b, int32 c, int32 d) const {
+			return valid && values[0] == a && values[1] == b && values[2] == c && values[3] == d;
+		}
+		void set(int32 a, int32 b, int32 c, int32 d) {
+			valid = true;
+			values[0] = a; values[1] = b; values[2] = c; values[3] = d;
+		}
+	};
+
+	GLuint _vbo;
+	bool _use_vbo;
+	bool _bound;
+
+	uint32 _layout_version;
+	bool _built;
+
+	std::vector<vertex> _vertices;
+	std::vector<GLint> _polygon_first;
+	GLint _side_first;
+	std::vector<key> _polygon_keys;
+	std::vector<key> _side_keys;
+
+	void update(GLint first, GLsizei count) {
+		if (_use_vbo) {
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, _vbo);
+			glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, first * sizeof(vertex), count * sizeof(vertex), &_vertices[first]);
+			if (!_bound)
+				glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		}
+	}
+
+	void build() {
+		release();
+
+		short polygon_count = dynamic_world->polygon_count;
+		short side_count = dynamic_world->side_count;
+
+		_polygon_first.resize(polygon_count);
+		GLint count = 0;
+		for (short i = 0; i < polygon_count; ++i) {
+			_polygon_first[i] = count;
+			count += NUMBER_OF_RINGS * get_polygon_data(i)->vertex_count;
+		}
+		_side_first = count;
+		count += NUMBER_OF_SIDE_TEXTURES * 4 * side_count;
+
+		_vertices.assign(MAX(count, 1), vertex());
+		_polygon_keys.assign(NUMBER_OF_RINGS * polygon_count, key());
+		_side_keys.assign(NUMBER_OF_SIDE_TEXTURES * side_count, key());
+
+		if (_use_vbo) {
+			if (!_vbo)
+				glGenBuffersARB(1, &_vbo);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, _vbo);
+			glBufferDataARB(GL_ARRAY_BUFFER_ARB, _vertices.size() * sizeof(vertex), &_vertices[0], GL_DYNAMIC_DRAW_ARB);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		}
+
+		_layout_version = map_layout_version;
+		_built = true;
+	}
+
+public:
+	SurfaceBuffer() : _vbo(0), _bound(false), _layout_version(0), _built(false), _side_first(0) {
+		_use_vbo = OGL_CheckExtension("GL_ARB_vertex_buffer_object");
+	}
+
+	~SurfaceBuffer() {
+		release();
+		if (_vbo)
+			glDeleteBuffersARB(1, &_vbo);
+	}
+
+	// rebuilds the layout if a new map has been loaded since
+	void prepare() {
+		if (!_built || _layout_version != map_layout_version ||
+		    _polygon_first.size() != size_t(dynamic_world->polygon_count) ||
+		    _side_keys.size() != size_t(NUMBER_OF_SIDE_TEXTURES * dynamic_world->side_count))
+			build();
+	}
+
+	// first vertex of a polygon's floor, ceiling or liquid ring, rewritten
+	// if it was last built for another height or texture offset
+	GLint polygon_ring(short polygon_index, int ring, bool ceil, world_distance height, int32 s, int32 t) {
+		polygon_data *polygon = get_polygon_data(polygon_index);
+		short vertex_count = polygon->vertex_count;
+		GLint first = _polygon_first[polygon_index] + ring * vertex_count;
+
+		key& k = _polygon_keys[NUMBER_OF_RINGS * polygon_index + ring];
+		if (!k.matches(height, s, t, ceil)) {
+			vertex *v = &_vertices[first];
+			for (short i = 0; i < vertex_count; ++i, ++v) {
+				world_point2d p = get_endpoint_data(polygon->endpoint_indexes[ceil ? vertex_count - 1 - i : i])->vertex;
+				v->x = p.x;
+				v->y = p.y;
+				v->z = height;
+				v->s = (p.x + s) / float(WORLD_ONE);
+				v->t = (p.y + t) / float(WORLD_ONE);
+			}
+			update(first, vertex_count);
+			k.set(height, s, t, ceil);
+		}
+		return first;
+	}
+
+	// first vertex of the quad for one of a side's textures, rewritten
+	// if it was last built for other heights or texture offsets
+	GLint side_quad(const vertical_surface_data& surface, int texture, world_distance top, world_distance bottom, int32 t, world_distance s) {
+		GLint index = NUMBER_OF_SIDE_TEXTURES * surface.side_index + texture;
+		GLint first = _side_first + 4 * index;
+
+		key& k = _side_keys[index];
+		if (!k.matches(top, bottom, t, s)) {
+			vertex *v = &_vertices[first];
+			const world_distance z[4] = { top, top, bottom, bottom };
+			for (int i = 0; i < 4; ++i) {
+				const long_vector2d& p = (i == 1 || i == 2) ? surface.p1 : surface.p0;
+				float p2 = (i == 1 || i == 2) ? surface.length : 0;
+				v[i].x = p.i;
+				v[i].y = p.j;
+				v[i].z = z[i];
+				v[i].s = (t - z[i]) / double(WORLD_ONE);
+				v[i].t = (s + p2) / double(WORLD_ONE);
+			}
+			update(first, 4);
+			k.set(top, bottom, t, s);
+		}
+		return first;
+	}
+
+	void draw(GLenum mode, GLint first, GLsizei count) {
+		if (!_bound) {
+			const GLvoid *base = NULL;
+			if (_use_vbo)
+				glBindBufferARB(GL_ARRAY_BUFFER_ARB, _vbo);
+			else
+				base = &_vertices[0];
+			glVertexPointer(3, GL_FLOAT, sizeof(vertex), base);
+			glTexCoordPointer(2, GL_FLOAT, sizeof(vertex), static_cast<const GLfloat *>(base) + 3);
+			_bound = true;
+		}
+		glDrawArrays(mode, first, count);
+	}
+
+	// everything else draws out of client-side arrays
+	void release() {
+		if (_bound && _use_vbo)
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		_bound = false;
+	}
+};
+
+/*
+ * a wall, floor or ceiling waiting to be drawn
+ */
+struct surface_draw {
+	int texture;			// into SurfaceQueue::textures
+	Shader *shader;
+	LandscapeOptions *opts;
+	GLfloat color;
+	float flare;
+	float pulsate;
+	float wobble;
+	float glow_wobble;
+	float intensity;
+	float offset;
+
+	clipping_window_data *window;
+	GLenum mode;
+	GLint first;
+	GLsizei count;
+	GLfloat normal[3];
+	GLfloat tangent[4];
+};
+
+/*
+ * what one rendering step draws, collected while walking the sorted tree
+ */
+class SurfaceQueue {
+
+public:
+	// a blended surface, an object, or (neither) the start of a node
+	struct item {
+		int draw;
+		render_object_data *object;
+		bool other_side_of_media;
+	};
+
+	std::vector<TextureManager> textures;
+	std::map<uint32, int> texture_indexes;
+
+	std::vector<surface_draw> draws;
+	std::vector<int> opaque;
+	std::vector<item> ordered;
+
+	void clear() {
+		textures.clear();
+		texture_indexes.clear();
+		draws.clear();
+		opaque.clear();
+		ordered.clear();
+	}
+};
+
+struct surface_draw_order {
+	const std::vector<surface_draw>& draws;
+
+	surface_draw_order(const std::vector<surface_draw>& d) : draws(d) {}
+
+	bool operator()(int a, int b) const {
+		const surface_draw& x = draws[a];
+		const surface_draw& y = draws[b];
+		if (x.shader != y.shader)
+			return x.shader < y.shader;
+		if (x.texture != y.texture)
+			return x.texture < y.texture;
+		return a < b;
+	}
+};
+
+
+RenderRasterize_Shader::RenderRasterize_Shader() : blur(NULL), geometry(NULL), queue(new SurfaceQueue), drawCalls(0), stateChanges(0), RenderRasterizerClass() {}
+
+RenderRasterize_Shader::~RenderRasterize_Shader() {}
 
 /*
  * initialize some stuff
@@ -92,6 +356,9 @@ void RenderRasterize_Shader::setupGL(Rasterizer_Shader_Class& Rasterizer) {
 
 	Shader::loadAll();
 
+	// the last run's buffer was deleted by teardownGL()
+	geometry.reset(new SurfaceBuffer);
+
 	Shader* s_blur = Shader::get(Shader::S_Blur);
 	Shader* s_bloom = Shader::get(Shader::S_Bloom);
 
@@ -106,6 +373,14 @@ void RenderRasterize_Shader::setupGL(Rasterizer_Shader_Class& Rasterizer) {
 //	glDisable(GL_LIGHTING);
 }
 
+/*
+ * happens when an opengl run stops, before its context goes away
+ */
+void RenderRasterize_Shader::teardownGL() {
+
+	geometry.reset();
+}
+
 /*
  * override for RenderRasterizerClass::render_tree()
  *
@@ -166,11 +441,17 @@ void RenderRasterize_Shader::render_tree() {
 	s->setFloat(Shader::U_Pitch, view->pitch * AngleConvert);
 	Shader::disable();
 
+	drawCalls = 0;
+	stateChanges = 0;
+
+	geometry->prepare();
 	RenderRasterizerClass::render_tree(kDiffuse);
+	flushSurfaces(kDiffuse);
 
 	if (TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_Blur) && blur.get()) {
 		blur->begin();
 		RenderRasterizerClass::render_tree(kGlow);
+		flushSurfaces(kGlow);
 		blur->end();
 		RasPtr->swapper->deactivate();
 		blur->draw(*RasPtr->swapper);
@@ -183,14 +464,10 @@ void RenderRasterize_Shader::render_tree() {
 void RenderRasterize_Shader::render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep)
 {
 	// parasitic object detection
-    objectCount = 0;
-    objectY = 0;
+	SurfaceQueue::item item = { NONE, NULL, false };
+	queue->ordered.push_back(item);
 
     RenderRasterizerClass::render_node(node, SeeThruLiquids, renderStep);
-
-	// turn off clipping planes
-	glDisable(GL_CLIP_PLANE0);
-	glDisable(GL_CLIP_PLANE1);
 }
 
 void RenderRasterize_Shader::clip_to_window(clipping_window_data *win)
@@ -226,9 +503,10 @@ void RenderRasterize_Shader::clip_to_window(clipping_window_data *win)
 }
 
 void RenderRasterize_Shader::store_endpoint(
-	endpoint_data *endpoint,
+	short endpoint_index,
 	long_vector2d& p)
 {
+	endpoint_data *endpoint = get_endpoint_data(endpoint_index);
 	p.i = endpoint->vertex.x;
 	p.j = endpoint->vertex.y;
 }
@@ -319,55 +597,38 @@ TextureManager RenderRasterize_Shader::setupSpriteTexture(const rectangle_defini
 const double Radian2Circle = 1/TWO_PI;			// A circle is 2*pi radians
 const double FullCircleReciprocal = 1/double(FULL_CIRCLE);
 
-TextureManager RenderRasterize_Shader::setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep) {
+// picks the shader and textures for a wall, floor or ceiling; nothing is bound until it's drawn
+bool RenderRasterize_Shader::setupWallTexture(surface_draw& d, const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep) {
 
 	Shader *s = NULL;
 
-	TextureManager TMgr;
-	LandscapeOptions *opts = NULL;
-	TMgr.ShapeDesc = Texture;
-	if (TMgr.ShapeDesc == UNONE) { return TMgr; }
-	get_shape_bitmap_and_shading_table(Texture, &TMgr.Texture, &TMgr.ShadingTables,
-		current_player->infravision_duration ? _shading_infravision : _shading_normal);
+	if (Texture == UNONE) { return false; }
 
-	TMgr.TransferMode = _textured_transfer;
-	TMgr.IsShadeless = current_player->infravision_duration ? 1 : 0;
-	TMgr.TransferData = 0;
+	short textureType = OGL_Txtr_Wall;
+	short mode = _textured_transfer;
+	bool shadeless = current_player->infravision_duration ? 1 : 0;
+	LandscapeOptions *opts = NULL;
 
 	float flare = weaponFlare;
-
-	glEnable(GL_TEXTURE_2D);
-	glColor4f(intensity, intensity, intensity, 1.0);
+	GLfloat color = intensity;
 
 	switch(transferMode) {
 		case _xfer_static:
-			TMgr.TextureType = OGL_Txtr_Wall;
-			TMgr.TransferMode = _static_transfer;
-			TMgr.IsShadeless = 1;
+			mode = _static_transfer;
+			shadeless = 1;
 			flare = -1;
 			s = Shader::get(renderStep == kGlow ? Shader::S_InvincibleBloom : Shader::S_Invincible);
-			s->enable();
 			break;
 		case _xfer_landscape:
 		case _xfer_big_landscape:
-		{
-			TMgr.TextureType = OGL_Txtr_Landscape;
-			TMgr.TransferMode = _big_landscaped_transfer;
+			textureType = OGL_Txtr_Landscape;
+			mode = _big_landscaped_transfer;
 			opts = View_GetLandscapeOptions(Texture);
-			TMgr.LandscapeVertRepeat = opts->VertRepeat;
-			TMgr.Landscape_AspRatExp = opts->OGL_AspRatExp;
 			s = Shader::get(renderStep == kGlow ? Shader::S_LandscapeBloom : Shader::S_Landscape);
-			s->enable();
-		}
 			break;
 		default:
-			TMgr.TextureType = OGL_Txtr_Wall;
-			if(TMgr.IsShadeless) {
-				if (renderStep == kDiffuse) {
-					glColor4f(1,1,1,1);
-				} else {
-					glColor4f(0,0,0,1);
-				}
+			if(shadeless) {
+				color = (renderStep == kDiffuse) ? 1 : 0;
 				flare = -1;
 			}
 	}
@@ -378,51 +639,50 @@ TextureManager RenderRasterize_Shader::setupWallTexture(const shape_descriptor&
 		} else {
 			s = Shader::get(renderStep == kGlow ? Shader::S_WallBloom : Shader::S_Wall);
 		}
-		s->enable();
 	}
 
-	if(TMgr.Setup()) {
-		TMgr.RenderNormal(); // must allocate first
-		if (TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_BumpMap)) {
-			glActiveTextureARB(GL_TEXTURE1_ARB);
-			TMgr.RenderBump();
-			glActiveTextureARB(GL_TEXTURE0_ARB);
-		}
+	// every surface with the same texture shares one texture manager
+	uint32 key = (uint32(Texture) << 16) | (textureType << 8) | mode;
+	std::map<uint32, int>::iterator it = queue->texture_indexes.find(key);
+	int index;
+	if (it != queue->texture_indexes.end()) {
+		index = it->second;
 	} else {
-		TMgr.ShapeDesc = UNONE;
-		return TMgr;
-	}
-
-	TMgr.SetupTextureMatrix();
-	
-	if (TMgr.TextureType == OGL_Txtr_Landscape && opts) {
-		double TexScale = ABS(TMgr.U_Scale);
-		double HorizScale = double(1 << opts->HorizExp);
-		s->setFloat(Shader::U_ScaleX, HorizScale * (npotTextures ? 1.0 : TexScale) * Radian2Circle);
-		s->setFloat(Shader::U_OffsetX, HorizScale * (0.25 + opts->Azimuth * FullCircleReciprocal));
-		
-		short AdjustedVertExp = opts->VertExp + opts->OGL_AspRatExp;
-		double VertScale = (AdjustedVertExp >= 0) ? double(1 << AdjustedVertExp)
-		                                          : 1/double(1 << (-AdjustedVertExp));
-		s->setFloat(Shader::U_ScaleY, VertScale * TexScale * Radian2Circle);
-		s->setFloat(Shader::U_OffsetY, (0.5 + TMgr.U_Offset) * TexScale);
-	}
+		index = queue->textures.size();
+		queue->textures.resize(index + 1);
+
+		TextureManager& TMgr = queue->textures.back();
+		TMgr.ShapeDesc = Texture;
+		get_shape_bitmap_and_shading_table(Texture, &TMgr.Texture, &TMgr.ShadingTables,
+			current_player->infravision_duration ? _shading_infravision : _shading_normal);
+		TMgr.TransferMode = mode;
+		TMgr.IsShadeless = shadeless;
+		TMgr.TransferData = 0;
+		TMgr.TextureType = textureType;
+		if (opts) {
+			TMgr.LandscapeVertRepeat = opts->VertRepeat;
+			TMgr.Landscape_AspRatExp = opts->OGL_AspRatExp;
+		}
 
-	if (renderStep == kGlow) {
-		if (TMgr.TextureType == OGL_Txtr_Landscape) {
-			s->setFloat(Shader::U_BloomScale, TMgr.LandscapeBloom());
-		} else {
-			s->setFloat(Shader::U_BloomScale, TMgr.BloomScale());
-			s->setFloat(Shader::U_BloomShift, TMgr.BloomShift());
+		if (!TMgr.Setup()) {
+			queue->textures.pop_back();
+			index = NONE;
 		}
+		queue->texture_indexes[key] = index;
 	}
-	s->setFloat(Shader::U_Flare, flare);
-	s->setFloat(Shader::U_SelfLuminosity, selfLuminosity);
-	s->setFloat(Shader::U_Pulsate, pulsate);
-	s->setFloat(Shader::U_Wobble, wobble);
-	s->setFloat(Shader::U_Depth, offset);
-	s->setFloat(Shader::U_Glow, 0);
-	return TMgr;
+	if (index == NONE) { return false; }
+
+	d.texture = index;
+	d.shader = s;
+	d.opts = opts;
+	d.color = color;
+	d.flare = flare;
+	d.pulsate = pulsate;
+	d.wobble = wobble;
+	d.glow_wobble = wobble;
+	d.intensity = intensity;
+	d.offset = offset;
+	return true;
 }
 
 void instantiate_transfer_mode(struct view_data *view, short transfer_mode, world_distance &x0, world_distance &y0) {
@@ -532,8 +792,152 @@ bool setupGlow(struct view_data *view, TextureManager &TMgr, float wobble, float
 	return false;
 }
 
+// binds a surface's shader and textures (if the last surface drawn didn't
+// use the same ones) and draws it; false if it left other state behind
+bool RenderRasterize_Shader::drawSurface(const surface_draw& d, bool rebind, bool reclip, RenderStep renderStep) {
+
+	TextureManager& TMgr = queue->textures[d.texture];
+	Shader *s = d.shader;
+
+	if (rebind) {
+		glEnable(GL_TEXTURE_2D);
+		s->enable();
+
+		TMgr.RenderNormal(); // must allocate first
+		if (TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_BumpMap)) {
+			glActiveTextureARB(GL_TEXTURE1_ARB);
+			TMgr.RenderBump();
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+		}
+		TMgr.SetupTextureMatrix();
+
+		if (TMgr.TextureType == OGL_Txtr_Landscape && d.opts) {
+			LandscapeOptions *opts = d.opts;
+			double TexScale = ABS(TMgr.U_Scale);
+			double HorizScale = double(1 << opts->HorizExp);
+			s->setFloat(Shader::U_ScaleX, HorizScale * (npotTextures ? 1.0 : TexScale) * Radian2Circle);
+			s->setFloat(Shader::U_OffsetX, HorizScale * (0.25 + opts->Azimuth * FullCircleReciprocal));
+
+			short AdjustedVertExp = opts->VertExp + opts->OGL_AspRatExp;
+			double VertScale = (AdjustedVertExp >= 0) ? double(1 << AdjustedVertExp)
+			                                          : 1/double(1 << (-AdjustedVertExp));
+			s->setFloat(Shader::U_ScaleY, VertScale * TexScale * Radian2Circle);
+			s->setFloat(Shader::U_OffsetY, (0.5 + TMgr.U_Offset) * TexScale);
+		}
+
+		if (renderStep == kGlow) {
+			if (TMgr.TextureType == OGL_Txtr_Landscape) {
+				s->setFloat(Shader::U_BloomScale, TMgr.LandscapeBloom());
+			} else {
+				s->setFloat(Shader::U_BloomScale, TMgr.BloomScale());
+				s->setFloat(Shader::U_BloomShift, TMgr.BloomShift());
+			}
+		}
+
+		if (TMgr.IsBlended()) {
+			glEnable(GL_BLEND);
+			setupBlendFunc(TMgr.NormalBlend());
+			glEnable(GL_ALPHA_TEST);
+			glAlphaFunc(GL_GREATER, 0.001);
+		} else {
+			glDisable(GL_BLEND);
+			glEnable(GL_ALPHA_TEST);
+			glAlphaFunc(GL_GREATER, 0.5);
+		}
+	}
+
+	glColor4f(d.color, d.color, d.color, 1.0);
+	s->setFloat(Shader::U_Flare, d.flare);
+	s->setFloat(Shader::U_SelfLuminosity, selfLuminosity);
+	s->setFloat(Shader::U_Pulsate, d.pulsate);
+	s->setFloat(Shader::U_Wobble, d.wobble);
+	s->setFloat(Shader::U_Depth, d.offset);
+	s->setFloat(Shader::U_Glow, 0);
+
+	if (reclip)
+		clip_to_window(d.window);
+
+	glNormal3fv(d.normal);
+	glMultiTexCoord4fvARB(GL_TEXTURE1_ARB, d.tangent);
+
+	geometry->draw(d.mode, d.first, d.count);
+	drawCalls++;
+
+	if (setupGlow(view, TMgr, d.glow_wobble, d.intensity, weaponFlare, selfLuminosity, d.offset, renderStep)) {
+		geometry->draw(d.mode, d.first, d.count);
+		drawCalls++;
+		return false;
+	}
+	return true;
+}
+
+static void finishSurface() {
+	Shader::disable();
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+}
+
+// opaque surfaces are depth buffered and alpha tested, so they can go in
+// any order: they go first, by shader and then texture, and a run sharing
+// both is bound once; blended surfaces and objects go back to front after them
+void RenderRasterize_Shader::flushSurfaces(RenderStep renderStep) {
+
+	SurfaceQueue& q = *queue;
+	std::sort(q.opaque.begin(), q.opaque.end(), surface_draw_order(q.draws));
+
+	const surface_draw *previous = NULL;
+	bool current = false;
+	for (std::vector<int>::const_iterator it = q.opaque.begin(); it != q.opaque.end(); ++it) {
+		const surface_draw& d = q.draws[*it];
+		bool rebind = !current || previous->shader != d.shader || previous->texture != d.texture;
+		if (rebind)
+			stateChanges++;
+		current = drawSurface(d, rebind, !previous || previous->window != d.window, renderStep);
+		if (!current)
+			finishSurface();
+		previous = &d;
+	}
+	if (current)
+		finishSurface();
+
+	for (std::vector<SurfaceQueue::item>::const_iterator it = q.ordered.begin(); it != q.ordered.end(); ++it) {
+		if (it->draw != NONE) {
+			stateChanges++;
+			drawSurface(q.draws[it->draw], true, true, renderStep);
+			finishSurface();
+		} else if (it->object) {
+			drawNodeObject(it->object, it->other_side_of_media, renderStep);
+		} else {
+			// parasitic object detection starts over with each node
+			objectCount = 0;
+			objectY = 0;
+		}
+	}
+
+	// turn off clipping planes
+	glDisable(GL_CLIP_PLANE0);
+	glDisable(GL_CLIP_PLANE1);
+
+	geometry->release();
+	q.clear();
+}
+
+void RenderRasterize_Shader::queueSurface(const surface_draw& d) {
+
+	int index = queue->draws.size();
+	queue->draws.push_back(d);
+
+	if (queue->textures[d.texture].IsBlended()) {
+		SurfaceQueue::item item = { index, NULL, false };
+		queue->ordered.push_back(item);
+	} else {
+		queue->opaque.push_back(index);
+	}
+}
+
 void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *window,
-	polygon_data *polygon, horizontal_surface_data *surface, bool void_present, bool ceil, RenderStep renderStep) {
+	polygon_data *polygon, horizontal_surface_data *surface, bool void_present, bool ceil, bool liquid, RenderStep renderStep) {
 
 	float offset = 0;
 
@@ -542,19 +946,8 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 	float wobble = calcWobble(surface->transfer_mode, view->tick_count);
 	// note: wobble and pulsate behave the same way on floors and ceilings
 	// note 2: stronger wobble looks more like classic with default shaders
-	TextureManager TMgr = setupWallTexture(texture, surface->transfer_mode, wobble * 4.0, 0, intensity, offset, renderStep);
-	if(TMgr.ShapeDesc == UNONE) { return; }
-
-	if (TMgr.IsBlended()) {
-		glEnable(GL_BLEND);
-		setupBlendFunc(TMgr.NormalBlend());
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.001);
-	} else {
-		glDisable(GL_BLEND);
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.5);
-	}
+	surface_draw d;
+	if (!setupWallTexture(d, texture, surface->transfer_mode, wobble * 4.0, 0, intensity, offset, renderStep)) { return; }
 
 //	if (void_present) {
 //		glDisable(GL_BLEND);
@@ -564,66 +957,28 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 	short vertex_count = polygon->vertex_count;
 
 	if (vertex_count) {
-        clip_to_window(window);
-
 		world_distance x = 0.0, y = 0.0;
 		instantiate_transfer_mode(view, surface->transfer_mode, x, y);
 
-		vec3 N;
-		vec3 T;
-		float sign;
-		if(ceil) {
-			N = vec3(0,0,-1);
-			T = vec3(0,1,0);
-			sign = 1;
-		} else {
-			N = vec3(0,0,1);
-			T = vec3(0,1,0);
-			sign = -1;
-		}
-		glNormal3f(N[0], N[1], N[2]);
-		glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
-
-		GLfloat vertex_array[MAXIMUM_VERTICES_PER_POLYGON * 3];
-		GLfloat texcoord_array[MAXIMUM_VERTICES_PER_POLYGON * 2];
-
-		GLfloat* vp = vertex_array;
-		GLfloat* tp = texcoord_array;
-		if (ceil)
-		{
-			for(short i = 0; i < vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[vertex_count - 1 - i])->vertex;
-				*vp++ = vertex.x;
-				*vp++ = vertex.y;
-				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
-				*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
-			}
-		}
-		else
-		{
-			for(short i=0; i<vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
-				*vp++ = vertex.x;
-				*vp++ = vertex.y;
-				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
-				*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
-			}
-		}
-		glVertexPointer(3, GL_FLOAT, 0, vertex_array);
-		glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
-
-		glDrawArrays(GL_POLYGON, 0, vertex_count);
-
-		if (setupGlow(view, TMgr, wobble, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
-			glDrawArrays(GL_POLYGON, 0, vertex_count);
-		}
-
-		Shader::disable();
-		glMatrixMode(GL_TEXTURE);
-		glLoadIdentity();
-		glMatrixMode(GL_MODELVIEW);
+		// the liquid is drawn separately from a floor or ceiling when it can be seen through
+		int ring = liquid ? SurfaceBuffer::kLiquid : ceil ? SurfaceBuffer::kCeiling : SurfaceBuffer::kFloor;
+		GLint first = geometry->polygon_ring(polygon - map_polygons, ring, ceil, surface->height,
+		                                     surface->origin.x + x, surface->origin.y + y);
+
+		d.normal[0] = 0;
+		d.normal[1] = 0;
+		d.normal[2] = ceil ? -1 : 1;
+		d.tangent[0] = 0;
+		d.tangent[1] = 1;
+		d.tangent[2] = 0;
+		d.tangent[3] = ceil ? 1 : -1;
+
+		d.window = window;
+		d.mode = GL_POLYGON;
+		d.first = first;
+		d.count = vertex_count;
+		d.glow_wobble = wobble;
+		queueSurface(d);
 	}
 }
 
@@ -642,19 +997,8 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 		pulsate = wobble;
 		wobble = 0;
 	}
-	TextureManager TMgr = setupWallTexture(texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep);
-	if(TMgr.ShapeDesc == UNONE) { return; }
-
-	if (TMgr.IsBlended()) {
-		glEnable(GL_BLEND);
-		setupBlendFunc(TMgr.NormalBlend());
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.001);
-	} else {
-		glDisable(GL_BLEND);
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.5);
-	}
+	surface_draw d;
+	if (!setupWallTexture(d, texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep)) { return; }
 
 //	if (void_present) {
 //		glDisable(GL_BLEND);
@@ -665,78 +1009,40 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 
 	if (h>surface->h0) {
 
-		world_point2d vertex[2];
-		uint16 flags;
-		flagged_world_point3d vertices[MAXIMUM_VERTICES_PER_WORLD_POLYGON];
-		short vertex_count;
-
-		/* initialize the two posts of our trapezoid */
-		vertex_count= 2;
-		long_to_overflow_short_2d(surface->p0, vertex[0], flags);
-		long_to_overflow_short_2d(surface->p1, vertex[1], flags);
-
-		if (vertex_count) {
-            clip_to_window(window);
-
-			vertex_count= 4;
-			vertices[0].z= vertices[1].z= h + view->origin.z;
-			vertices[2].z= vertices[3].z= surface->h0 + view->origin.z;
-			vertices[0].x= vertices[3].x= vertex[0].x, vertices[0].y= vertices[3].y= vertex[0].y;
-			vertices[1].x= vertices[2].x= vertex[1].x, vertices[1].y= vertices[2].y= vertex[1].y;
-			vertices[0].flags = vertices[3].flags = 0;
-			vertices[1].flags = vertices[2].flags = 0;
-
-			double div = WORLD_ONE;
-			double dx = (surface->p1.i - surface->p0.i) / double(surface->length);
-			double dy = (surface->p1.j - surface->p0.j) / double(surface->length);
-
-			world_distance x0 = WORLD_FRACTIONAL_PART(surface->texture_definition->x0);
-			world_distance y0 = WORLD_FRACTIONAL_PART(surface->texture_definition->y0);
-
-			double tOffset = surface->h1 + view->origin.z + y0;
-
-			vec3 N(-dy, dx, 0);
-			vec3 T(dx, dy, 0);
-			float sign = 1;
-			glNormal3f(N[0], N[1], N[2]);
-			glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
+		double dx = (surface->p1.i - surface->p0.i) / double(surface->length);
+		double dy = (surface->p1.j - surface->p0.j) / double(surface->length);
 
-			world_distance x = 0.0, y = 0.0;
-			instantiate_transfer_mode(view, surface->transfer_mode, x, y);
+		world_distance x0 = WORLD_FRACTIONAL_PART(surface->texture_definition->x0);
+		world_distance y0 = WORLD_FRACTIONAL_PART(surface->texture_definition->y0);
 
-			x0 -= x;
-			tOffset -= y;
+		int32 tOffset = surface->h1 + view->origin.z + y0;
 
-			GLfloat vertex_array[12];
-			GLfloat texcoord_array[8];
+		d.normal[0] = -dy;
+		d.normal[1] = dx;
+		d.normal[2] = 0;
+		d.tangent[0] = dx;
+		d.tangent[1] = dy;
+		d.tangent[2] = 0;
+		d.tangent[3] = 1;
 
-			GLfloat* vp = vertex_array;
-			GLfloat* tp = texcoord_array;
-
-			for(int i = 0; i < vertex_count; ++i) {
-				float p2 = 0;
-				if(i == 1 || i == 2) { p2 = surface->length; }
-
-				*vp++ = vertices[i].x;
-				*vp++ = vertices[i].y;
-				*vp++ = vertices[i].z;
-				*tp++ = (tOffset - vertices[i].z) / div;
-				*tp++ = (x0+p2) / div;
-			}
-			glVertexPointer(3, GL_FLOAT, 0, vertex_array);
-			glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
-			
-			glDrawArrays(GL_QUADS, 0, vertex_count);
-
-			if (setupGlow(view, TMgr, wobble, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
-				glDrawArrays(GL_QUADS, 0, vertex_count);
-			}
+		world_distance x = 0.0, y = 0.0;
+		instantiate_transfer_mode(view, surface->transfer_mode, x, y);
 
-			Shader::disable();
-			glMatrixMode(GL_TEXTURE);
-			glLoadIdentity();
-			glMatrixMode(GL_MODELVIEW);
-		}
+		x0 -= x;
+		tOffset -= y;
+
+		side_data *side = get_side_data(surface->side_index);
+		int texture = SurfaceBuffer::kPrimary;
+		if (surface->texture_definition == &side->secondary_texture)
+			texture = SurfaceBuffer::kSecondary;
+		else if (surface->texture_definition == &side->transparent_texture)
+			texture = SurfaceBuffer::kTransparent;
+
+		d.window = window;
+		d.mode = GL_QUADS;
+		d.first = geometry->side_quad(*surface, texture, h + view->origin.z, surface->h0 + view->origin.z, tOffset, x0);
+		d.count = 4;
+		queueSurface(d);
 	}
 }
 
@@ -893,9 +1199,18 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 
 void RenderRasterize_Shader::render_node_object(render_object_data *object, bool other_side_of_media, RenderStep renderStep) {
 
+	// objects are drawn back to front, in among the blended surfaces
+	SurfaceQueue::item item = { NONE, object, other_side_of_media };
+	queue->ordered.push_back(item);
+}
+
+void RenderRasterize_Shader::drawNodeObject(render_object_data *object, bool other_side_of_media, RenderStep renderStep) {
+
     if (!object->clipping_windows)
         return;
 
+	geometry->release();
+
 	clipping_window_data *win;
 
 	// To properly handle sprites in media, we render above and below
@@ -20,9 +20,14 @@
 #include <memory>
 
 class Blur;
+class SurfaceBuffer;
+class SurfaceQueue;
+struct surface_draw;
 class RenderRasterize_Shader : public RenderRasterizerClass {
 
 	std::auto_ptr<Blur> blur;
+	std::auto_ptr<SurfaceBuffer> geometry;
+	std::auto_ptr<SurfaceQueue> queue;
 	Rasterizer_Shader_Class *RasPtr;
 	
 	int objectCount;
@@ -32,13 +37,22 @@ class RenderRasterize_Shader : public RenderRasterizerClass {
 	
 	long_vector2d leftmost_clip, rightmost_clip;
 
+	// for the frame being (or last) drawn
+	uint32 drawCalls;
+	uint32 stateChanges;
+
+	bool drawSurface(const surface_draw& d, bool rebind, bool reclip, RenderStep renderStep);
+	void queueSurface(const surface_draw& d);
+	void flushSurfaces(RenderStep renderStep);
+	void drawNodeObject(render_object_data *object, bool other_side_of_media, RenderStep renderStep);
+
 protected:
 	virtual void render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep);	
-	virtual void store_endpoint(endpoint_data *endpoint, long_vector2d& p);
+	virtual void store_endpoint(short endpoint_index, long_vector2d& p);
 
 	virtual void render_node_floor_or_ceiling(
 		  clipping_window_data *window, polygon_data *polygon, horizontal_surface_data *surface,
-		  bool void_present, bool ceil, RenderStep renderStep);
+		  bool void_present, bool ceil, bool liquid, RenderStep renderStep);
 	virtual void render_node_side(
 		  clipping_window_data *window, vertical_surface_data *surface,
 		  bool void_present, RenderStep renderStep);
@@ -50,13 +64,20 @@ protected:
 	
 public:
 
-	RenderRasterize_Shader() : blur(NULL), RenderRasterizerClass() {}
+	RenderRasterize_Shader();
+	~RenderRasterize_Shader();
 
 	virtual void setupGL(Rasterizer_Shader_Class& Rasterizer);
+	// releases what setupGL() made, while its context is still current
+	void teardownGL();
 
 	virtual void render_tree(void);
 
-	TextureManager setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep);
+	// surfaces drawn, and times the shader or texture changed between them, last frame
+	uint32 surface_draw_calls() const { return drawCalls; }
+	uint32 surface_state_changes() const { return stateChanges; }
+
+	bool setupWallTexture(surface_draw& d, const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep);
 	TextureManager setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep);
 };
 
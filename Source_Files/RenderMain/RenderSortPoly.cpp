@@ -55,7 +55,7 @@ enum /* build_clipping_window() window states */
 
 RenderSortPolyClass::RenderSortPolyClass():
 	view(NULL),	// Idiot-proofing
-	RVPtr(NULL)
+	RVPtr(NULL), sorted_clipping_window_count(0)
 {
 	SortedNodes.reserve(MAXIMUM_SORTED_NODES);
 	AccumulatedEndpointClips.reserve(MAXIMUM_CLIPS_PER_NODE);
@@ -229,6 +229,22 @@ void RenderSortPolyClass::sort_render_tree()
 	}
 
 	while (last_leaf != &Nodes.front()); /* continue until we remove the root */
+	
+	sorted_clipping_window_count= RVPtr->ClippingWindows.size();
+}
+
+void RenderSortPolyClass::reuse_sorted_render_tree()
+{
+	assert(RVPtr);
+	
+	for (size_t i= 0; i<SortedNodes.size(); ++i)
+	{
+		SortedNodes[i].interior_objects= NULL;
+		SortedNodes[i].exterior_objects= NULL;
+	}
+	
+	/* drop the objects' windows; this never reallocates, so the nodes' window pointers hold */
+	RVPtr->ClippingWindows.resize(sorted_clipping_window_count);
 }
 
 /* ---------- initializing and calculating clip data */
@@ -90,6 +90,13 @@ public:
 
 	// Does the sorting
 	void sort_render_tree();
+	
+	// Readies the last sorting to have objects placed in it again,
+	// for when neither the view nor the map has changed
+	void reuse_sorted_render_tree();
+	
+	// How many clipping windows the sorting made; object placement adds its own after them
+	size_t sorted_clipping_window_count;
   	
   	// Inits everything
  	RenderSortPolyClass();
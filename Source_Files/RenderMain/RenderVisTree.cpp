@@ -99,6 +99,33 @@ void RenderVisTreeClass::Resize(size_t NumEndpoints, size_t NumLines)
 	line_clip_indexes.resize(NumLines);
 }
 
+/* the same rotation as transform_overflow_point2d(), and the same 20-bit range that the
+	overflow-short packing used to leave it with, for all the endpoints at once; it's a
+	straight loop over the endpoint list that the compiler can vectorize */
+void RenderVisTreeClass::transform_endpoints()
+{
+	size_t count= EndpointList.size();
+	transformed_endpoints.resize(count);
+	if (!count) return;
+	
+	angle theta= normalize_angle(view->yaw);
+	int32 cosine= cosine_table[theta], sine= sine_table[theta];
+	int32 origin_x= view->origin.x, origin_y= view->origin.y;
+	const endpoint_data *endpoint= &EndpointList[0];
+	long_vector2d *transformed= &transformed_endpoints[0];
+	
+	for (size_t i= 0; i<count; ++i)
+	{
+		int32 x= int32(endpoint[i].vertex.x)-origin_x;
+		int32 y= int32(endpoint[i].vertex.y)-origin_y;
+		int32 tx= ((x*cosine)>>TRIG_SHIFT) + ((y*sine)>>TRIG_SHIFT);
+		int32 ty= ((y*cosine)>>TRIG_SHIFT) - ((x*sine)>>TRIG_SHIFT);
+		
+		transformed[i].i= (tx<<12)>>12;
+		transformed[i].j= (ty<<12)>>12;
+	}
+}
+
 // Add a polygon to the polygon queue
 void RenderVisTreeClass::PUSH_POLYGON_INDEX(short polygon_index)
 {
@@ -130,6 +157,9 @@ void RenderVisTreeClass::build_render_tree()
 	/* reset clipping buffers */
 	initialize_clip_data();
 	
+	/* transform every endpoint up front, rather than one at a time as they're visited */
+	transform_endpoints();
+	
 	// LP change:
 	// Adjusted for long-vector handling
 	// Using start index of list of nodes: 0
@@ -158,19 +188,12 @@ void RenderVisTreeClass::build_render_tree()
 				// LP change: move toward correct handling of long distances
 				long_vector2d _vector;
 				
-				/* transform all visited endpoints */
-				endpoint->transformed= endpoint->vertex;
-				transform_overflow_point2d(&endpoint->transformed, (world_point2d *) &view->origin, view->yaw, &endpoint->flags);
-
 				/* calculate an outbound vector to this endpoint */
 				// LP: changed to do long distance correctly.	
 				_vector.i= int32(endpoint->vertex.x)-int32(view->origin.x);
 				_vector.j= int32(endpoint->vertex.y)-int32(view->origin.y);
 				
-				// LP change: compose a true transformed point to replace endpoint->transformed,
-				// and use it in the upcoming code
-				long_vector2d transformed_endpoint;
-				overflow_short_to_long_2d(endpoint->transformed,endpoint->flags,transformed_endpoint);
+				const long_vector2d& transformed_endpoint= transformed_endpoints[endpoint_index];
 				
 				if (transformed_endpoint.i>0)
 				{
@@ -655,24 +678,15 @@ void RenderVisTreeClass::calculate_line_clipping_information(
 	size_t LastIndex = Length-1;
 	
 	line_data *line= get_line_data(line_index);
-	// LP change: relabeling p0 and p1 so as not to conflict with later use
-	world_point2d p0_orig= get_endpoint_data(line->endpoint_indexes[0])->vertex;
-	world_point2d p1_orig= get_endpoint_data(line->endpoint_indexes[1])->vertex;
 	// LP addition: place for new line data
 	line_clip_data *data= &LineClips[LastIndex];
 
-	/* its possible (in fact, likely) that this lines endpoints have not been transformed yet,
-		so we have to do it ourselves */
-	// LP change: making the operation long-distance friendly
-	uint16 p0_flags = 0, p1_flags = 0;
-	transform_overflow_point2d(&p0_orig, (world_point2d *) &view->origin, view->yaw, &p0_flags);
-	transform_overflow_point2d(&p1_orig, (world_point2d *) &view->origin, view->yaw, &p1_flags);
-	
-	// Defining long versions here and copying over
+	/* this line's endpoints may not have been visited, but all of them have been transformed */
 	long_point2d p0, p1;
-	long_vector2d *pv0ptr = (long_vector2d*)(&p0), *pv1ptr = (long_vector2d*)(&p1);
-	overflow_short_to_long_2d(p0_orig,p0_flags,*pv0ptr);
-	overflow_short_to_long_2d(p1_orig,p1_flags,*pv1ptr);
+	const long_vector2d& v0= transformed_endpoints[line->endpoint_indexes[0]];
+	const long_vector2d& v1= transformed_endpoints[line->endpoint_indexes[1]];
+	p0.x= v0.i, p0.y= v0.j;
+	p1.x= v1.i, p1.y= v1.j;
 	
 	clip_flags&= _clip_up|_clip_down;	
 	assert(clip_flags&(_clip_up|_clip_down));
@@ -776,7 +790,6 @@ short RenderVisTreeClass::calculate_endpoint_clipping_information(
 	assert(Length >= 1);
 	size_t LastIndex = Length-1;
 
-	endpoint_data *endpoint= get_endpoint_data(endpoint_index);
 	endpoint_clip_data *data= &EndpointClips[LastIndex];
 	int32 x;
 
@@ -784,10 +797,7 @@ short RenderVisTreeClass::calculate_endpoint_clipping_information(
 	assert((clip_flags&(_clip_left|_clip_right))!=(_clip_left|_clip_right)); /* but cant have both */
 	assert(!TEST_RENDER_FLAG(endpoint_index, _endpoint_has_clip_data));
 	
-	// LP change: compose a true transformed point to replace endpoint->transformed,
-	// and use it in the upcoming code
-	long_vector2d transformed_endpoint;
-	overflow_short_to_long_2d(endpoint->transformed,endpoint->flags,transformed_endpoint);
+	const long_vector2d& transformed_endpoint= transformed_endpoints[endpoint_index];
 	
 	data->flags= clip_flags&(_clip_left|_clip_right);
 	switch (data->flags)
@@ -188,8 +188,14 @@ class RenderVisTreeClass
 	
 	void ResetLineClips();
 	
+	void transform_endpoints();
+	
 public:
 
+	/* every map endpoint in view space, transformed once per visibility tree; this is
+		endpoint->transformed without the overflow-short packing */
+	vector<long_vector2d> transformed_endpoints;
+
 	/* gives screen x-coordinates for a map endpoint (only valid if _endpoint_is_visible) */
 	vector<short> endpoint_x_coordinates;
 	
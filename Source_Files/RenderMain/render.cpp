@@ -241,6 +241,9 @@ extern WindowPtr screen_window;
 #endif
 #include "preferences.h"
 #include "screen.h"
+#include "Logging.h"
+
+#include <SDL_thread.h>
 
 /* use native alignment */
 #if defined (powerc) || defined (__powerc)
@@ -305,6 +308,21 @@ static const int TICKS_PER_EXPLORE = 4;
 static struct view_data explore_view;
 static RenderVisTreeClass explore_tree;
 
+// The view and map geometry the visibility tree and its sorting were last built for
+static bool render_tree_valid= false;
+static struct view_data render_tree_view;
+static uint32 render_tree_geometry_version;
+static struct render_tree_statistics render_tree_stats;
+
+// Pipelined views are rasterized on this thread, from the first one until
+// stop_background_rasterizer()
+static SDL_Thread *background_rasterizer= NULL;
+static SDL_sem *background_rasterizer_start= NULL;
+static SDL_sem *background_rasterizer_done= NULL;
+static bool background_rasterizer_failed= false;
+static bool background_rasterizer_busy= false;
+static bool background_rasterizer_quit= false;
+
 void OGL_Rasterizer_Init() {
 	
 #ifdef HAVE_OPENGL
@@ -315,6 +333,13 @@ void OGL_Rasterizer_Init() {
 #endif
 }
 
+void OGL_Rasterizer_Stop() {
+	
+#ifdef HAVE_OPENGL
+	Render_Shader.teardownGL();
+#endif
+}
+
 /* ---------- private prototypes */
 
 static void update_view_data(struct view_data *view);
@@ -322,6 +347,8 @@ static void update_render_effect(struct view_data *view);
 static void shake_view_origin(struct view_data *view, world_distance delta);
 
 static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr);
+static bool render_tree_is_current(struct view_data *view);
+static int background_rasterizer_thread(void *);
 static void position_sprite_axis(short *x0, short *x1, short scale_width, short screen_width,
 	short positioning_mode, _fixed position, bool flip, world_distance world_left, world_distance world_right);
 
@@ -348,6 +375,8 @@ void allocate_render_memory(
 	RenderVisTree.Resize(MAXIMUM_ENDPOINTS_PER_MAP,MAXIMUM_LINES_PER_MAP);
 	RenderSortPoly.Resize(MAXIMUM_POLYGONS_PER_MAP);
 	
+	render_tree_valid= false;
+	
 	// LP change: set up pointers
 	RenderSortPoly.RVPtr = &RenderVisTree;
 	RenderPlaceObjs.RVPtr = &RenderVisTree;
@@ -415,17 +444,43 @@ void initialize_view_data(
 	// LP: this is now called in render_screen(), so we need to disable the initializing
 }
 
+/* adds the time since stage_start to stage, and starts the next stage */
+static void end_render_stage(
+	Uint64& stage,
+	Uint64& stage_start)
+{
+	Uint64 now= machine_microsecond_count();
+	
+	stage+= now - stage_start;
+	stage_start= now;
+}
+
 /* origin,origin_polygon_index,yaw,pitch,roll,etc. have probably changed since last call */
 void render_view(
 	struct view_data *view,
-	struct bitmap_definition *destination)
+	struct bitmap_definition *destination,
+	struct render_view_timings *timings,
+	bool pipelined)
 {
+	Uint64 stage_start= timings ? machine_microsecond_count() : 0;
+	
+	wait_for_background_rasterizer();
+	
 	update_view_data(view);
 
-	/* clear the render flags */
-	objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
+	/* the visibility tree and its sorting only depend on the view and the map's geometry,
+		so while neither changes (a viewer standing still, an idle camera) last frame's are
+		reused; the render flags, transformed endpoints and automap are still as they left them */
+	bool reuse_render_tree= !view->terminal_mode_active && !view->overhead_map_active &&
+		render_tree_is_current(view);
+	
+	if (!reuse_render_tree)
+	{
+		/* clear the render flags */
+		objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
 
-	ResetOverheadMap();
+		ResetOverheadMap();
+	}
 /*
 #ifdef AUTOMAP_DEBUG
 	memset(automap_lines, 0, (dynamic_world->line_count/8+((dynamic_world->line_count%8)?1:0)*sizeof(byte)));
@@ -445,8 +500,12 @@ void render_view(
 		
 		// LP: now from the visibility-tree class
 		/* build the render tree, regardless of map mode, so the automap updates while active */
-		RenderVisTree.view = view;
-		RenderVisTree.build_render_tree();
+		if (!reuse_render_tree)
+		{
+			RenderVisTree.view = view;
+			RenderVisTree.build_render_tree();
+		}
+		if (timings) end_render_stage(timings->build_render_tree, stage_start);
 		
 		/* do something complicated and difficult to explain */
 		if (!view->overhead_map_active || map_is_translucent())
@@ -454,13 +513,28 @@ void render_view(
 			// LP: now from the polygon-sorter class
 			/* sort the render tree (so we have a depth-ordering of polygons) and accumulate
 				clipping information for each polygon */
-			RenderSortPoly.view = view;
-			RenderSortPoly.sort_render_tree();
+			if (reuse_render_tree)
+			{
+				RenderSortPoly.reuse_sorted_render_tree();
+				render_tree_stats.reused+= 1;
+			}
+			else
+			{
+				RenderSortPoly.view = view;
+				RenderSortPoly.sort_render_tree();
+				render_tree_stats.built+= 1;
+				
+				render_tree_valid= true;
+				render_tree_view= *view;
+				render_tree_geometry_version= map_geometry_version;
+			}
+			if (timings) end_render_stage(timings->sort_render_tree, stage_start);
 			
 			// LP: now from the object-placement class
 			/* build the render object list by looking at the sorted render tree */
 			RenderPlaceObjs.view = view;
 			RenderPlaceObjs.build_render_object_list();
+			if (timings) end_render_stage(timings->build_render_object_list, stage_start);
 			
 			// LP addition: set the current rasterizer to whichever is appropriate here
 			RasterizerClass *RasPtr;
@@ -472,6 +546,7 @@ void render_view(
 #endif
 				// The software renderer needs this but the OpenGL one doesn't...
 				Rasterizer_SW.screen = destination;
+				Rasterizer_SW.deferred = pipelined;
 				RasPtr = &Rasterizer_SW;
 #ifdef HAVE_OPENGL
 			}
@@ -501,14 +576,110 @@ void render_view(
 			
 			// Finish rendering main view
 			RasPtr->End();
+			if (timings) end_render_stage(timings->render_tree, stage_start);
 		}
 
 		if (view->overhead_map_active)
 		{
 			/* if the overhead map is active, render it */
 			render_overhead_map(view);
+			
+			/* it uses the endpoints' transformed coordinates for its own */
+			render_tree_valid= false;
+		}
+	}
+}
+
+const struct render_tree_statistics& get_render_tree_statistics(
+	void)
+{
+	render_tree_stats.occluded_sprites= Rasterizer_SW.occluded_rectangles;
+#ifdef HAVE_OPENGL
+	render_tree_stats.surface_draw_calls= Render_Shader.surface_draw_calls();
+	render_tree_stats.surface_state_changes= Render_Shader.surface_state_changes();
+#endif
+	return render_tree_stats;
+}
+
+/* draws the view that the last pipelined render_view() recorded; if the thread
+	can't be started, it's drawn right here */
+void rasterize_view_in_background(
+	void)
+{
+	if (!Rasterizer_SW.deferred) return;
+	Rasterizer_SW.deferred= false;
+	
+	if (!background_rasterizer && !background_rasterizer_failed)
+	{
+		background_rasterizer_start= SDL_CreateSemaphore(0);
+		background_rasterizer_done= SDL_CreateSemaphore(0);
+		if (background_rasterizer_start && background_rasterizer_done)
+			background_rasterizer= SDL_CreateThread(background_rasterizer_thread, NULL);
+		
+		if (!background_rasterizer)
+		{
+			logWarning("couldn't start the background rasterizer (%s); views will not be pipelined", SDL_GetError());
+			background_rasterizer_failed= true;
 		}
 	}
+	
+	if (background_rasterizer)
+	{
+		background_rasterizer_busy= true;
+		SDL_SemPost(background_rasterizer_start);
+	}
+	else
+		Rasterizer_SW.Rasterize();
+}
+
+void wait_for_background_rasterizer(
+	void)
+{
+	if (background_rasterizer_busy)
+	{
+		SDL_SemWait(background_rasterizer_done);
+		background_rasterizer_busy= false;
+	}
+}
+
+void stop_background_rasterizer(
+	void)
+{
+	if (background_rasterizer)
+	{
+		wait_for_background_rasterizer();
+		
+		background_rasterizer_quit= true;
+		SDL_SemPost(background_rasterizer_start);
+		SDL_WaitThread(background_rasterizer, NULL);
+		background_rasterizer= NULL;
+		background_rasterizer_quit= false;
+	}
+	
+	if (background_rasterizer_start)
+	{
+		SDL_DestroySemaphore(background_rasterizer_start);
+		background_rasterizer_start= NULL;
+	}
+	if (background_rasterizer_done)
+	{
+		SDL_DestroySemaphore(background_rasterizer_done);
+		background_rasterizer_done= NULL;
+	}
+}
+
+static int background_rasterizer_thread(
+	void *)
+{
+	for (;;)
+	{
+		SDL_SemWait(background_rasterizer_start);
+		if (background_rasterizer_quit) break;
+		Rasterizer_SW.Rasterize();
+		SDL_SemPost(background_rasterizer_done);
+	}
+	
+	return 0;
 }
 
 void start_render_effect(
@@ -583,6 +754,7 @@ void check_m1_exploration(void)
 
 		update_view_data(&explore_view);
 		objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
+		render_tree_valid= false;
         // build_render_tree() actually marks the polygons
 		explore_tree.build_render_tree();
 	}
@@ -591,6 +763,20 @@ void check_m1_exploration(void)
 
 /* ---------- private code */
 
+static bool render_tree_is_current(
+	struct view_data *view)
+{
+	struct view_data *last= &render_tree_view;
+	
+	return render_tree_valid && render_tree_geometry_version==map_geometry_version &&
+		view->origin_polygon_index==last->origin_polygon_index &&
+		view->origin.x==last->origin.x && view->origin.y==last->origin.y && view->origin.z==last->origin.z &&
+		view->yaw==last->yaw && view->pitch==last->pitch &&
+		view->screen_width==last->screen_width && view->screen_height==last->screen_height &&
+		view->world_to_screen_x==last->world_to_screen_x && view->world_to_screen_y==last->world_to_screen_y &&
+		view->half_cone==last->half_cone && view->dtanpitch==last->dtanpitch;
+}
+
 static void update_view_data(
 	struct view_data *view)
 {
@@ -186,7 +186,41 @@ extern vector<uint16> RenderFlagList;
 void allocate_render_memory(void);
 
 void initialize_view_data(struct view_data *view, bool ignore_preferences = false);
-void render_view(struct view_data *view, struct bitmap_definition *destination);
+
+// Microseconds spent in each stage of a render_view() call
+struct render_view_timings
+{
+	Uint64 build_render_tree;
+	Uint64 sort_render_tree;
+	Uint64 build_render_object_list;
+	Uint64 render_tree;	// and the weapons in hand, through the rasterizer's End()
+};
+
+// A pipelined view is only recorded; rasterize_view_in_background() then draws it into the
+// destination while the world moves on to the next tick, so what is on screen is at most a
+// tick behind. Only the software renderer pipelines; the others ignore the flag.
+void render_view(struct view_data *view, struct bitmap_definition *destination, struct render_view_timings *timings = NULL, bool pipelined = false);
+void rasterize_view_in_background(void);
+
+// How many render_view() calls built the visibility tree and sorted it, and how many
+// could reuse the last ones because neither the view nor the map had changed; and how
+// many sprites the software renderer skipped because others drawn later hid them; and how
+// many surfaces the shader renderer drew last frame, and how often it switched shader or texture
+struct render_tree_statistics
+{
+	uint32 built;
+	uint32 reused;
+	uint32 occluded_sprites;
+	uint32 surface_draw_calls;
+	uint32 surface_state_changes;
+};
+
+const struct render_tree_statistics& get_render_tree_statistics(void);
+
+// Anything that touches the destination, or the shapes a view was drawn with, waits for it first
+void wait_for_background_rasterizer(void);
+// Waits for it, then ends its thread; the next pipelined view starts another
+void stop_background_rasterizer(void);
 
 void start_render_effect(struct view_data *view, short effect);
 
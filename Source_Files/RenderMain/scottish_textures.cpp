@@ -129,9 +129,13 @@ not only that, but texture_horizontal_polygon() is actually faster than texture_
 
 #include <stdlib.h>
 #include <limits.h>
+#include <vector>
+
+#include <SDL_thread.h>
 
 #include "preferences.h"
 #include "SW_Texture_Extras.h"
+#include "Logging.h"
 
 
 /* ---------- constants */
@@ -235,12 +239,15 @@ static void calculate_shading_table(void * &result,view_data *view, void *shadin
 	right lines of the current polygon), the trapezoid rasterizer (to store the y-coordinates
 	of the top and bottom of the current trapezoid) and the rectangle mapper (for its
 	vertical and if necessary horizontal distortion tables).  these are not necessary as
-	globals, just as global storage. */
-static short *scratch_table0 = NULL, *scratch_table1 = NULL;
-static void *precalculation_table = NULL;
+	globals, just as global storage.  every strip rendering thread has its own set; these
+	are the main thread's. */
+static sw_scratch_tables main_scratch= {NULL, NULL, NULL};
 
 static uint16 texture_random_seed= 6906;
 
+// cleared to run the texture mappers' scalar loops in place of their SIMD ones
+static bool texture_spans_simd= true;
+
 /* ---------- private prototypes */
 
 static void _pretexture_horizontal_polygon_lines(struct polygon_definition *polygon,
@@ -258,6 +265,12 @@ static void _prelandscape_horizontal_polygon_lines(struct polygon_definition *po
 	struct bitmap_definition *screen, struct view_data *view, struct _horizontal_polygon_line_data *data,
 	short y0, short *x0_table, short *x1_table, short line_count);
 
+static void allocate_scratch_tables(sw_scratch_tables& scratch);
+static bool clip_horizontal_polygon_lines(struct _horizontal_polygon_line_data *data, short *x0_table, short *x1_table,
+	short line_count, bool advance_source_y, short left, short right);
+static struct _vertical_polygon_data *clip_vertical_polygon_lines(struct _vertical_polygon_data *data,
+	short *&y0_table, short *&y1_table, short left, short right);
+
 /* ---------- code */
 
 
@@ -278,23 +291,31 @@ inline int NextLowerExponent(int n)
 void allocate_texture_tables(
 	void)
 {
-	scratch_table0= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
-	scratch_table1= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
-	precalculation_table= (void*)new char[MAXIMUM_PRECALCULATION_TABLE_ENTRY_SIZE*MAXIMUM_SCRATCH_TABLE_ENTRIES];
-	assert(scratch_table0&&scratch_table1&&precalculation_table);
+	allocate_scratch_tables(main_scratch);
 }
 
-void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& textured_polygon)
+static void allocate_scratch_tables(
+	sw_scratch_tables& scratch)
+{
+	scratch.table0= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	scratch.table1= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	scratch.precalculation= (void*)new char[MAXIMUM_PRECALCULATION_TABLE_ENTRY_SIZE*MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	assert(scratch.table0&&scratch.table1&&scratch.precalculation);
+}
+
+void Rasterizer_SW_Class::draw_horizontal_polygon(polygon_definition& textured_polygon, sw_scratch_tables& scratch, short left, short right)
 {
 	polygon_definition *polygon = &textured_polygon;	// Reference to pointer
 	short vertex, highest_vertex, lowest_vertex;
 	point2d *vertices= polygon->vertices;
+	short *scratch_table0= scratch.table0, *scratch_table1= scratch.table1;
+	void *precalculation_table= scratch.precalculation;
 
 	assert(polygon->vertex_count>=MINIMUM_VERTICES_PER_SCREEN_POLYGON&&polygon->vertex_count<MAXIMUM_VERTICES_PER_SCREEN_POLYGON);
 
 	/* if we get static, tinted or landscaped transfer modes punt to the vertical polygon mapper */
 	if (polygon->transfer_mode == _static_transfer) {
-		texture_vertical_polygon(textured_polygon);
+		draw_vertical_polygon(textured_polygon, scratch, left, right);
 		return;
 	}
 
@@ -397,6 +418,14 @@ void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& texture
 				vhalt(csprintf(temporary, "horizontal_polygons dont support mode #%d", polygon->transfer_mode));
 		}
 		
+		/* when drawing one strip of the screen, trim every line to it */
+		if (left>0 || right<screen->width)
+		{
+			if (!clip_horizontal_polygon_lines((struct _horizontal_polygon_line_data *)precalculation_table, left_table, right_table,
+					aggregate_total_line_count, polygon->transfer_mode==_textured_transfer, left, right))
+				return;
+		}
+		
 		/* render all lines */
 		switch (bit_depth)
 		{
@@ -501,16 +530,18 @@ void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& texture
 	}
 }
 
-void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_polygon)
+void Rasterizer_SW_Class::draw_vertical_polygon(polygon_definition& textured_polygon, sw_scratch_tables& scratch, short left, short right)
 {
 	polygon_definition *polygon = &textured_polygon;	// Reference to pointer
 	short vertex, highest_vertex, lowest_vertex;
 	point2d *vertices= polygon->vertices;
+	short *scratch_table0= scratch.table0, *scratch_table1= scratch.table1;
+	void *precalculation_table= scratch.precalculation;
 
 	assert(polygon->vertex_count>=MINIMUM_VERTICES_PER_SCREEN_POLYGON&&polygon->vertex_count<MAXIMUM_VERTICES_PER_SCREEN_POLYGON);
 
     if (polygon->transfer_mode == _big_landscaped_transfer) {
-        texture_horizontal_polygon(textured_polygon);
+        draw_horizontal_polygon(textured_polygon, scratch, left, right);
         return;
     }
      
@@ -604,6 +635,13 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
           }
           else vhalt(csprintf(temporary, "vertical_polygons dont support mode #%d", polygon->transfer_mode));
           
+		/* when drawing one strip of the screen, skip the columns outside it */
+		if (left>0 || right<screen->width)
+		{
+			precalculation_table= clip_vertical_polygon_lines((struct _vertical_polygon_data *)precalculation_table, left_table, right_table, left, right);
+			if (!precalculation_table) return;
+		}
+
 		/* render all lines */
 		switch (bit_depth)
 		{
@@ -730,15 +768,17 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
 	}
 }
 
-void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_rectangle)
+void Rasterizer_SW_Class::draw_rectangle(rectangle_definition& textured_rectangle, sw_scratch_tables& scratch, short left, short right)
 {
 	rectangle_definition *rectangle = &textured_rectangle;	// Reference to pointer
+	short *scratch_table0= scratch.table0, *scratch_table1= scratch.table1;
+	void *precalculation_table= scratch.precalculation;
 
 	if (rectangle->x0<rectangle->x1 && rectangle->y0<rectangle->y1)
 	{
-		/* subsume screen boundaries into clipping parameters */
-		if (rectangle->clip_left<0) rectangle->clip_left= 0;
-		if (rectangle->clip_right>screen->width) rectangle->clip_right= screen->width;
+		/* subsume screen (or strip) boundaries into clipping parameters */
+		if (rectangle->clip_left<left) rectangle->clip_left= left;
+		if (rectangle->clip_right>right) rectangle->clip_right= right;
 		if (rectangle->clip_top<0) rectangle->clip_top= 0;
 		if (rectangle->clip_bottom>screen->height) rectangle->clip_bottom= screen->height;
 	
@@ -960,6 +1000,568 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 	}
 }
 
+/* ---------- strip rendering */
+
+/* strips start on multiples of four columns, so that texture_vertical_polygon_lines() groups
+	the same columns together as it does when drawing the whole screen */
+#define STRIP_ALIGNMENT 4
+#define MINIMUM_STRIP_WIDTH 64
+#define MAXIMUM_STRIP_COUNT 16
+
+struct strip_worker
+{
+	SDL_Thread *thread;
+	SDL_sem *start, *done;
+	bool quit;
+	sw_scratch_tables scratch;
+
+	// what to draw when start is posted
+	Rasterizer_SW_Class *rasterizer;
+	size_t first, last;
+	short left, right;
+};
+
+static std::vector<strip_worker *> strip_workers;
+
+// set once a thread couldn't be started, so we don't keep trying every frame
+static size_t strip_worker_limit= MAXIMUM_STRIP_COUNT;
+
+static int strip_worker_thread(
+	void *data)
+{
+	strip_worker *worker= (strip_worker *) data;
+
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+		if (worker->quit) break;
+		worker->rasterizer->draw_strip(worker->first, worker->last, worker->scratch, worker->left, worker->right);
+		SDL_SemPost(worker->done);
+	}
+
+	return 0;
+}
+
+static void free_strip_worker(
+	strip_worker *worker)
+{
+	if (worker->thread)
+	{
+		worker->quit= true;
+		SDL_SemPost(worker->start);
+		SDL_WaitThread(worker->thread, NULL);
+	}
+	if (worker->start) SDL_DestroySemaphore(worker->start);
+	if (worker->done) SDL_DestroySemaphore(worker->done);
+	delete []worker->scratch.table0;
+	delete []worker->scratch.table1;
+	delete [](char *)worker->scratch.precalculation;
+	delete worker;
+}
+
+/* starts or stops threads until there are count of them; returns how many there are */
+static size_t set_strip_worker_count(
+	size_t count)
+{
+	count= MIN(count, strip_worker_limit);
+	
+	while (strip_workers.size()>count)
+	{
+		free_strip_worker(strip_workers.back());
+		strip_workers.pop_back();
+	}
+	
+	while (strip_workers.size()<count)
+	{
+		strip_worker *worker= new strip_worker;
+		worker->thread= NULL;
+		worker->quit= false;
+		worker->start= SDL_CreateSemaphore(0);
+		worker->done= SDL_CreateSemaphore(0);
+		allocate_scratch_tables(worker->scratch);
+		if (worker->start && worker->done) worker->thread= SDL_CreateThread(strip_worker_thread, worker);
+		
+		if (!worker->thread)
+		{
+			logWarning("couldn't start a software rendering thread (%s); using %d", SDL_GetError(), int(strip_workers.size())+1);
+			free_strip_worker(worker);
+			strip_worker_limit= strip_workers.size();
+			break;
+		}
+		
+		strip_workers.push_back(worker);
+	}
+	
+	return strip_workers.size();
+}
+
+void Rasterizer_SW_Class::Begin()
+{
+	int strip_count= graphics_preferences->software_render_threads;
+	if (strip_count<=0) strip_count= get_processor_count();
+	strip_count= MIN(strip_count, MAXIMUM_STRIP_COUNT);
+	strip_count= MIN(strip_count, screen->width/MINIMUM_STRIP_WIDTH);
+	strip_count= MAX(strip_count, 1);
+	
+	commands.clear();
+	polygons.clear();
+	rectangles.clear();
+	set_strip_worker_count(strip_count-1);
+	recording= true;
+}
+
+void Rasterizer_SW_Class::End()
+{
+	if (!recording) return;
+	
+	if (deferred)
+	{
+		deferred_view= *view;
+		view= &deferred_view;
+		return;
+	}
+	Rasterize();
+}
+
+void Rasterizer_SW_Class::Rasterize()
+{
+	if (!recording) return;
+	recording= false;
+	
+	cull_occluded_rectangles();
+	
+	/* static takes its noise from a single sequence of random numbers, in drawing order, so
+		it can't be split up; draw everything before it in strips, then it across the screen */
+	size_t first= 0;
+	for (size_t i= 0; i<commands.size(); ++i)
+	{
+		if (commands[i].serial)
+		{
+			draw_strips(first, i);
+			draw_strip(i, i+1, main_scratch, 0, screen->width);
+			first= i+1;
+		}
+	}
+	draw_strips(first, commands.size());
+	
+	commands.clear();
+	polygons.clear();
+	rectangles.clear();
+}
+
+void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& textured_polygon)
+{
+	if (recording)
+		record_polygon(_horizontal_polygon_command, textured_polygon);
+	else
+		draw_horizontal_polygon(textured_polygon, main_scratch, 0, screen->width);
+}
+
+void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_polygon)
+{
+	if (recording)
+		record_polygon(_vertical_polygon_command, textured_polygon);
+	else
+		draw_vertical_polygon(textured_polygon, main_scratch, 0, screen->width);
+}
+
+void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_rectangle)
+{
+	if (recording)
+	{
+		command c;
+		c.type= _rectangle_command;
+		c.left= MAX(textured_rectangle.x0, textured_rectangle.clip_left);
+		c.right= MIN(textured_rectangle.x1, textured_rectangle.clip_right);
+		c.serial= textured_rectangle.transfer_mode==_static_transfer;
+		c.culled= false;
+		c.index= rectangles.size();
+		rectangles.push_back(textured_rectangle);
+		commands.push_back(c);
+	}
+	else
+	{
+		draw_rectangle(textured_rectangle, main_scratch, 0, screen->width);
+	}
+}
+
+void Rasterizer_SW_Class::record_polygon(int16 type, polygon_definition& textured_polygon)
+{
+	command c;
+	c.type= type;
+	c.left= SHRT_MAX;
+	c.right= SHRT_MIN;
+	for (short vertex= 0; vertex<textured_polygon.vertex_count; ++vertex)
+	{
+		c.left= MIN(c.left, textured_polygon.vertices[vertex].x);
+		c.right= MAX(c.right, textured_polygon.vertices[vertex].x+1);
+	}
+	c.serial= textured_polygon.transfer_mode==_static_transfer;
+	c.culled= false;
+	c.index= polygons.size();
+	polygons.push_back(textured_polygon);
+	commands.push_back(c);
+}
+
+void Rasterizer_SW_Class::draw_strip(size_t first, size_t last, sw_scratch_tables& scratch, short left, short right)
+{
+	for (size_t i= first; i<last; ++i)
+	{
+		const command& c= commands[i];
+		if (c.culled || c.right<=left || c.left>=right) continue;
+		
+		switch (c.type)
+		{
+			case _horizontal_polygon_command:
+				draw_horizontal_polygon(polygons[c.index], scratch, left, right);
+				break;
+			
+			case _vertical_polygon_command:
+				draw_vertical_polygon(polygons[c.index], scratch, left, right);
+				break;
+			
+			case _rectangle_command:
+			{
+				/* draw_rectangle() clips the rectangle it's given, so every strip needs a copy */
+				rectangle_definition rectangle= rectangles[c.index];
+				draw_rectangle(rectangle, scratch, left, right);
+				break;
+			}
+			
+			default:
+				assert(false);
+				break;
+		}
+	}
+}
+
+/* ---------- sprite occlusion */
+
+/* crowds of monsters, and the weapons in hand, draw over one another a lot.  walking the commands
+	from the last one drawn back, every column remembers the run of rows the sprites drawn after
+	the current one cover with opaque texels; a sprite whose every column is inside those runs
+	would be drawn over completely, so it isn't drawn at all.  only textured sprites cover
+	anything, since tinted ones blend with what's under them and static ones are rare; static
+	ones are never skipped either, since that would change the noise of any drawn after them. */
+
+void Rasterizer_SW_Class::cull_occluded_rectangles()
+{
+	covered_top.assign(screen->width, 0);
+	covered_bottom.assign(screen->width, 0);
+	
+	for (size_t i= commands.size(); i-->0; )
+	{
+		command& c= commands[i];
+		if (c.type!=_rectangle_command || c.serial) continue;
+		
+		/* clip it the same way draw_rectangle() will */
+		const rectangle_definition& rectangle= rectangles[c.index];
+		short left= MAX(MAX(rectangle.clip_left, rectangle.x0), 0);
+		short right= MIN(MIN(rectangle.clip_right, rectangle.x1), screen->width);
+		short top= MAX(MAX(rectangle.clip_top, rectangle.y0), 0);
+		short bottom= MIN(MIN(rectangle.clip_bottom, rectangle.y1), screen->height);
+		if (left>=right || top>=bottom) continue;
+		
+		short x;
+		for (x= left; x<right; ++x)
+		{
+			if (covered_top[x]>top || covered_bottom[x]<bottom) break;
+		}
+		if (x==right)
+		{
+			c.culled= true;
+			occluded_rectangles+= 1;
+			continue;
+		}
+		
+		if (rectangle.transfer_mode==_textured_transfer) cover_columns(rectangle, left, right, top, bottom);
+	}
+}
+
+/* adds the rows of [top, bottom) that the rectangle's opaque texels cover in each column of
+	[left, right), stepping through the texture exactly as draw_rectangle() does */
+void Rasterizer_SW_Class::cover_columns(
+	const rectangle_definition& rectangle,
+	short left,
+	short right,
+	short top,
+	short bottom)
+{
+	struct bitmap_definition *texture= rectangle.texture;
+	_fixed texture_dx= INTEGER_TO_FIXED(texture->width)/(rectangle.x1-rectangle.x0);
+	_fixed texture_dy= INTEGER_TO_FIXED(texture->height)/(rectangle.y1-rectangle.y0);
+	if (!texture_dx || !texture_dy) return;
+	
+	_fixed texture_x= texture_dx>>1;
+	if (rectangle.flip_horizontal)
+	{
+		texture_dx= -texture_dx;
+		texture_x= INTEGER_TO_FIXED(texture->width)+(texture_dx>>1);
+	}
+	texture_x+= (left-rectangle.x0)*texture_dx;
+	
+	short last_column= NONE, solid_top= 0, solid_bottom= 0;
+	for (short x= left; x<right; ++x, texture_x+= texture_dx)
+	{
+		short column= FIXED_INTEGERAL_PART(texture_x);
+		if (column!=last_column)
+		{
+			/* the longest run of opaque texels in this column, as screen rows */
+			byte *read= texture->row_addresses[column];
+			short first= (read[0]<<8) | read[1];
+			short last= (read[2]<<8) | read[3];
+			short run_start= first, best_start= 0, best_end= 0;
+			
+			read+= 4;
+			for (short row= first; row<=last; ++row)
+			{
+				if (row==last || !read[row-first])
+				{
+					if (row-run_start>best_end-best_start) best_start= run_start, best_end= row;
+					run_start= row+1;
+				}
+			}
+			
+			/* screen row y reads texel row ((y-y0)*texture_dy)>>FIXED_FRACTIONAL_BITS; draw_rectangle()
+				can round a row off either end of the column's run, so leave one row off each end */
+			solid_top= rectangle.y0 + (INTEGER_TO_FIXED(best_start)+texture_dy-1)/texture_dy + 1;
+			solid_bottom= rectangle.y0 + (INTEGER_TO_FIXED(best_end)+texture_dy-1)/texture_dy - 1;
+			solid_top= MAX(solid_top, top);
+			solid_bottom= MIN(solid_bottom, bottom);
+			last_column= column;
+		}
+		if (solid_top>=solid_bottom) continue;
+		
+		/* keep one run per column: the union if they touch, otherwise the longer */
+		if (solid_top<=covered_bottom[x] && solid_bottom>=covered_top[x])
+		{
+			covered_top[x]= MIN(covered_top[x], solid_top);
+			covered_bottom[x]= MAX(covered_bottom[x], solid_bottom);
+		}
+		else if (solid_bottom-solid_top>covered_bottom[x]-covered_top[x])
+		{
+			covered_top[x]= solid_top;
+			covered_bottom[x]= solid_bottom;
+		}
+	}
+}
+
+/* draws [first, last) with the screen split into one strip per thread, this one included */
+void Rasterizer_SW_Class::draw_strips(size_t first, size_t last)
+{
+	if (first==last) return;
+	
+	short strip_count= strip_workers.size()+1;
+	short strip_width= (screen->width+strip_count-1)/strip_count;
+	strip_width= (strip_width+STRIP_ALIGNMENT-1)&~(STRIP_ALIGNMENT-1);
+	
+	size_t started= 0;
+	for (size_t i= 0; i<strip_workers.size(); ++i)
+	{
+		short strip_left= (i+1)*strip_width;
+		if (strip_left>=screen->width) break;
+		
+		strip_worker *worker= strip_workers[i];
+		worker->rasterizer= this;
+		worker->first= first, worker->last= last;
+		worker->left= strip_left, worker->right= MIN(strip_left+strip_width, screen->width);
+		SDL_SemPost(worker->start);
+		started+= 1;
+	}
+	
+	draw_strip(first, last, main_scratch, 0, MIN(strip_width, screen->width));
+	
+	for (size_t i= 0; i<started; ++i)
+	{
+		SDL_SemWait(strip_workers[i]->done);
+	}
+}
+
+/* ---------- texture mapper benchmark */
+
+#define BENCHMARK_WIDTH 640
+#define BENCHMARK_HEIGHT 480
+#define BENCHMARK_TEXTURE_SIZE 128
+#define BENCHMARK_MILLISECONDS 500
+
+struct texture_benchmark
+{
+	bitmap_definition *screen, *texture;
+	struct _horizontal_polygon_line_data *horizontal;
+	struct _vertical_polygon_data *vertical;
+	short *x0_table, *x1_table, *y0_table, *y1_table;
+	uint8 *opacity_table;
+};
+
+template <int sw_alpha_blend>
+static void benchmark_horizontal_lines(texture_benchmark& benchmark)
+{
+	texture_horizontal_polygon_lines<pixel32, sw_alpha_blend>(benchmark.texture, benchmark.screen, NULL, benchmark.horizontal,
+		0, benchmark.x0_table, benchmark.x1_table, BENCHMARK_HEIGHT, benchmark.opacity_table);
+}
+
+template <int sw_alpha_blend, bool check_transparent>
+static void benchmark_vertical_lines(texture_benchmark& benchmark)
+{
+	texture_vertical_polygon_lines<pixel32, sw_alpha_blend, check_transparent>(benchmark.screen, NULL, benchmark.vertical,
+		benchmark.y0_table, benchmark.y1_table, benchmark.opacity_table);
+}
+
+static bitmap_definition *new_benchmark_bitmap(short width, short height, short bytes_per_row, pixel8 *pixels)
+{
+	bitmap_definition *bitmap= (bitmap_definition *) new char[sizeof(bitmap_definition)+height*sizeof(pixel8 *)];
+	
+	obj_clear(*bitmap);
+	bitmap->width= width, bitmap->height= height;
+	bitmap->bytes_per_row= bytes_per_row;
+	bitmap->bit_depth= 8;
+	for (short row= 0; row<height; ++row) bitmap->row_addresses[row]= pixels + row*bytes_per_row;
+	
+	return bitmap;
+}
+
+static uint32 checksum_benchmark_screen(SDL_Surface *surface)
+{
+	uint32 checksum= 2166136261U;
+	
+	for (int row= 0; row<surface->h; ++row)
+	{
+		pixel32 *pixels= (pixel32 *)((byte *)surface->pixels + row*surface->pitch);
+		for (int column= 0; column<surface->w; ++column) checksum= (checksum^pixels[column])*16777619U;
+	}
+	
+	return checksum;
+}
+
+/* times the 32-bit texture mappers over a synthetic screenful, with and without SIMD, and prints
+	Mpixels/s for each; the screens the two produce are compared as well */
+void benchmark_texture_spans(
+	void)
+{
+	static const struct
+	{
+		const char *name;
+		void (*draw)(texture_benchmark&);
+		bool vertical;
+	} kernels[]=
+	{
+		{"horizontal", benchmark_horizontal_lines<_sw_alpha_off>, false},
+		{"horizontal fast alpha", benchmark_horizontal_lines<_sw_alpha_fast>, false},
+		{"horizontal nice alpha", benchmark_horizontal_lines<_sw_alpha_nice>, false},
+		{"vertical", benchmark_vertical_lines<_sw_alpha_off, false>, true},
+		{"vertical transparent", benchmark_vertical_lines<_sw_alpha_off, true>, true},
+		{"vertical fast alpha", benchmark_vertical_lines<_sw_alpha_fast, true>, true},
+		{"vertical nice alpha", benchmark_vertical_lines<_sw_alpha_nice, true>, true}
+	};
+	
+	extern SDL_Surface *world_pixels;
+	SDL_Surface *saved_world_pixels= world_pixels;
+	bool saved_texture_spans_simd= texture_spans_simd;
+	
+	world_pixels= SDL_CreateRGBSurface(SDL_SWSURFACE, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 32, 0xff0000, 0xff00, 0xff, 0);
+	if (!world_pixels)
+	{
+		printf("Couldn't allocate a %dx%d surface: %s\n", BENCHMARK_WIDTH, BENCHMARK_HEIGHT, SDL_GetError());
+		world_pixels= saved_world_pixels;
+		return;
+	}
+	
+	std::vector<pixel8> texels(BENCHMARK_TEXTURE_SIZE*BENCHMARK_TEXTURE_SIZE);
+	std::vector<pixel32> shading_table(MAXIMUM_SHADING_TABLE_INDEXES);
+	std::vector<uint8> opacity_table(MAXIMUM_SHADING_TABLE_INDEXES);
+	for (size_t i= 0; i<texels.size(); ++i) texels[i]= (i%11) ? rand() : 0;
+	for (size_t i= 0; i<shading_table.size(); ++i) shading_table[i]= (rand()<<16)^rand();
+	for (size_t i= 0; i<opacity_table.size(); ++i) opacity_table[i]= rand();
+	
+	texture_benchmark benchmark;
+	benchmark.screen= new_benchmark_bitmap(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, world_pixels->pitch, (pixel8 *) world_pixels->pixels);
+	benchmark.texture= new_benchmark_bitmap(BENCHMARK_TEXTURE_SIZE, BENCHMARK_TEXTURE_SIZE, BENCHMARK_TEXTURE_SIZE, &texels[0]);
+	benchmark.opacity_table= &opacity_table[0];
+	
+	/* every row of the screen is a horizontal line with its own texture coordinates */
+	std::vector<struct _horizontal_polygon_line_data> horizontal(BENCHMARK_HEIGHT);
+	std::vector<short> x0_table(BENCHMARK_HEIGHT, 0), x1_table(BENCHMARK_HEIGHT, BENCHMARK_WIDTH);
+	for (int row= 0; row<BENCHMARK_HEIGHT; ++row)
+	{
+		horizontal[row].source_x= row*0x01234567U;
+		horizontal[row].source_y= row*0x00765432U;
+		horizontal[row].source_dx= (1U<<(HORIZONTAL_WIDTH_DOWNSHIFT-1)) + row*4099;
+		horizontal[row].source_dy= (1U<<(HORIZONTAL_HEIGHT_DOWNSHIFT-2)) - row*2053;
+		horizontal[row].shading_table= &shading_table[0];
+	}
+	benchmark.horizontal= &horizontal[0];
+	benchmark.x0_table= &x0_table[0], benchmark.x1_table= &x1_table[0];
+	
+	/* and every column a vertical one, with ragged tops and bottoms */
+	std::vector<byte> vertical(sizeof(struct _vertical_polygon_data) + BENCHMARK_WIDTH*sizeof(struct _vertical_polygon_line_data));
+	std::vector<short> y0_table(BENCHMARK_WIDTH), y1_table(BENCHMARK_WIDTH);
+	int vertical_pixels= 0;
+	benchmark.vertical= (struct _vertical_polygon_data *) &vertical[0];
+	benchmark.vertical->downshift= VERTICAL_TEXTURE_DOWNSHIFT;
+	benchmark.vertical->x0= 0;
+	benchmark.vertical->width= BENCHMARK_WIDTH;
+	for (int column= 0; column<BENCHMARK_WIDTH; ++column)
+	{
+		struct _vertical_polygon_line_data *line= (struct _vertical_polygon_line_data *) (benchmark.vertical+1) + column;
+		
+		line->shading_table= &shading_table[0];
+		line->texture= &texels[(column%BENCHMARK_TEXTURE_SIZE)*BENCHMARK_TEXTURE_SIZE];
+		line->texture_y= column*0x00345678U;
+		line->texture_dy= (BENCHMARK_TEXTURE_SIZE<<VERTICAL_TEXTURE_FREE_BITS)/(BENCHMARK_HEIGHT/2) + column*31;
+		y0_table[column]= (column*37)%24;
+		y1_table[column]= BENCHMARK_HEIGHT - (column*53)%24;
+		vertical_pixels+= y1_table[column] - y0_table[column];
+	}
+	benchmark.y0_table= &y0_table[0], benchmark.y1_table= &y1_table[0];
+	
+#ifdef SSE2_TEXTURE_SPANS
+	const int pass_count= 2;
+	printf("%-24s %16s %16s\n", "", "scalar", "SSE2");
+#else
+	const int pass_count= 1;
+	printf("%-24s %16s\n", "", "scalar");
+#endif
+	for (size_t k= 0; k<sizeof(kernels)/sizeof(kernels[0]); ++k)
+	{
+		int pixels= kernels[k].vertical ? vertical_pixels : BENCHMARK_WIDTH*BENCHMARK_HEIGHT;
+		uint32 checksums[2];
+		
+		printf("%-24s", kernels[k].name);
+		for (int pass= 0; pass<pass_count; ++pass)
+		{
+			texture_spans_simd= pass>0;
+			
+			/* a known background, since the alpha modes blend with it */
+			for (int row= 0; row<BENCHMARK_HEIGHT; ++row)
+			{
+				pixel32 *write= (pixel32 *) benchmark.screen->row_addresses[row];
+				for (int column= 0; column<BENCHMARK_WIDTH; ++column) write[column]= (row*0x010203)^(column*0x030201);
+			}
+			kernels[k].draw(benchmark);
+			checksums[pass]= checksum_benchmark_screen(world_pixels);
+			
+			int frames= 0;
+			uint32 start= machine_tick_count(), elapsed;
+			do
+			{
+				kernels[k].draw(benchmark);
+				frames+= 1;
+				elapsed= machine_tick_count() - start;
+			}
+			while (elapsed<BENCHMARK_MILLISECONDS);
+			
+			printf(" %10.1f Mpx/s", double(frames)*pixels/(elapsed*1000.0));
+		}
+		printf("%s\n", (pass_count>1 && checksums[0]!=checksums[1]) ? "  (results differ!)" : "");
+	}
+	
+	delete [](char *)benchmark.screen;
+	delete [](char *)benchmark.texture;
+	SDL_FreeSurface(world_pixels);
+	world_pixels= saved_world_pixels;
+	texture_spans_simd= saved_texture_spans_simd;
+}
+
 /* ---------- private code */
 
 /* starting at x0 and for line_count vertical lines between *y0 and *y1, precalculate all the
@@ -1366,3 +1968,67 @@ static short *build_y_table(
 	
 	return table;
 }
+
+/* trims the lines of a precalculated horizontal polygon to the columns [left, right), moving the
+	texture coordinates of lines that lose their left end along with them; false if nothing's left */
+static bool clip_horizontal_polygon_lines(
+	struct _horizontal_polygon_line_data *data,
+	short *x0_table,
+	short *x1_table,
+	short line_count,
+	bool advance_source_y,
+	short left,
+	short right)
+{
+	bool visible= false;
+	
+	while ((line_count-= 1)>=0)
+	{
+		short x0= *x0_table, x1= *x1_table;
+		
+		if (x0<left)
+		{
+			uint32 skipped= left-x0;
+			
+			data->source_x+= skipped*data->source_dx;
+			if (advance_source_y) data->source_y+= skipped*data->source_dy;
+			x0= left;
+		}
+		if (x1>right) x1= right;
+		if (x1>x0) visible= true; else x1= x0;
+		
+		*x0_table++= x0, *x1_table++= x1;
+		data+= 1;
+	}
+	
+	return visible;
+}
+
+/* drops the columns of a precalculated vertical polygon outside [left, right); returns the header
+	to draw with (moved to just before the first column kept) or NULL if no columns are left */
+static struct _vertical_polygon_data *clip_vertical_polygon_lines(
+	struct _vertical_polygon_data *data,
+	short *&y0_table,
+	short *&y1_table,
+	short left,
+	short right)
+{
+	struct _vertical_polygon_line_data *line= (struct _vertical_polygon_line_data *) (data+1);
+	short first= MAX(left-data->x0, 0);
+	short last= MIN(right-data->x0, data->width);
+	
+	if (first>=last) return NULL;
+	
+	if (first>0)
+	{
+		struct _vertical_polygon_data *header= ((struct _vertical_polygon_data *) (line+first)) - 1;
+		
+		*header= *data;
+		data= header;
+		y0_table+= first, y1_table+= first;
+	}
+	data->x0+= first;
+	data->width= last-first;
+	
+	return data;
+}
@@ -205,4 +205,7 @@ extern short number_of_shading_tables, shading_table_fractional_bits, shading_ta
 
 void allocate_texture_tables(void);
 
+// Times the 32-bit texture mappers and prints the results to stdout
+void benchmark_texture_spans(void);
+
 #endif
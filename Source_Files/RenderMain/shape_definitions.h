@@ -30,6 +30,8 @@ Aug 14, 2000 (Loren Petrich):
 
 /* ---------- structures */
 
+struct shading_table_set;
+
 struct collection_header /* 32 bytes on disk */
 {
 	int16 status;
@@ -40,7 +42,7 @@ struct collection_header /* 32 bytes on disk */
 
 	// LP: handles to pointers
 	collection_definition *collection;
-	byte *shading_tables;
+	shading_table_set *shading_tables;	// built on first use
 };
 const int SIZEOF_collection_header = 32;
 
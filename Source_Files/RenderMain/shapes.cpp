@@ -113,6 +113,7 @@ Jan 17, 2001 (Loren Petrich):
 
 #include <SDL_rwops.h>
 #include <memory>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -169,6 +170,33 @@ static pixel32 *global_shading_table32= (pixel32 *) NULL;
 
 short number_of_shading_tables, shading_table_fractional_bits, shading_table_size;
 
+// Most alternate CLUTs and tints never show up in a given level, so update_color_environment()
+// only writes down how each table would be built, and the table itself is built the first
+// time somebody asks for it. The colors are copied because later collections can still
+// change the flags of the ones they share.
+struct shading_table_recipe
+{
+	std::vector<rgb_color_value> colors;
+	short bit_depth;
+	short tint_color;	// NONE for shading tables
+	bool is_opengl;
+	bool remapped;		// alternate CLUT: the primary one's colors, remapped
+	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS];
+
+	void *table;		// NULL until it is first used
+	int32 size;
+
+	shading_table_recipe() : bit_depth(0), tint_color(NONE), is_opengl(false), remapped(false), table(NULL), size(0) {}
+};
+
+struct shading_table_set
+{
+	std::vector<shading_table_recipe> cluts;
+	shading_table_recipe tints[NUMBER_OF_TINT_TABLES];
+};
+
+static shading_table_statistics shading_statistics;
+
 // LP addition: opened-shapes-file object
 static OpenedFile ShapesFile;
 static OpenedResourceFile M1ShapesFile;
@@ -197,6 +225,11 @@ static bool new_color_run(struct rgb_color_value *_new, struct rgb_color_value *
 
 static int32 get_shading_table_size(short collection_code);
 
+static void set_shading_table_recipe(struct shading_table_recipe& recipe, struct rgb_color_value *colors, short color_count, short bit_depth, pixel8 *remapping_table, bool is_opengl);
+static void *build_shading_table(short collection_index, struct shading_table_recipe& recipe, bool tint);
+static void release_shading_table(struct shading_table_recipe& recipe);
+static void free_shading_tables(struct collection_header *header);
+
 static void build_collection_tinting_table(struct rgb_color_value *colors, short color_count, short collection_index, bool is_opengl);
 static void build_tinting_table8(struct rgb_color_value *colors, short color_count, pixel8 *tint_table, short tint_start, short tint_count);
 static void build_tinting_table16(struct rgb_color_value *colors, short color_count, pixel16 *tint_table, struct rgb_color *tint_color);
@@ -731,15 +764,36 @@ static void load_bitmap(std::vector<uint8>& bitmap, SDL_RWops *p, int version)
 static void allocate_shading_tables(short collection_index, bool strip)
 {
 	collection_header *header = get_collection_header(collection_index);
-	// Allocate enough space for this collection's shading tables
-	if (strip)
-		header->shading_tables = NULL;
-	else {
+	free_shading_tables(header);
+	// Make room to describe this collection's shading tables; they're built on first use
+	if (!strip) {
 		collection_definition *definition = get_collection_definition(collection_index);
-		header->shading_tables = (byte *)malloc(get_shading_table_size(collection_index) * definition->clut_count + shading_table_size * NUMBER_OF_TINT_TABLES);
+		header->shading_tables = new shading_table_set;
+		header->shading_tables->cluts.resize(definition->clut_count);
+		shading_statistics.tables += definition->clut_count + NUMBER_OF_TINT_TABLES;
 	}
 }
 
+static void free_shading_tables(struct collection_header *header)
+{
+	shading_table_set *tables = header->shading_tables;
+	if (!tables) return;
+
+	for (size_t clut_index = 0; clut_index < tables->cluts.size(); ++clut_index)
+		release_shading_table(tables->cluts[clut_index]);
+	for (int tint_index = 0; tint_index < NUMBER_OF_TINT_TABLES; ++tint_index)
+		release_shading_table(tables->tints[tint_index]);
+	shading_statistics.tables -= tables->cluts.size() + NUMBER_OF_TINT_TABLES;
+
+	delete tables;
+	header->shading_tables = NULL;
+}
+
+const shading_table_statistics& get_shading_table_statistics()
+{
+	return shading_statistics;
+}
+
 /*
  *  Load collection
  */
@@ -856,9 +910,8 @@ static void unload_collection(struct collection_header *header)
 {
 	assert(header->collection);
 	delete header->collection;
-	free(header->shading_tables);
+	free_shading_tables(header);
 	header->collection = NULL;
-	header->shading_tables = NULL;
 }
 
 #define ENDC_TAG FOUR_CHARS_TO_INT('e', 'n', 'd', 'c')
@@ -1139,6 +1192,7 @@ void unload_all_collections(
 	struct collection_header *header;
 	short collection_index;
 	
+	wait_for_background_rasterizer();
 	for (collection_index= 0, header= collection_headers; collection_index<MAXIMUM_COLLECTIONS; ++collection_index, ++header)
 	{
 		if (collection_loaded(header))
@@ -1374,6 +1428,8 @@ void load_collections(
 //		open_progress_dialog(_loading_collections);
 //		draw_progress_bar(0, 2*MAXIMUM_COLLECTIONS);
 	}
+	// a pipelined view may still be drawing with the shapes about to be unloaded
+	wait_for_background_rasterizer();
 	precalculate_bit_depth_constants();
 	
 	free_and_unlock_memory(); /* do our best to get a big, unfragmented heap */
@@ -1494,6 +1550,8 @@ void load_replacement_collections()
 			OGL_LoadModelsImages(collection_index);
 		}
 	}
+	
+	OGL_LogTextureLoading();
 }
 
 #endif
@@ -1642,17 +1700,16 @@ static void update_color_environment(
 				remap_bitmap(bitmap, remapping_table);
 			}
 			
-			/* build a shading table for each clut in this collection */
+			/* describe a shading table for each clut in this collection; they get built on first use */
+			shading_table_set *shading_tables= get_collection_header(collection_index)->shading_tables;
 			for (clut_index= 0; clut_index<collection->clut_count; ++clut_index)
 			{
-				void *primary_shading_table= get_collection_shading_tables(collection_index, 0);
 				short collection_bit_depth= collection->type==_interface_collection ? 8 : bit_depth;
 
 				if (clut_index)
 				{
 					struct rgb_color_value *alternate_colors= get_collection_colors(collection_index, clut_index)+NUMBER_OF_PRIVATE_COLORS;
 					assert(alternate_colors);
-					void *alternate_shading_table= get_collection_shading_tables(collection_index, clut_index);
 					pixel8 shading_remapping_table[PIXEL8_MAXIMUM_COLORS];
 					
 					memset(shading_remapping_table, 0, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
@@ -1669,39 +1726,11 @@ static void update_color_environment(
 					}
 //					shading_remapping_table[iBLACK]= iBLACK; /* make iBLACK==>iBLACK remapping explicit */
 
-					switch (collection_bit_depth)
-					{
-						case 8:
-							/* duplicate the primary shading table and remap it */
-							memcpy(alternate_shading_table, primary_shading_table, get_shading_table_size(collection_index));
-							map_bytes((unsigned char *)alternate_shading_table, shading_remapping_table, get_shading_table_size(collection_index));
-							break;
-						
-						case 16:
-							build_shading_tables16(colors, color_count, (pixel16 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						case 32:
-							build_shading_tables32(colors, color_count, (pixel32 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						default:
-							assert(false);
-							break;
-					}
+					set_shading_table_recipe(shading_tables->cluts[clut_index], colors, color_count, collection_bit_depth, shading_remapping_table, is_opengl);
 				}
 				else
 				{
-					/* build the primary shading table */
-					switch (collection_bit_depth)
-					{
-					case 8: build_shading_tables8(colors, color_count, (unsigned char *)primary_shading_table); break;
-					case 16: build_shading_tables16(colors, color_count, (pixel16 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-					case 32: build_shading_tables32(colors, color_count,  (pixel32 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-						default:
-							assert(false);
-							break;
-					}
+					set_shading_table_recipe(shading_tables->cluts[clut_index], colors, color_count, collection_bit_depth, NULL, is_opengl);
 				}
 			}
 			
@@ -2131,7 +2160,7 @@ static void build_collection_tinting_table(
 	struct collection_definition *collection= get_collection_definition(collection_index);
 	if (!collection) return;
 	
-	void *tint_table= get_collection_tint_tables(collection_index, 0);
+	shading_table_recipe& tint_table= get_collection_header(collection_index)->shading_tables->tints[0];
 	short tint_color;
 
 	/* get the tint color */
@@ -2151,26 +2180,133 @@ static void build_collection_tinting_table(
 #ifdef HAVE_OPENGL
 		OGL_SetInfravisionTint(collection_index,true,Color.red/65535.0F,Color.green/65535.0F,Color.blue/65535.0F);
 #endif
-		switch (bit_depth)
+	}
+	else
+	{
+		// LP addition: OpenGL support
+#ifdef HAVE_OPENGL
+		OGL_SetInfravisionTint(collection_index,false,1,1,1);
+#endif
+	}
+
+	/* the tint table itself is built on first use */
+	set_shading_table_recipe(tint_table, colors, color_count, bit_depth, NULL, is_opengl);
+	tint_table.tint_color= tint_color;
+}
+
+static void set_shading_table_recipe(
+	struct shading_table_recipe& recipe,
+	struct rgb_color_value *colors,
+	short color_count,
+	short bit_depth,
+	pixel8 *remapping_table,
+	bool is_opengl)
+{
+	release_shading_table(recipe);
+
+	recipe.colors.assign(colors, colors+color_count);
+	recipe.bit_depth= bit_depth;
+	recipe.tint_color= NONE;
+	recipe.is_opengl= is_opengl;
+	recipe.remapped= remapping_table!=NULL;
+	if (remapping_table) memcpy(recipe.remapping_table, remapping_table, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
+}
+
+static void release_shading_table(
+	struct shading_table_recipe& recipe)
+{
+	if (recipe.table)
+	{
+		free(recipe.table);
+		recipe.table= NULL;
+
+		shading_statistics.built--;
+		shading_statistics.bytes-= recipe.size;
+	}
+}
+
+/* builds the table a recipe describes, exactly as update_color_environment() would have */
+static void *build_shading_table(
+	short collection_index,
+	struct shading_table_recipe& recipe,
+	bool tint)
+{
+	int32 size= tint ? shading_table_size : get_shading_table_size(collection_index);
+	
+	// a collection without bitmaps never gets a recipe, and used to get garbage; zeros will do
+	void *table= calloc(1, size);
+	if (!table) return NULL;
+
+	struct rgb_color_value *colors= recipe.colors.empty() ? NULL : &recipe.colors[0];
+	short color_count= static_cast<short>(recipe.colors.size());
+
+	if (tint)
+	{
+		short tint_color= recipe.tint_color;
+		if (tint_color!=NONE)
+		{
+			switch (recipe.bit_depth)
+			{
+				case 8:
+					build_tinting_table8(colors, color_count, (unsigned char *)table, tint_colors8[tint_color].start, tint_colors8[tint_color].count);
+					break;
+				case 16:
+					build_tinting_table16(colors, color_count, (pixel16 *)table, tint_colors16+tint_color);
+					break;
+				case 32:
+					build_tinting_table32(colors, color_count, (pixel32 *)table, tint_colors16+tint_color, recipe.is_opengl);
+					break;
+			}
+		}
+	}
+	else if (recipe.remapped)
+	{
+		switch (recipe.bit_depth)
 		{
 			case 8:
-				build_tinting_table8(colors, color_count, (unsigned char *)tint_table, tint_colors8[tint_color].start, tint_colors8[tint_color].count);
+			{
+				/* duplicate the primary shading table and remap it */
+				void *primary_shading_table= get_collection_shading_tables(collection_index, 0);
+				if (!primary_shading_table) break;
+				memcpy(table, primary_shading_table, size);
+				map_bytes((unsigned char *)table, recipe.remapping_table, size);
 				break;
+			}
+			
 			case 16:
-				build_tinting_table16(colors, color_count, (pixel16 *)tint_table, tint_colors16+tint_color);
+				build_shading_tables16(colors, color_count, (pixel16 *)table, recipe.remapping_table, recipe.is_opengl);
 				break;
+			
 			case 32:
-				build_tinting_table32(colors, color_count, (pixel32 *)tint_table, tint_colors16+tint_color, is_opengl);
+				build_shading_tables32(colors, color_count, (pixel32 *)table, recipe.remapping_table, recipe.is_opengl);
+				break;
+			
+			default:
+				assert(false);
 				break;
 		}
 	}
 	else
 	{
-		// LP addition: OpenGL support
-#ifdef HAVE_OPENGL
-		OGL_SetInfravisionTint(collection_index,false,1,1,1);
-#endif
+		/* the primary shading table */
+		switch (recipe.bit_depth)
+		{
+			case 8: build_shading_tables8(colors, color_count, (unsigned char *)table); break;
+			case 16: build_shading_tables16(colors, color_count, (pixel16 *)table, (byte *) NULL, recipe.is_opengl); break;
+			case 32: build_shading_tables32(colors, color_count, (pixel32 *)table, (byte *) NULL, recipe.is_opengl); break;
+			case 0: break;
+			default:
+				assert(false);
+				break;
+		}
 	}
+
+	recipe.table= table;
+	recipe.size= size;
+	shading_statistics.built++;
+	shading_statistics.bytes+= size;
+
+	return table;
 }
 
 static void build_tinting_table8(
@@ -2343,11 +2479,14 @@ static void *get_collection_shading_tables(
 	short collection_index,
 	short clut_index)
 {
-	void *shading_tables= get_collection_header(collection_index)->shading_tables;
+	shading_table_set *shading_tables= get_collection_header(collection_index)->shading_tables;
+	if (!shading_tables || shading_tables->cluts.empty()) return NULL;
 
-	shading_tables = (uint8 *)shading_tables + clut_index*get_shading_table_size(collection_index);
+	// an out-of-range CLUT gets the primary one
+	if (clut_index<0 || clut_index>=static_cast<short>(shading_tables->cluts.size())) clut_index= 0;
 	
-	return shading_tables;
+	shading_table_recipe& recipe= shading_tables->cluts[clut_index];
+	return recipe.table ? recipe.table : build_shading_table(collection_index, recipe, false);
 }
 
 static void *get_collection_tint_tables(
@@ -2357,11 +2496,11 @@ static void *get_collection_tint_tables(
 	struct collection_definition *definition= get_collection_definition(collection_index);
 	if (!definition) return NULL;
 	
-	void *tint_table= get_collection_header(collection_index)->shading_tables;
-
-	tint_table = (uint8 *)tint_table + get_shading_table_size(collection_index)*definition->clut_count + shading_table_size*tint_index;
+	shading_table_set *shading_tables= get_collection_header(collection_index)->shading_tables;
+	if (!shading_tables || tint_index<0 || tint_index>=NUMBER_OF_TINT_TABLES) return NULL;
 	
-	return tint_table;
+	shading_table_recipe& recipe= shading_tables->tints[tint_index];
+	return recipe.table ? recipe.table : build_shading_table(collection_index, recipe, true);
 }
 
 // LP additions:
@@ -30,6 +30,8 @@
 #include "images.h"
 #include "shell.h" // get_shape_surface!?
 #include "Shape_Blitter.h"
+#include "screen.h"
+#include "textures.h"
 
 #if defined(__WIN32__) || defined(__MINGW32__)
 #undef DrawText
@@ -60,15 +62,27 @@ void HUD_SW_Class::update_motion_sensor(short time_elapsed)
  *  Draw shapes
  */
 
+// Everything drawn into the HUD buffer asks for that part of it to be copied to the screen
+static void damage(screen_rectangle *r)
+{
+	RequestDrawingHUD(r->left, r->top, r->right, r->bottom);
+}
+
 void HUD_SW_Class::DrawShape(shape_descriptor shape, screen_rectangle *dest, screen_rectangle *src)
 {
 	_draw_screen_shape(shape, dest, src);
+	damage(dest);
 }
 
 void HUD_SW_Class::DrawShapeAtXY(shape_descriptor shape, short x, short y, bool transparency)
 {
 	// "transparency" is only used for OpenGL motion sensor
 	_draw_screen_shape_at_x_y(shape, x, y);
+
+	bitmap_definition *bitmap;
+	get_shape_bitmap_and_shading_table(shape, &bitmap, (void **) NULL, NONE);
+	if (bitmap)
+		RequestDrawingHUD(x, y, x + bitmap->width, y + bitmap->height);
 }
 
 extern SDL_Surface *HUD_Buffer;
@@ -130,6 +144,7 @@ void HUD_SW_Class::DrawTexture(shape_descriptor shape, short texture_type, short
     r.x = x + (size - r.w)/2;
     r.y = y + (size - r.h)/2;
     b.SDL_Draw(HUD_Buffer, r);
+    RequestDrawingHUD(r.x, r.y, r.x + r.w, r.y + r.h);
 }
 
 /*
@@ -139,6 +154,7 @@ void HUD_SW_Class::DrawTexture(shape_descriptor shape, short texture_type, short
 void HUD_SW_Class::DrawText(const char *text, screen_rectangle *dest, short flags, short font_id, short text_color)
 {
 	_draw_screen_text(text, dest, flags, font_id, text_color);
+	damage(dest);
 }
 
 
@@ -149,6 +165,7 @@ void HUD_SW_Class::DrawText(const char *text, screen_rectangle *dest, short flag
 void HUD_SW_Class::FillRect(screen_rectangle *r, short color_index)
 {
 	_fill_rect(r, color_index);
+	damage(r);
 }
 
 
@@ -159,4 +176,5 @@ void HUD_SW_Class::FillRect(screen_rectangle *r, short color_index)
 void HUD_SW_Class::FrameRect(screen_rectangle *r, short color_index)
 {
 	_frame_rect(r, color_index);
+	damage(r);
 }
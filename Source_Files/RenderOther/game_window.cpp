@@ -305,20 +305,16 @@ void update_interface(short time_elapsed)
 
 	if (!game_window_is_full_screen())
 	{
-		// LP addition: don't force an update unless explicitly requested
-		bool force_update = (time_elapsed == NONE);
-
 		ensure_HUD_buffer();
 
 		// LP addition: added support for HUD buffer;
 		_set_port_to_HUD();
-		if (HUD_SW.update_everything(time_elapsed))
-			force_update = true;
+		HUD_SW.update_everything(time_elapsed);
 		_restore_port();
 		
-		// Draw the whole thing if doing so is requested
-		// (may need some smart way of drawing only what has to be drawn)
-		if (force_update)
+		// Draw the whole thing if doing so is requested; otherwise
+		// HUD_SW has asked for just the parts it drew into
+		if (time_elapsed == NONE)
 			RequestDrawingHUD();
 	}
 }
@@ -145,6 +145,7 @@ static void DisplayPosition(SDL_Surface *s);
 static void DisplayMessages(SDL_Surface *s);
 static void DisplayNetMicStatus(SDL_Surface *s);
 static void DrawSurface(SDL_Surface *s, SDL_Rect &dest_rect, SDL_Rect &src_rect);
+static bool draw_HUD_damage(const SDL_Rect &dest_rect);
 static void clear_screen_margin();
 
 SDL_PixelFormat pixel_format_16 = {
@@ -290,6 +291,8 @@ void Screen::Initialize(screen_mode_data* mode)
 			graphics_preferences->screen_mode.height = 480;
 			write_preferences();
 		}
+		
+		Console::instance()->register_command("profile", profile_command());
 	} else {
 
 		unload_all_collections();
@@ -508,6 +511,7 @@ SDL_Rect Screen::hud_rect()
 
 static void reallocate_world_pixels(int width, int height)
 {
+	wait_for_background_rasterizer();
 	if (world_pixels) {
 		SDL_FreeSurface(world_pixels);
 		world_pixels = NULL;
@@ -596,6 +600,7 @@ void enter_screen(void)
 	
 	// Set screen to selected size
 	in_game = true;
+	reset_frame_profile();
 	change_screen_mode(_screentype_level);
 	PrevFullscreen = screen_mode.fullscreen;
 
@@ -641,6 +646,7 @@ void enter_screen(void)
 
 void exit_screen(void)
 {
+	stop_background_rasterizer();
 	in_game = false;
 #ifdef HAVE_OPENGL
 	OGL_StopRun();
@@ -1038,6 +1044,12 @@ static bool clear_next_screen = false;
 
 void render_screen(short ticks_elapsed)
 {
+	// The last pipelined view has been drawing while the world was updated;
+	// any time left waiting for it is rasterizing time
+	frame_profile_begin(_frame_stage_rasterize);
+	wait_for_background_rasterizer();
+	frame_profile_end(_frame_stage_rasterize);
+
 	// Make whatever changes are necessary to the world_view structure based on whichever player is frontmost
 	world_view->ticks_elapsed = ticks_elapsed;
 	world_view->tick_count = dynamic_world->tick_count;
@@ -1220,8 +1232,29 @@ void render_screen(short ticks_elapsed)
     if (screen_mode.acceleration != _no_acceleration)
         clear_screen_margin();
     
-	// Render world view
-	render_view(world_view, world_pixels_structure);
+	// Render world view; when pipelined, what's shown below is the view recorded
+	// last time, and this one is drawn while the next tick is being computed
+	bool pipelined = graphics_preferences->software_render_pipelining &&
+		screen_mode.acceleration == _no_acceleration &&
+		!world_view->overhead_map_active && !world_view->terminal_mode_active;
+	// the map and terminals only pause pipelining, but the thread isn't
+	// kept once it has been turned off
+	if (!graphics_preferences->software_render_pipelining ||
+		screen_mode.acceleration != _no_acceleration)
+		stop_background_rasterizer();
+	render_view_timings timings;
+	obj_clear(timings);
+	Uint64 render_start = machine_microsecond_count();
+	render_view(world_view, world_pixels_structure, &timings, pipelined);
+	
+	// The stages follow one another
+	add_frame_profile_event(_frame_stage_vis_tree, render_start, timings.build_render_tree);
+	render_start += timings.build_render_tree;
+	add_frame_profile_event(_frame_stage_sort, render_start, timings.sort_render_tree);
+	render_start += timings.sort_render_tree;
+	add_frame_profile_event(_frame_stage_place_objects, render_start, timings.build_render_object_list);
+	render_start += timings.build_render_object_list;
+	add_frame_profile_event(_frame_stage_rasterize, render_start, timings.render_tree);
 
     // clear Lua drawing from previous frame
     // (SDL is slower if we do this before render_view)
@@ -1248,6 +1281,7 @@ void render_screen(short ticks_elapsed)
 	  if (!chat_input_mode){
 		update_fps_display(disp_pixels);
 	  }
+	  DisplayFrameProfile(disp_pixels);
 	  DisplayPosition(disp_pixels);
 	  DisplayNetMicStatus(disp_pixels);
 	  DisplayScores(disp_pixels);
@@ -1266,12 +1300,14 @@ void render_screen(short ticks_elapsed)
 	if (screen_mode.acceleration != _no_acceleration) {
 #ifdef HAVE_OPENGL
 		if (Screen::instance()->hud()) {
+			frame_profile_begin(_frame_stage_hud);
 			if (Screen::instance()->lua_hud())
 				Lua_DrawHUD(ticks_elapsed);
 			else {
 				Rect dr = {HUD_DestRect.y, HUD_DestRect.x, HUD_DestRect.y + HUD_DestRect.h, HUD_DestRect.x + HUD_DestRect.w};
 				OGL_DrawHUD(dr, ticks_elapsed);
 			}
+			frame_profile_end(_frame_stage_hud);
 		}
 		
 		if (world_view->terminal_mode_active) {
@@ -1290,7 +1326,11 @@ void render_screen(short ticks_elapsed)
 		// Update world window
 		if (!world_view->terminal_mode_active &&
 			(!world_view->overhead_map_active || MapIsTranslucent))
+		{
+			frame_profile_begin(_frame_stage_swap);
 			update_screen(BufferRect, ViewRect, HighResolution);
+			frame_profile_end(_frame_stage_swap);
+		}
 		
 		// Update map
 		if (world_view->overhead_map_active) {
@@ -1299,15 +1339,24 @@ void render_screen(short ticks_elapsed)
 		}
 		
 		// Update HUD
+		frame_profile_begin(_frame_stage_hud);
 		if (Screen::instance()->lua_hud())
 		{
 			Lua_DrawHUD(ticks_elapsed);
 		}
 		else if (HUD_RenderRequest) {
-			SDL_Rect src_rect = { 0, 320, 640, 160 };
-			DrawSurface(HUD_Buffer, HUD_DestRect, src_rect);
+			if (HUD_RenderAll || !draw_HUD_damage(HUD_DestRect)) {
+				SDL_Rect src_rect = { 0, 320, 640, 160 };
+				DrawSurface(HUD_Buffer, HUD_DestRect, src_rect);
+				HUD_PixelsUpdated = HUD_DestRect.w * HUD_DestRect.h;
+			}
 			HUD_RenderRequest = false;
+			HUD_RenderAll = false;
+			HUD_DamagedRects.clear();
 		}
+		else
+			HUD_PixelsUpdated = 0;
+		frame_profile_end(_frame_stage_hud);
 
 		// Update terminal
 		if (world_view->terminal_mode_active) {
@@ -1318,6 +1367,7 @@ void render_screen(short ticks_elapsed)
 			}
 		}
 
+		frame_profile_begin(_frame_stage_swap);
 		if (update_full_screen || Screen::instance()->lua_hud())
 		{
 			SDL_UpdateRect(main_surface, 0, 0, 0, 0);
@@ -1328,21 +1378,146 @@ void render_screen(short ticks_elapsed)
 		{
 			SDL_UpdateRects(main_surface, 1, &ViewRect);
 		}
+		frame_profile_end(_frame_stage_swap);
 	}
 
 #ifdef HAVE_OPENGL
 	// Swap OpenGL double-buffers
 	if (screen_mode.acceleration != _no_acceleration)
+	{
+		frame_profile_begin(_frame_stage_swap);
 		OGL_SwapBuffers();
+		frame_profile_end(_frame_stage_swap);
+	}
 #endif
 	
 	Movie::instance()->AddFrame(Movie::FRAME_NORMAL);
+
+	if (pipelined)
+		rasterize_view_in_background();
+	
+	end_frame_profile();
+}
+
+/*
+ *  Render a view offscreen, for benchmarking
+ */
+
+uint32 render_benchmark_view(short width, short height, const world_point3d *origin, short polygon_index, short yaw, short pitch, render_view_timings &timings)
+{
+	// world_pixels_structure only has room for this many rows
+	assert(width > 0 && width <= MAXIMUM_WORLD_WIDTH);
+	assert(height > 0 && height <= MAXIMUM_WORLD_HEIGHT);
+
+	if (!world_pixels || world_pixels->w != width || world_pixels->h != height)
+		reallocate_world_pixels(width, height);
+
+	// Only the 3D view is timed
+	if (world_view->overhead_map_active)
+		set_overhead_map_status(false);
+	if (world_view->terminal_mode_active)
+		set_terminal_status(false);
+
+	world_view->ticks_elapsed = 1;
+	world_view->tick_count = dynamic_world->tick_count;
+	world_view->maximum_depth_intensity = current_player->weapon_intensity;
+	world_view->shading_mode = current_player->infravision_duration ? _shading_infravision : _shading_normal;
+	world_view->screen_width = width;
+	world_view->screen_height = height;
+	world_view->standard_screen_width = 2 * height;
+	initialize_view_data(world_view);
+
+	if (origin) {
+		world_view->origin = *origin;
+		world_view->origin_polygon_index = polygon_index;
+		world_view->yaw = yaw;
+		world_view->pitch = pitch;
+		world_view->show_weapons_in_hand = false;
+	} else {
+		world_view->origin = current_player->camera_location;
+		if (!graphics_preferences->screen_mode.camera_bob)
+			world_view->origin.z -= current_player->step_height;
+		world_view->origin_polygon_index = current_player->camera_polygon_index;
+		world_view->yaw = current_player->facing;
+		world_view->pitch = current_player->elevation;
+		world_view->show_weapons_in_hand = true;
+	}
+
+	world_pixels_structure->width = width;
+	world_pixels_structure->height = height;
+	world_pixels_structure->bytes_per_row = world_pixels->pitch;
+	world_pixels_structure->flags = 0;
+	world_pixels_structure->bit_depth = bit_depth;
+	world_pixels_structure->row_addresses[0] = (pixel8 *)world_pixels->pixels;
+	precalculate_bitmap_row_addresses(world_pixels_structure);
+
+	render_view(world_view, world_pixels_structure, &timings);
+
+	// FNV-1a over the visible pixels
+	uint32 checksum = 2166136261U;
+	int row_bytes = width * world_pixels->format->BytesPerPixel;
+	for (int y = 0; y < height; y++) {
+		const uint8 *p = (const uint8 *)world_pixels->pixels + y * world_pixels->pitch;
+		for (int x = 0; x < row_bytes; x++)
+			checksum = (checksum ^ p[x]) * 16777619U;
+	}
+	return checksum;
 }
 
 /*
  *  Blit world view to screen
  */
 
+/* the world view is scaled up 2x by writing each pixel out twice on two rows; with SSE2
+	the 16- and 32-bit versions duplicate eight or four pixels at a time */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SSE2_SCREEN_BLITS
+#include <emmintrin.h>
+#endif
+
+template <class T>
+static inline void quadruple_row(const T *src, T *dst, T *dst2, int width)
+{
+	for (int x=0; x<width; x++) {
+		T p = src[x];
+		dst[x * 2] = dst[x * 2 + 1] = p;
+		dst2[x * 2] = dst2[x * 2 + 1] = p;
+	}
+}
+
+#ifdef SSE2_SCREEN_BLITS
+static inline void quadruple_row(const pixel16 *src, pixel16 *dst, pixel16 *dst2, int width)
+{
+	int x = 0;
+	for (; width - x >= 8; x += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i low = _mm_unpacklo_epi16(p, p);
+		__m128i high = _mm_unpackhi_epi16(p, p);
+		_mm_storeu_si128((__m128i *)(dst + x * 2), low);
+		_mm_storeu_si128((__m128i *)(dst + x * 2 + 8), high);
+		_mm_storeu_si128((__m128i *)(dst2 + x * 2), low);
+		_mm_storeu_si128((__m128i *)(dst2 + x * 2 + 8), high);
+	}
+	quadruple_row<pixel16>(src + x, dst + x * 2, dst2 + x * 2, width - x);
+}
+
+static inline void quadruple_row(const pixel32 *src, pixel32 *dst, pixel32 *dst2, int width)
+{
+	int x = 0;
+	for (; width - x >= 4; x += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i low = _mm_unpacklo_epi32(p, p);
+		__m128i high = _mm_unpackhi_epi32(p, p);
+		_mm_storeu_si128((__m128i *)(dst + x * 2), low);
+		_mm_storeu_si128((__m128i *)(dst + x * 2 + 4), high);
+		_mm_storeu_si128((__m128i *)(dst2 + x * 2), low);
+		_mm_storeu_si128((__m128i *)(dst2 + x * 2 + 4), high);
+	}
+	quadruple_row<pixel32>(src + x, dst + x * 2, dst2 + x * 2, width - x);
+}
+#endif
+
 template <class T>
 static inline void quadruple_surface(const T *src, int src_pitch, T *dst, int dst_pitch, const SDL_Rect &dst_rect)
 {
@@ -1352,71 +1527,112 @@ static inline void quadruple_surface(const T *src, int src_pitch, T *dst, int ds
 	T *dst2 = dst + dst_pitch / sizeof(T);
 
 	while (height-- > 0) {
-		for (int x=0; x<width; x++) {
-			T p = src[x];
-			dst[x * 2] = dst[x * 2 + 1] = p;
-			dst2[x * 2] = dst2[x * 2 + 1] = p;
-		}
+		quadruple_row(src, dst, dst2, width);
 		src += src_pitch / sizeof(T);
 		dst += dst_pitch * 2 / sizeof(T);
 		dst2 += dst_pitch * 2 / sizeof(T);
 	}
 }
 
+/* gamma correction and pixel format conversion are one table lookup per channel: each
+	channel's bits, shifted down, index its gamma corrected bits in the destination format,
+	and a pixel is the three of them OR'd together */
+struct pixel_conversion_table
+{
+	uint32 shift[3];
+	uint32 mask[3];
+	uint32 bits[3][256];
+};
+
+static void build_pixel_conversion_table(pixel_conversion_table &table, SDL_PixelFormat *src, SDL_PixelFormat *dst, bool gamma)
+{
+	const uint32 src_masks[3] = { src->Rmask, src->Gmask, src->Bmask };
+	const uint32 src_shifts[3] = { src->Rshift, src->Gshift, src->Bshift };
+	const uint32 src_losses[3] = { src->Rloss, src->Gloss, src->Bloss };
+	const uint32 dst_masks[3] = { dst->Rmask, dst->Gmask, dst->Bmask };
+	const uint32 dst_shifts[3] = { dst->Rshift, dst->Gshift, dst->Bshift };
+	const uint32 dst_losses[3] = { dst->Rloss, dst->Gloss, dst->Bloss };
+	const uint16 *gamma_tables[3] = { current_gamma_r, current_gamma_g, current_gamma_b };
+
+	for (int c = 0; c < 3; c++) {
+		table.shift[c] = src_shifts[c];
+		table.mask[c] = std::min<uint32>(src_masks[c] >> src_shifts[c], 255);
+		for (uint32 v = 0; v <= table.mask[c]; v++) {
+			uint8 value = v << src_losses[c];
+			if (gamma)
+				value = gamma_tables[c][value] >> 8;
+			table.bits[c][v] = ((value >> dst_losses[c]) << dst_shifts[c]) & dst_masks[c];
+		}
+	}
+}
+
+template <class S, class D>
+static inline void convert_row(const S *src, D *dst, int width, const pixel_conversion_table &table)
+{
+	const uint32 rs = table.shift[0], gs = table.shift[1], bs = table.shift[2];
+	const uint32 rm = table.mask[0], gm = table.mask[1], bm = table.mask[2];
+	for (int x = 0; x < width; x++) {
+		uint32 px = src[x];
+		dst[x] = table.bits[0][(px >> rs) & rm] | table.bits[1][(px >> gs) & gm] | table.bits[2][(px >> bs) & bm];
+	}
+}
+
+// Converts (and gamma corrects) width x height source pixels into dst, doubling them if scale is 2;
+// a row at a time, so the scaled copy reads the converted pixels while they're still in cache
+template <class S, class D>
+static void convert_surface(const uint8 *src, int src_pitch, uint8 *dst, int dst_pitch, int width, int height, int scale, const pixel_conversion_table &table)
+{
+	std::vector<D> row(scale == 2 ? width : 0);
+	while (height-- > 0) {
+		if (scale == 2) {
+			convert_row((const S *)src, &row[0], width, table);
+			quadruple_row((const D *)&row[0], (D *)dst, (D *)(dst + dst_pitch), width);
+			dst += dst_pitch * 2;
+		} else {
+			convert_row((const S *)src, (D *)dst, width, table);
+			dst += dst_pitch;
+		}
+		src += src_pitch;
+	}
+}
+
+// False if either surface isn't 16- or 32-bit
+static bool convert_pixels(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect &dst_rect, int width, int height, int scale, bool gamma)
+{
+	if (width <= 0 || height <= 0)
+		return true;
+
+	pixel_conversion_table table;
+	build_pixel_conversion_table(table, src->format, dst->format, gamma);
+
+	const uint8 *s = static_cast<const uint8 *>(src->pixels);
+	uint8 *d = static_cast<uint8 *>(dst->pixels) + dst_rect.y * dst->pitch + dst_rect.x * dst->format->BytesPerPixel;
+	switch (src->format->BytesPerPixel * 8 + dst->format->BytesPerPixel) {
+		case 2 * 8 + 2:
+			convert_surface<pixel16, pixel16>(s, src->pitch, d, dst->pitch, width, height, scale, table);
+			break;
+		case 2 * 8 + 4:
+			convert_surface<pixel16, pixel32>(s, src->pitch, d, dst->pitch, width, height, scale, table);
+			break;
+		case 4 * 8 + 2:
+			convert_surface<pixel32, pixel16>(s, src->pitch, d, dst->pitch, width, height, scale, table);
+			break;
+		case 4 * 8 + 4:
+			convert_surface<pixel32, pixel32>(s, src->pitch, d, dst->pitch, width, height, scale, table);
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
 static void apply_gamma(SDL_Surface *src, SDL_Surface *dst)
 {
 	if (SDL_MUSTLOCK(dst)) {
 	    if (SDL_LockSurface(dst) < 0) return;
 	}
-	uint32 px, dst_px;
-	uint8 src_r, src_g, src_b;
-	uint8 dst_r, dst_g, dst_b;
-	
-	uint32 srm = src->format->Rmask, sgm = src->format->Gmask, sbm = src->format->Bmask;
-	uint32 drm = dst->format->Rmask, dgm = dst->format->Gmask, dbm = dst->format->Bmask;
-	uint32 srs = src->format->Rshift, sgs = src->format->Gshift, sbs = src->format->Bshift;
-	uint32 drs = dst->format->Rshift, dgs = dst->format->Gshift, dbs = dst->format->Bshift;
-	uint32 srl = src->format->Rloss, sgl = src->format->Gloss, sbl = src->format->Bloss;
-	uint32 drl = dst->format->Rloss, dgl = dst->format->Gloss, dbl = dst->format->Bloss;
-	
-	int sbpp = src->format->BytesPerPixel;
-	int dbpp = dst->format->BytesPerPixel;
-	uint8 *sptr = static_cast<uint8*>(src->pixels);
-	uint8 *dptr = static_cast<uint8*>(dst->pixels);
-	size_t numpixels = src->w * src->h;
-	for (size_t i = 0; i < numpixels; ++i) {
-		switch (sbpp) {
-			case 2:
-				px = reinterpret_cast<uint16*>(sptr)[i];
-				break;
-			case 4:
-				px = reinterpret_cast<uint32*>(sptr)[i];
-				break;
-			default:
-				return;
-		}
-	
-		src_r = ((px & srm) >> srs) << srl;
-		src_g = ((px & sgm) >> sgs) << sgl;
-		src_b = ((px & sbm) >> sbs) << sbl;
-		dst_r = current_gamma_r[src_r] >> 8;
-		dst_g = current_gamma_g[src_g] >> 8;
-		dst_b = current_gamma_b[src_b] >> 8;
-		dst_px = (((dst_r >> drl) << drs) & drm) |
-				 (((dst_g >> dgl) << dgs) & dgm) |
-				 (((dst_b >> dbl) << dbs) & dbm);
-			
-		switch (dbpp) {
-			case 2:
-				reinterpret_cast<uint16*>(dptr)[i] = dst_px;
-				break;
-			case 4:
-				reinterpret_cast<uint32*>(dptr)[i] = dst_px;
-				break;
-			default:
-				return;
-		}
-	}
+	SDL_Rect origin = { 0, 0, 0, 0 };
+	convert_pixels(src, dst, origin, std::min(src->w, dst->w), std::min(src->h, dst->h), 1, true);
 	if (SDL_MUSTLOCK(dst))
 		SDL_UnlockSurface(dst);
 }
@@ -1432,13 +1648,21 @@ static inline bool pixel_formats_equal(SDL_PixelFormat* a, SDL_PixelFormat* b)
 static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez)
 {
 	SDL_Surface *s = world_pixels;
-	if ((software_gamma || Movie::instance()->IsRecording()) && !using_default_gamma && bit_depth > 8) {
-		apply_gamma(world_pixels, world_pixels_corrected);
-		s = world_pixels_corrected;
-	}
-		
-	if (hi_rez) 
+	bool gamma = (software_gamma || Movie::instance()->IsRecording()) && !using_default_gamma && bit_depth > 8;
+	bool convert = s->format->BytesPerPixel != 1 && (gamma || !pixel_formats_equal(s->format, main_surface->format));
+
+	// gamma correction and format conversion happen on the way to the screen, in the same
+	// pass as the scaling, unless SDL has to clip the blit
+	bool fits = destination.x >= 0 && destination.y >= 0 &&
+		destination.x + (hi_rez ? s->w : destination.w) <= main_surface->w &&
+		destination.y + (hi_rez ? s->h : destination.h) <= main_surface->h;
+
+	if (hi_rez && !(convert && fits))
 	{
+		if (gamma) {
+			apply_gamma(world_pixels, world_pixels_corrected);
+			s = world_pixels_corrected;
+		}
 		SDL_BlitSurface(s, NULL, main_surface, &destination);
 	} 
 	else 
@@ -1449,23 +1673,40 @@ static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez)
 			if (SDL_LockSurface(main_surface) < 0) return;
 		}
 
-		if (s->format->BytesPerPixel != 1 && !pixel_formats_equal(s->format, main_surface->format))
+		if (convert && fits)
 		{
-			intermediary = SDL_ConvertSurface(s, main_surface->format, s->flags);
-			s = intermediary;
+			if (hi_rez)
+				convert_pixels(s, main_surface, destination, s->w, s->h, 1, gamma);
+			else
+				convert_pixels(s, main_surface, destination, destination.w / 2, destination.h / 2, 2, gamma);
 		}
-
-		switch (s->format->BytesPerPixel) 
+		else
 		{
-		case 1:
-			quadruple_surface((pixel8 *)s->pixels, s->pitch, (pixel8 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
-		case 2:
-			quadruple_surface((pixel16 *)s->pixels, s->pitch, (pixel16 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
-		case 4:
-			quadruple_surface((pixel32 *)s->pixels, s->pitch, (pixel32 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
+			if (convert)
+			{
+				if (gamma) {
+					apply_gamma(world_pixels, world_pixels_corrected);
+					s = world_pixels_corrected;
+				}
+				if (!pixel_formats_equal(s->format, main_surface->format))
+				{
+					intermediary = SDL_ConvertSurface(s, main_surface->format, s->flags);
+					s = intermediary;
+				}
+			}
+
+			switch (s->format->BytesPerPixel) 
+			{
+			case 1:
+				quadruple_surface((pixel8 *)s->pixels, s->pitch, (pixel8 *)main_surface->pixels, main_surface->pitch, destination);
+				break;
+			case 2:
+				quadruple_surface((pixel16 *)s->pixels, s->pitch, (pixel16 *)main_surface->pixels, main_surface->pitch, destination);
+				break;
+			case 4:
+				quadruple_surface((pixel32 *)s->pixels, s->pitch, (pixel32 *)main_surface->pixels, main_surface->pitch, destination);
+				break;
+			}
 		}
 		
 		if (SDL_MUSTLOCK(main_surface)) {
@@ -1664,9 +1905,11 @@ void render_overhead_map(struct view_data *view)
 	overhead_data.origin.x = view->origin.x;
 	overhead_data.origin.y = view->origin.y;
 
+	frame_profile_begin(_frame_stage_overhead_map);
 	_set_port_to_map();
 	_render_overhead_map(&overhead_data);
 	_restore_port();
+	frame_profile_end(_frame_stage_overhead_map);
 }
 
 
@@ -1812,6 +2055,80 @@ void validate_world_window(void)
  *  Draw the HUD or terminal (non-OpenGL)
  */
 
+template <class T>
+static void scale_HUD_rect(SDL_Surface *src, int x0, int y0, int x1, int y1, uint32 dx, uint32 dy, int dst_x, int dst_y)
+{
+	for (int y = y0; y < y1; y++) {
+		const T *p = (const T *)((const uint8 *)src->pixels + ((y * dy) >> 16) * src->pitch);
+		T *q = (T *)((uint8 *)main_surface->pixels + (dst_y + y) * main_surface->pitch) + dst_x;
+		for (int x = x0; x < x1; x++)
+			q[x] = p[(x * dx) >> 16];
+	}
+}
+
+// Copies only the parts of the HUD that were drawn into since the last time, each scaled
+// exactly as DrawSurface() would scale the whole of it; false if it can't
+static bool draw_HUD_damage(const SDL_Rect &dest_rect)
+{
+	if (!HUD_Buffer || HUD_Buffer->format->BytesPerPixel == 1 ||
+	    !pixel_formats_equal(HUD_Buffer->format, main_surface->format))
+		return false;
+	if (dest_rect.x < 0 || dest_rect.y < 0 ||
+	    dest_rect.x + dest_rect.w > main_surface->w || dest_rect.y + dest_rect.h > main_surface->h)
+		return false;
+
+	// The whole HUD buffer, scaled, and which rows of it the HUD is
+	double x_scale = dest_rect.w / 640.0;
+	double y_scale = dest_rect.h / 160.0;
+	int width = static_cast<int>(HUD_Buffer->w * x_scale);
+	int height = static_cast<int>(HUD_Buffer->h * y_scale);
+	if (width <= 0 || height <= 0)
+		return false;
+	uint32 dx = (HUD_Buffer->w << 16) / width;
+	uint32 dy = (HUD_Buffer->h << 16) / height;
+	int top = static_cast<Sint16>(320 * y_scale);
+	int right = static_cast<Uint16>(640 * x_scale);
+	int bottom = top + static_cast<Uint16>(160 * y_scale);
+
+	if (SDL_MUSTLOCK(main_surface) && SDL_LockSurface(main_surface) < 0)
+		return false;
+
+	std::vector<SDL_Rect> updated;
+	HUD_PixelsUpdated = 0;
+	for (size_t i = 0; i < HUD_DamagedRects.size(); i++)
+	{
+		// the scaled pixels that come from the damaged ones
+		const SDL_Rect &r = HUD_DamagedRects[i];
+		int x0 = std::max(0, static_cast<int>(((r.x << 16) + dx - 1) / dx));
+		int x1 = std::min(right, static_cast<int>((((r.x + r.w) << 16) + dx - 1) / dx));
+		int y0 = std::max(top, static_cast<int>(((r.y << 16) + dy - 1) / dy));
+		int y1 = std::min(bottom, static_cast<int>((((r.y + r.h) << 16) + dy - 1) / dy));
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		switch (main_surface->format->BytesPerPixel) {
+			case 2:
+				scale_HUD_rect<pixel16>(HUD_Buffer, x0, y0, x1, y1, dx, dy, dest_rect.x, dest_rect.y - top);
+				break;
+			case 4:
+				scale_HUD_rect<pixel32>(HUD_Buffer, x0, y0, x1, y1, dx, dy, dest_rect.x, dest_rect.y - top);
+				break;
+		}
+
+		SDL_Rect u = { static_cast<Sint16>(dest_rect.x + x0), static_cast<Sint16>(dest_rect.y + y0 - top),
+			static_cast<Uint16>(x1 - x0), static_cast<Uint16>(y1 - y0) };
+		updated.push_back(u);
+		HUD_PixelsUpdated += u.w * u.h;
+	}
+
+	if (SDL_MUSTLOCK(main_surface))
+		SDL_UnlockSurface(main_surface);
+
+	if (!updated.empty())
+		SDL_UpdateRects(main_surface, updated.size(), &updated[0]);
+	return true;
+}
+
 void DrawSurface(SDL_Surface *s, SDL_Rect &dest_rect, SDL_Rect &src_rect)
 {
 	if (s) {
@@ -145,6 +145,10 @@ enum /* screen selection based on game state */
 	_screentype_chapter
 };
 
+// Biggest possible of those defined
+#define MAXIMUM_WORLD_WIDTH 1900
+#define MAXIMUM_WORLD_HEIGHT 1200
+
 /* ---------- missing from QUICKDRAW.H */
 
 #define deviceIsGrayscale 0x0000
@@ -172,6 +176,33 @@ void start_extravision_effect(bool out);
 
 void render_screen(short ticks_elapsed);
 
+// Frame profiler: the time each frame spends in these stages is kept for the last
+// few hundred frames, for the "profile" console command's overlay and traces
+enum {
+	_frame_stage_input,
+	_frame_stage_update_world,
+	_frame_stage_vis_tree,
+	_frame_stage_sort,
+	_frame_stage_place_objects,
+	_frame_stage_rasterize,
+	_frame_stage_hud,
+	_frame_stage_overhead_map,
+	_frame_stage_swap,
+	NUMBER_OF_FRAME_STAGES
+};
+
+// A stage may be timed more than once in a frame; the times add up
+void frame_profile_begin(short stage);
+void frame_profile_end(short stage);
+
+// Renders the current player's view, or the given camera's if origin isn't NULL, into the
+// world buffer without drawing it to the screen; adds the time each stage of render_view()
+// took to timings and returns a checksum of the pixels; the size can't exceed
+// MAXIMUM_WORLD_WIDTH x MAXIMUM_WORLD_HEIGHT
+struct world_point3d;
+struct render_view_timings;
+uint32 render_benchmark_view(short width, short height, const world_point3d *origin, short polygon_index, short yaw, short pitch, render_view_timings &timings);
+
 void toggle_overhead_map_display_status(void);
 
 // Returns whether the size scale had been changed
@@ -218,6 +249,8 @@ bool SetTunnelVision(bool TunnelVisionOn);
 
 // Request for drawing the HUD
 void RequestDrawingHUD();
+// Request for drawing just part of it again, in the HUD buffer's coordinates
+void RequestDrawingHUD(short left, short top, short right, short bottom);
 // Request for drawing the terminal
 void RequestDrawingTerm();
 // Request for drawing (or redrawing) a menu or intro screen
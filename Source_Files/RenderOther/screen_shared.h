@@ -39,10 +39,6 @@ Jan 25, 2002 (Br'fin (Jeremy Parsons)):
 #define DESIRED_SCREEN_WIDTH 640
 #define DESIRED_SCREEN_HEIGHT 480
 
-// Biggest possible of those defined
-#define MAXIMUM_WORLD_WIDTH 1900
-#define MAXIMUM_WORLD_HEIGHT 1200
-
 #define DEFAULT_WORLD_WIDTH 640
 #define DEFAULT_WORLD_HEIGHT 320
 
@@ -72,13 +68,54 @@ bool displaying_fps= false;
 short frame_count, frame_index;
 int32 frame_ticks[64];
 
+// Frame profiler; frames are recorded all the time, so that a stutter can be
+// looked at after it happened
+#define FRAME_PROFILE_SIZE 600
+#define MAXIMUM_FRAME_EVENTS 32
+
+struct frame_profile_event {
+	short stage;
+	Uint64 start, duration;
+};
+
+struct frame_profile {
+	Uint64 start, end;
+	Uint64 stage_time[NUMBER_OF_FRAME_STAGES];
+	short event_count;
+	frame_profile_event events[MAXIMUM_FRAME_EVENTS];	// any beyond these only count in stage_time
+};
+
+static frame_profile frame_profiles[FRAME_PROFILE_SIZE];
+static short frame_profile_index = 0;	// the frame being recorded
+static short frame_profile_count = 0;	// finished frames before it
+static Uint64 frame_stage_start[NUMBER_OF_FRAME_STAGES];
+static bool displaying_frame_profile = false;
+
+static const char *frame_stage_names[NUMBER_OF_FRAME_STAGES] = {
+	"input",
+	"update_world",
+	"vis_tree",
+	"sort",
+	"place_objects",
+	"rasterize",
+	"hud",
+	"overhead_map",
+	"swap"
+};
+
 // LP addition:
 // whether to show one's position
 bool ShowPosition = false;
 bool ShowScores = false;
 
-// Whether rendering of the HUD has been requested
+// Whether rendering of the HUD has been requested; all of it, or only the parts of it
+// drawn into since it was last rendered
 static bool HUD_RenderRequest = false;
+static bool HUD_RenderAll = false;
+static std::vector<SDL_Rect> HUD_DamagedRects;
+
+// How many screen pixels drawing the HUD touched in the last frame
+static uint32 HUD_PixelsUpdated = 0;
 static bool Term_RenderRequest = false;
 
 static bool screen_initialized= false;
@@ -460,7 +497,7 @@ static void update_fps_display(SDL_Surface *s)
 	if (displaying_fps && !player_in_terminal_mode(current_player_index))
 	{
 		uint32 ticks = SDL_GetTicks();
-		char fps[sizeof("120.00fps (10000 ms)")];
+		char fps[sizeof("120.00fps (10000 ms) 4294967295 draws 4294967295 binds")];
 		char ms[sizeof("(10000 ms)")];
 		
 		frame_ticks[frame_index]= ticks;
@@ -483,6 +520,17 @@ static void update_fps_display(SDL_Surface *s)
 				sprintf(fps, "%lu%s %s",(unsigned long)TICKS_PER_SECOND,".00fps", ms);
 			else
 				sprintf(fps, "%3.2ffps %s", count, ms);
+			
+			// the software HUD only copies what changed to the screen
+			if (!alephone::Screen::instance()->openGL() && !alephone::Screen::instance()->lua_hud() && !game_window_is_full_screen())
+				sprintf(fps + strlen(fps), " HUD %lu px", (unsigned long)HUD_PixelsUpdated);
+
+			// the shader renderer batches surfaces by shader and texture
+			if (get_screen_mode()->acceleration == _shader_acceleration)
+			{
+				const render_tree_statistics& trees = get_render_tree_statistics();
+				sprintf(fps + strlen(fps), " %lu draws %lu binds", (unsigned long)trees.surface_draw_calls, (unsigned long)trees.surface_state_changes);
+			}
 		}
 		
 		FontSpecifier& Font = GetOnScreenFont();
@@ -511,6 +559,217 @@ static void update_fps_display(SDL_Surface *s)
 }
 
 
+static void add_frame_profile_event(short stage, Uint64 start, Uint64 duration)
+{
+	frame_profile& frame = frame_profiles[frame_profile_index];
+	frame.stage_time[stage] += duration;
+	if (frame.event_count < MAXIMUM_FRAME_EVENTS)
+	{
+		frame_profile_event& event = frame.events[frame.event_count++];
+		event.stage = stage;
+		event.start = start;
+		event.duration = duration;
+	}
+}
+
+void frame_profile_begin(short stage)
+{
+	frame_stage_start[stage] = machine_microsecond_count();
+}
+
+void frame_profile_end(short stage)
+{
+	Uint64 start = frame_stage_start[stage];
+	add_frame_profile_event(stage, start, machine_microsecond_count() - start);
+}
+
+// Forgets the frames so far, e.g. when a level starts after some time in the menus
+static void reset_frame_profile()
+{
+	frame_profile_count = 0;
+	obj_clear(frame_profiles[frame_profile_index]);
+}
+
+static void end_frame_profile()
+{
+	Uint64 now = machine_microsecond_count();
+	frame_profile& frame = frame_profiles[frame_profile_index];
+	
+	// The first frame has nothing to start from
+	if (frame.start)
+	{
+		frame.end = now;
+		frame_profile_index = (frame_profile_index + 1) % FRAME_PROFILE_SIZE;
+		if (frame_profile_count < FRAME_PROFILE_SIZE - 1)
+			frame_profile_count++;
+	}
+	
+	frame_profile& next = frame_profiles[frame_profile_index];
+	obj_clear(next);
+	next.start = now;
+}
+
+// The i-th of the last count finished frames, oldest first
+static frame_profile& recent_frame_profile(int i, int count)
+{
+	return frame_profiles[(frame_profile_index - count + i + FRAME_PROFILE_SIZE) % FRAME_PROFILE_SIZE];
+}
+
+static Uint64 frame_profile_percentile(std::vector<Uint64>& times, int percent)
+{
+	if (times.empty()) return 0;
+	
+	size_t n = (times.size() - 1) * percent / 100;
+	std::nth_element(times.begin(), times.begin() + n, times.end());
+	return times[n];
+}
+
+static void DisplayRect(SDL_Surface *s, SDL_Rect& rect, unsigned char r, unsigned char g, unsigned char b)
+{
+#ifdef HAVE_OPENGL
+	if((OGL_MapActive || !world_view->overhead_map_active) && !world_view->terminal_mode_active)
+		if (OGL_RenderTextCursor(rect, r, g, b)) return;
+#endif
+	
+	SDL_FillRect(s, &rect, SDL_MapRGB(world_pixels->format, r, g, b));
+}
+
+// A graph of the recent frame times, with the middle and slowest stage times
+static void DisplayFrameProfile(SDL_Surface *s)
+{
+	if (!displaying_frame_profile || player_in_terminal_mode(current_player_index)) return;
+	
+	const int GraphFrames = 120;
+	const int BarWidth = 2;
+	const int GraphHeight = 100;
+	const Uint64 MicrosecondsPerPixel = 500;
+	const Uint64 TickMicroseconds = 1000000 / TICKS_PER_SECOND;
+	
+	FontSpecifier& Font = GetOnScreenFont();
+	
+	DisplayTextDest = s;
+	DisplayTextFont = Font.Info;
+	DisplayTextStyle = Font.Style;
+	
+	short Offset = Font.LineSpacing / 3;
+	short X0 = s->w - GraphFrames*BarWidth - Offset;
+	short Y = Font.LineSpacing;
+	
+	int count = frame_profile_count;
+	std::vector<Uint64> times(count);
+	char line[64];
+	
+	for (int i = 0; i < count; i++)
+		times[i] = recent_frame_profile(i, count).end - recent_frame_profile(i, count).start;
+	sprintf(line, "frame  p50 %.1f  p99 %.1f ms", frame_profile_percentile(times, 50) / 1000.0, frame_profile_percentile(times, 99) / 1000.0);
+	DisplayText(X0, Y, line);
+	Y += Font.LineSpacing;
+	
+	for (int stage = 0; stage < NUMBER_OF_FRAME_STAGES; stage++)
+	{
+		for (int i = 0; i < count; i++)
+			times[i] = recent_frame_profile(i, count).stage_time[stage];
+		Uint64 p99 = frame_profile_percentile(times, 99);
+		if (p99 == 0) continue;
+		
+		sprintf(line, "%s  p50 %.1f  p99 %.1f", frame_stage_names[stage], frame_profile_percentile(times, 50) / 1000.0, p99 / 1000.0);
+		DisplayText(X0, Y, line, 0xbf, 0xbf, 0xbf);
+		Y += Font.LineSpacing;
+	}
+	
+	// Bars from the bottom up, oldest on the left; green frames kept up with the game's ticks
+	short Bottom = Y + GraphHeight;
+	int shown = std::min(count, GraphFrames);
+	for (int i = 0; i < shown; i++)
+	{
+		frame_profile& frame = recent_frame_profile(count - shown + i, count);
+		Uint64 duration = frame.end - frame.start;
+		
+		SDL_Rect bar;
+		bar.w = BarWidth;
+		bar.h = std::max(1, int(std::min(Uint64(GraphHeight), duration / MicrosecondsPerPixel)));
+		bar.x = X0 + (GraphFrames - shown + i)*BarWidth;
+		bar.y = Bottom - bar.h;
+		
+		if (duration <= TickMicroseconds)
+			DisplayRect(s, bar, 0x00, 0xbf, 0x00);
+		else if (duration <= 2*TickMicroseconds)
+			DisplayRect(s, bar, 0xbf, 0xbf, 0x00);
+		else
+			DisplayRect(s, bar, 0xff, 0x00, 0x00);
+	}
+	
+	// A line at one tick
+	SDL_Rect tick;
+	tick.x = X0;
+	tick.w = GraphFrames*BarWidth;
+	tick.h = 1;
+	tick.y = Bottom - TickMicroseconds / MicrosecondsPerPixel;
+	DisplayRect(s, tick, 0x7f, 0x7f, 0x7f);
+}
+
+// Writes the last frames as a Chrome trace (chrome://tracing, or Perfetto)
+static bool save_frame_trace(FileSpecifier& File, int frames)
+{
+	int count = std::min(frames, int(frame_profile_count));
+	if (count <= 0) return false;
+	
+	Uint64 origin = recent_frame_profile(0, count).start;
+	std::string json = "{\"traceEvents\":[\n";
+	char event[256];
+	
+	for (int i = 0; i < count; i++)
+	{
+		frame_profile& frame = recent_frame_profile(i, count);
+		sprintf(event, "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lu,\"dur\":%lu,\"args\":{\"frame\":%d}},\n",
+			(unsigned long)(frame.start - origin), (unsigned long)(frame.end - frame.start), i);
+		json += event;
+		
+		for (int j = 0; j < frame.event_count; j++)
+		{
+			frame_profile_event& stage = frame.events[j];
+			sprintf(event, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lu,\"dur\":%lu},\n",
+				frame_stage_names[stage.stage], (unsigned long)(stage.start - origin), (unsigned long)stage.duration);
+			json += event;
+		}
+	}
+	
+	// No trailing comma
+	json.erase(json.size() - 2);
+	json += "\n]}\n";
+	
+	OpenedFile OFile;
+	if (!File.Open(OFile, true)) return false;
+	bool written = OFile.Write(json.size(), &json[0]);
+	OFile.Close();
+	return written;
+}
+
+// "profile" toggles the overlay; "profile save [frames]" writes a trace of the last frames
+struct profile_command
+{
+	void operator() (const std::string& arg) const {
+		if (arg.compare(0, 4, "save") != 0)
+		{
+			displaying_frame_profile = !displaying_frame_profile;
+			return;
+		}
+		
+		int frames = atoi(arg.c_str() + 4);
+		if (frames <= 0)
+			frames = FRAME_PROFILE_SIZE;
+		
+		FileSpecifier File;
+		File.SetToLocalDataDir();
+		File += "frame_trace.json";
+		if (save_frame_trace(File, frames))
+			screen_printf("Saved %s", File.GetPath());
+		else
+			screen_printf("An error occurred while saving the frame trace");
+	}
+};
+
+
 static void DisplayPosition(SDL_Surface *s)
 {
 	if (!ShowPosition) return;
@@ -900,6 +1159,35 @@ bool SetTunnelVision(bool TunnelVisionOn)
 void RequestDrawingHUD()
 {
 	HUD_RenderRequest = true;
+	HUD_RenderAll = true;
+}
+
+void RequestDrawingHUD(short left, short top, short right, short bottom)
+{
+	left = std::max<short>(left, 0);
+	top = std::max<short>(top, 0);
+	if (left >= right || top >= bottom)
+		return;
+
+	HUD_RenderRequest = true;
+	SDL_Rect r = { left, top, static_cast<Uint16>(right - left), static_cast<Uint16>(bottom - top) };
+
+	// Merge it with anything it overlaps, so no part is copied twice
+	for (size_t i = 0; i < HUD_DamagedRects.size(); )
+	{
+		SDL_Rect &d = HUD_DamagedRects[i];
+		if (d.x < r.x + r.w && r.x < d.x + d.w && d.y < r.y + r.h && r.y < d.y + d.h)
+		{
+			short x0 = std::min(d.x, r.x), y0 = std::min(d.y, r.y);
+			short x1 = std::max(d.x + d.w, r.x + r.w), y1 = std::max(d.y + d.h, r.y + r.h);
+			r.x = x0; r.y = y0; r.w = x1 - x0; r.h = y1 - y0;
+			HUD_DamagedRects.erase(HUD_DamagedRects.begin() + i);
+			i = 0;
+		}
+		else
+			i++;
+	}
+	HUD_DamagedRects.push_back(r);
 }
 
 // This is for requesting the drawing of the Terminal;
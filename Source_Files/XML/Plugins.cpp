@@ -33,10 +33,7 @@
 #include "InfoTree.h"
 #include "XML_ParseTreeRoot.h"
 #include "Scenario.h"
-
-#ifdef HAVE_ZZIP
-#include <zzip/lib.h>
-#endif
+#include "ZipArchive.h"
 
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -360,27 +357,25 @@ bool PluginLoader::ParseDirectory(FileSpecifier& dir)
 		{
 			ParseDirectory(file);
 		}
-#ifdef HAVE_ZZIP
 		else if (algo::ends_with(it->name, ".zip") || algo::ends_with(it->name, ".ZIP"))
 		{
-			// search it for a Plugin.xml file
-			ZZIP_DIR* zzipdir = zzip_dir_open(file.GetPath(), 0);
-			if (zzipdir)
+			// search it for a Plugin.xml file; this also primes the
+			// archive's index for everything the plugin loads later
+			boost::shared_ptr<ZipArchive> archive = ZipArchive::Open(file.GetPath());
+			if (archive)
 			{
-				ZZIP_DIRENT dirent;
-				while (zzip_dir_read(zzipdir, &dirent))
+				const std::vector<ZipArchive::Member>& members = archive->Members();
+				for (std::vector<ZipArchive::Member>::const_iterator member = members.begin(); member != members.end(); ++member)
 				{
-					if (strcmp(dirent.d_name, "Plugin.xml") == 0 || algo::ends_with(dirent.d_name, "/Plugin.xml"))
+					if (member->name == "Plugin.xml" || algo::ends_with(member->name, "/Plugin.xml"))
 					{
-						std::string archive = file.GetPath();
-						FileSpecifier file_name = FileSpecifier(archive.substr(0, archive.find_last_of('.'))) + dirent.d_name;
+						std::string path = file.GetPath();
+						FileSpecifier file_name = FileSpecifier(path.substr(0, path.find_last_of('.'))) + member->name;
 						ParsePlugin(file_name);
 					}
 				}
-				zzip_dir_close(zzipdir);
 			}
 		}
-#endif
 	}
 
 	return true;
@@ -391,6 +386,8 @@ extern std::vector<DirectorySpecifier> data_search_path;
 void Plugins::enumerate() {
 
 	logContext("parsing plugins");
+	// plugin archives may have changed since they were last indexed
+	ZipArchive::FlushCache();
 	PluginLoader loader;
 	
 	for (std::vector<DirectorySpecifier>::const_iterator it = data_search_path.begin(); it != data_search_path.end(); ++it) {
@@ -27,6 +27,7 @@
 #include <sstream>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
 
 #ifdef HAVE_SDL_IMAGE_H
 #include <SDL_image.h>
@@ -500,12 +501,12 @@ bool load_quick_save_dialog(FileSpecifier& saved_game)
 extern SDL_Surface *draw_surface;
 extern bool OGL_MapActive;
 
-static bool build_map_preview(std::ostringstream& ostream)
+static SDL_Surface *render_map_preview()
 {
     SDL_Rect r = {0, 0, RENDER_WIDTH, RENDER_HEIGHT};
     SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, r.w, r.h, 32, 0xff0000, 0x00ff00, 0x0000ff, 0);
     if (!surface)
-        return false;
+        return NULL;
 	
     SDL_FillRect(surface, &r, SDL_MapRGB(surface->format, 0, 0, 0));
 	
@@ -527,6 +528,16 @@ static bool build_map_preview(std::ostringstream& ostream)
     OGL_MapActive = old_OGL_MapActive;
     _restore_port();
 	
+    return surface;
+}
+
+// Runs on the saved game writer thread, which takes care of the surface
+static std::string encode_map_preview(SDL_Surface *surface)
+{
+    if (!surface)
+        return std::string();
+	
+    std::ostringstream ostream;
     SDL_RWops *rwops = SDL_RWFromOStream(ostream);
 #if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE_H)
     int ret = IMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
@@ -536,7 +547,7 @@ static bool build_map_preview(std::ostringstream& ostream)
     SDL_FreeSurface(surface);
     SDL_RWclose(rwops);
 	
-    return (ret == 0);
+    return (ret == 0) ? ostream.str() : std::string();
 }
 
 std::string build_save_metadata(QuickSave& save)
@@ -686,12 +697,13 @@ bool create_quick_save(void)
     save.save_file.AddPart(base + ".sgaA");
 	
     std::string metadata = build_save_metadata(save);
-    std::ostringstream image_stream;
-    bool success = build_map_preview(image_stream);
-    success = save_game_file(save.save_file, metadata, image_stream.str());
+    SDL_Surface *preview = render_map_preview();
+    // prune once the save is on disk, rather than waiting for it here
+    bool success = save_game_file(save.save_file, metadata, boost::bind(encode_map_preview, preview),
+                                  boost::bind(&QuickSaves::delete_surplus_saves, QuickSaves::instance(), environment_preferences->maximum_quick_saves));
+    if (!success && preview)
+        SDL_FreeSurface(preview);
     
-    if (success)
-        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
     return success;
 }
 
@@ -781,6 +793,7 @@ QuickSaves* QuickSaves::instance() {
 }
 
 void QuickSaves::enumerate() {
+    wait_for_saved_game_write();
     clear();
 	
     logContext("parsing quick saves");
@@ -221,6 +221,9 @@ static void usage(const char *prg_name)
 	  "\t[-s | --nosound]       Do not access the sound card\n"
 	  "\t[-m | --nogamma]       Disable gamma table effects (menu fades)\n"
           "\t[-j | --nojoystick]    Do not initialize joysticks\n"
+	  "\t[--benchmark-spans]    Time the software texture mappers and quit\n"
+	  "\t[--benchmark file]     Render a film or camera script offscreen,\n"
+	  "\t                       print per-frame timings and quit\n"
 	  // Documenting this might be a bad idea?
 	  // "\t[-i | --insecure_lua]  Allow Lua netscripts to take over your computer\n"
 	  "\tdirectory              Directory containing scenario data files\n"
@@ -237,6 +240,7 @@ static void usage(const char *prg_name)
 }
 
 extern bool handle_open_replay(FileSpecifier& File);
+extern bool run_render_benchmark(FileSpecifier& File);
 extern bool load_and_start_game(FileSpecifier& file);
 
 bool handle_open_document(const std::string& filename)
@@ -310,6 +314,7 @@ int main(int argc, char **argv)
 
 	// Parse arguments
 	char *prg_name = argv[0];
+	std::string benchmark_file;
 	argc--;
 	argv++;
 	while (argc > 0) {
@@ -334,6 +339,18 @@ int main(int argc, char **argv)
 			insecure_lua = true;
 		} else if (strcmp(*argv, "-d") == 0 || strcmp(*argv, "--debug") == 0) {
 		  option_debug = true;
+		} else if (strcmp(*argv, "--benchmark-spans") == 0) {
+			SDL_Init(0);
+			benchmark_texture_spans();
+			SDL_Quit();
+			exit(0);
+		} else if (strcmp(*argv, "--benchmark") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			benchmark_file = *argv;
+			// nothing is shown, so don't open a window or the sound card
+			SDL_putenv(const_cast<char*>("SDL_VIDEODRIVER=dummy"));
+			option_nosound = true;
 		} else if (*argv[0] != '-') {
 			// if it's a directory, make it the default data dir
 			// otherwise push it and handle it later
@@ -359,6 +376,12 @@ int main(int argc, char **argv)
 		// Initialize everything
 		initialize_application();
 
+		if (!benchmark_file.empty())
+		{
+			FileSpecifier f(benchmark_file);
+			exit(run_render_benchmark(f) ? 0 : 1);
+		}
+
 		for (std::vector<std::string>::iterator it = arg_files.begin(); it != arg_files.end(); ++it)
 		{
 			if (handle_open_document(*it))
@@ -684,6 +707,7 @@ void shutdown_application(void)
 
         already_shutting_down = true;
         
+	wait_for_saved_game_write();
 	WadImageCache::instance()->save_cache();
 	close_external_resources();
         
@@ -852,6 +876,9 @@ static void main_event_loop(void)
 		if (poll_event) {
 			global_idle_proc();
 
+			// Only polls that found something are worth a place in the frame profile
+			frame_profile_begin(_frame_stage_input);
+			bool processed_events = false;
 			while (true) {
 				SDL_Event event;
 				event.type = SDL_NOEVENT;
@@ -872,7 +899,10 @@ static void main_event_loop(void)
 					break;
 
 				process_event(event);
+				processed_events = true;
 			}
+			if (processed_events)
+				frame_profile_end(_frame_stage_input);
 		}
 
 		execute_timer_tasks(SDL_GetTicks());